@@ -3,6 +3,7 @@
 #include "i8259.h"
 #include "pit.h"
 #include "sys_calls.h"
+#include "wait_queue.h"
 #define RTC_cmd 0x70
 #define RTC_data 0x71
 
@@ -13,8 +14,9 @@
 // #define INIT_FREQ 8192
 #define MAX_FREQ 1024
 
-volatile int rtc_flag[NUM_TERMINALS];
+volatile uint32_t rtc_ticks[NUM_TERMINALS]; // Virtual ticks delivered to each terminal
 volatile uint32_t rtc_counter[NUM_TERMINALS];
+static wait_queue_t rtc_wait[NUM_TERMINALS]; // rtc_read callers sleeping until their next virtual tick
 volatile uint32_t rtc_freq[NUM_TERMINALS]= {INIT_RATE_DEFAULT,INIT_RATE_DEFAULT,INIT_RATE_DEFAULT}; // Default to the initial rate
 /*
  * RTC_init
@@ -40,35 +42,31 @@ void RTC_init() {
 
 /*
  * RTC_handler
- *   DESCRIPTION: The interrupt handler for the Real-Time Clock (RTC). It disables interrupts
- *                temporarily, checks for valid counters and then decrements the active counter,
- *                acknowledges the RTC interrupt to allow further interrupts, and finally,
- *                re-enables interrupts.
+ *   DESCRIPTION: The interrupt handler for the Real-Time Clock (RTC). The RTC runs at MAX_FREQ; each
+ *                terminal's counter divides that down to the frequency it asked for, and on each of
+ *                its virtual ticks rtc_ticks advances and any rtc_read sleepers are woken.
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: Disables and then re-enables interrupts. Acknowledges the RTC interrupt to
- *                 clear the interrupt request and allow for future RTC interrupts.
+ *   SIDE EFFECTS: Wakes rtc_read sleepers. Acknowledges the RTC interrupt to clear the interrupt
+ *                 request and allow for future RTC interrupts.
  */
 void RTC_handler() {
-
-    int curProcess = get_current_process(); // Function to get the current active thread index
-
-    int processes_active = 1;
     int i;
-    for(i = 1; i < NUM_TERMINALS; i++) {
-        if((base_shell_booted_bitmask >> i) & 0x1) {
-            processes_active++;
+    uint32_t period;
+
+    for(i = 0; i < NUM_TERMINALS; i++) { // Every terminal keeps time, not just the scheduled one
+        period = MAX_FREQ / rtc_freq[i];
+        if(period == 0) {
+            period = 1;
+        }
+        if((rtc_counter[i] % period) == 0) {
+            rtc_ticks[i]++;
+            wait_queue_wake(&rtc_wait[i]);
         }
+        rtc_counter[i]++; // Increment the counter for this terminal
     }
 
-	if((rtc_counter[curProcess] % (MAX_FREQ / (rtc_freq[curProcess] * processes_active))) == 0) {
-        // if(rtc_counter[curThread] % 256 == 0) {
-			rtc_flag[curProcess] = 0;
-			
-		}
-	rtc_counter[curProcess]++; // Increment the counter for the current thread
-
     outb(0x0C, RTC_cmd); // Unlock the RTC
     inb(RTC_data); // Clear interrupt flag
     send_eoi(8); // Send end of interrupt for the RTC to the PIC
@@ -85,9 +83,6 @@ void RTC_handler() {
  */
 int rtc_open(const uint8_t* filename) {
     cli(); // Disable interrupts
-	int curProcess = get_current_process();
-    rtc_flag[curProcess] = 0; // Reset the RTC interrupt
-
     // Set initial rate in register A
     outb(RTC_register_A, RTC_cmd); // Select register A
     char prev = inb(RTC_data); // Read current value of register A
@@ -150,23 +145,24 @@ int rtc_write(int32_t fd, const void* buf, int32_t nbytes) {
 
 /*
  * rtc_read
- *   DESCRIPTION: Waits for an RTC interrupt to occur (signaled by rtc_flag), effectively
+ *   DESCRIPTION: Waits for the terminal's next virtual RTC tick (rtc_ticks advancing), effectively
  *                synchronizing on the RTC's interrupt rate.
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: 0 indicating success
- *   SIDE EFFECTS: Blocks until an RTC interrupt occurs.
+ *   SIDE EFFECTS: Sleeps on the terminal's wait queue until its next virtual RTC tick.
  */
 int rtc_read(int32_t fd, void* buf, int32_t nbytes) {
     int curProcess = get_current_process(); // Assume function to get current thread index
+    uint32_t flags;
 
-    rtc_flag[curProcess] = 1; // Set the flag to wait for an interrupt
+    cli_and_save(flags);
+    uint32_t start = rtc_ticks[curProcess]; // Every reader waits for the next tick, however many there are
 
-    while (rtc_flag[curProcess] == 1) {
-        // Wait for the RTC_handler to clear the flag
+    while (rtc_ticks[curProcess] == start) {
+        wait_queue_sleep(&rtc_wait[curProcess]); // Sleep until the RTC_handler delivers a tick
     }
-
-    rtc_flag[curProcess] = 1; // Reset the flag for future reads
+    restore_flags(flags);
 
     return 0; // Success
 }
@@ -0,0 +1,340 @@
+#include "apic.h"
+#include "i8259.h"
+#include "pit.h"
+#include "paging.h"
+#include "lib.h"
+
+#define PIT_CH2_PORT   0x42
+#define PIT_CMD_PORT   0x43
+#define PIT_GATE_PORT  0x61
+#define IMCR_SELECT    0x22                     // Interrupt mode configuration register, on MP systems that have one
+#define IMCR_DATA      0x23
+
+int apic_enabled = 0;                 // Interrupts go through the IOAPIC and local APIC instead of the 8259
+volatile uint32_t* lapic = (volatile uint32_t*)LAPIC_VIRT;
+static volatile uint32_t* ioapic = (volatile uint32_t*)IOAPIC_VIRT;
+static uint32_t ioapic_pins = 0;      // Redirection entries the IOAPIC has
+static uint32_t lapic_ticks_per_ms = 0; // APIC timer rate at LAPIC_TIMER_DIV_16, from apic_timer_calibrate
+
+#ifdef USE_APIC
+/*
+ * ioapic_read
+ *   DESCRIPTION: Reads an IOAPIC register through its index/data window
+ *   INPUTS: reg - register index
+ *   OUTPUTS: none
+ *   RETURN VALUE: register value
+ *   SIDE EFFECTS: Called with interrupts disabled (the window is shared)
+ */
+static uint32_t ioapic_read(uint32_t reg) {
+    ioapic[0] = reg;
+    return ioapic[4]; // Data window at byte offset 0x10
+}
+#endif
+
+/*
+ * ioapic_write
+ *   DESCRIPTION: Writes an IOAPIC register through its index/data window
+ *   INPUTS: reg - register index
+ *           value - value to write
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Called with interrupts disabled (the window is shared)
+ */
+static void ioapic_write(uint32_t reg, uint32_t value) {
+    ioapic[0] = reg;
+    ioapic[4] = value;
+}
+
+#ifdef USE_APIC
+/*
+ * apic_present
+ *   DESCRIPTION: Checks CPUID for a local APIC and the MSRs needed to find and enable it
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: nonzero if the CPU has both
+ *   SIDE EFFECTS: none
+ */
+static int apic_present() {
+    uint32_t eax, ebx, ecx, edx;
+
+    asm volatile ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+    return (edx & CPUID_APIC) && (edx & CPUID_MSR);
+}
+
+/*
+ * apic_timer_calibrate
+ *   DESCRIPTION: Measures the APIC timer rate by counting it down across an APIC_CAL_MS one-shot countdown
+ *                on PIT channel 2 (the speaker channel, which nothing else uses)
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Sets lapic_ticks_per_ms, reprograms PIT channel 2
+ */
+static void apic_timer_calibrate() {
+    uint32_t latch = PIT_FREQ / 1000 * APIC_CAL_MS;
+
+    lapic[LAPIC_TIMER_DIV / 4] = LAPIC_TIMER_DIV_16;
+    lapic[LAPIC_LVT_TIMER / 4] = LAPIC_LVT_MASKED | APIC_TIMER_VECTOR;
+
+    outb((inb(PIT_GATE_PORT) & ~0x02) | 0x01, PIT_GATE_PORT); // Gate channel 2 on, speaker off
+    outb(0xB0, PIT_CMD_PORT); // Channel 2, lobyte/hibyte, mode 0 (interrupt on terminal count)
+    outb(latch & 0xFF, PIT_CH2_PORT);
+    outb(latch >> 8, PIT_CH2_PORT);
+
+    lapic[LAPIC_TIMER_INIT / 4] = 0xFFFFFFFF;
+    while (!(inb(PIT_GATE_PORT) & 0x20)); // Channel 2 output goes high at terminal count
+    lapic_ticks_per_ms = (0xFFFFFFFF - lapic[LAPIC_TIMER_CUR / 4]) / APIC_CAL_MS;
+    lapic[LAPIC_TIMER_INIT / 4] = 0;
+    if (lapic_ticks_per_ms == 0) {
+        lapic_ticks_per_ms = 1;
+    }
+}
+#endif
+
+/*
+ * apic_init
+ *   DESCRIPTION: Switches interrupt delivery from the 8259 to the APICs if the machine has them: maps the
+ *                local APIC (found through IA32_APIC_BASE) and the IOAPIC, enables the local APIC, masks
+ *                every IOAPIC pin and the whole 8259, and calibrates the APIC timer. From then on
+ *                enable_irq/disable_irq program IOAPIC pins (ISA IRQ n on pin n, vector 0x20 + n, as on a
+ *                PC) and send_eoi is a local APIC write. Leaves the 8259 in charge if there's no APIC.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Sets apic_enabled. Must run after i8259_init and setup_kernel_paging, and before any
+ *                 enable_irq or pit_init.
+ */
+void apic_init() {
+#ifdef USE_APIC
+    uint32_t base_lo, base_hi;
+    uint32_t version, pin;
+    uint32_t lapic_id; // Where the IOAPIC sends interrupts
+
+    if (!apic_present()) {
+        return;
+    }
+    asm volatile ("rdmsr" : "=a" (base_lo), "=d" (base_hi) : "c" (IA32_APIC_BASE_MSR));
+    kernel_map_mmio(LAPIC_VIRT, base_lo & ~(PAGE_SIZE - 1));
+    kernel_map_mmio(IOAPIC_VIRT, IOAPIC_PHYS);
+
+    version = ioapic_read(IOAPIC_VER);
+    ioapic_pins = ((version >> 16) & 0xFF) + 1;
+    if (version == 0xFFFFFFFF || ioapic_pins < 16) {
+        return; // Nothing (or no usable IOAPIC) answers there: stay on the 8259
+    }
+
+    // Enable the local APIC, both in the MSR and in software
+    asm volatile ("wrmsr" : : "a" (base_lo | APIC_BASE_ENABLE), "d" (base_hi), "c" (IA32_APIC_BASE_MSR));
+    lapic[LAPIC_SVR / 4] = LAPIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR;
+    lapic[LAPIC_TPR / 4] = 0; // Accept every priority
+    lapic[LAPIC_LVT_LINT0 / 4] = LAPIC_LVT_MASKED; // The 8259's virtual wire
+    lapic_id = lapic[LAPIC_ID / 4] >> 24;
+
+    for (pin = 0; pin < ioapic_pins; pin++) {
+        ioapic_write(IOAPIC_REDTBL + 2 * pin + 1, lapic_id << 24);
+        ioapic_write(IOAPIC_REDTBL + 2 * pin, IOAPIC_MASKED | (APIC_IRQ_VECTOR + pin));
+    }
+
+    // Take the 8259 out of the path: mask it, and route the interrupt lines to the APIC where there's an IMCR
+    outb(0xFF, MASTER_8259_DATA_PORT);
+    outb(0xFF, SLAVE_8259_DATA_PORT);
+    outb(0x70, IMCR_SELECT);
+    outb(0x01, IMCR_DATA);
+
+    apic_timer_calibrate();
+    apic_enabled = 1;
+#endif
+}
+
+/*
+ * apic_init_ap
+ *   DESCRIPTION: Enables an application processor's own local APIC the way apic_init did the boot CPU's,
+ *                and sets its timer divider (the rate apic_timer_calibrate measured is the same bus clock)
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Runs on the AP, from ap_main
+ */
+void apic_init_ap() {
+    uint32_t base_lo, base_hi;
+
+    asm volatile ("rdmsr" : "=a" (base_lo), "=d" (base_hi) : "c" (IA32_APIC_BASE_MSR));
+    asm volatile ("wrmsr" : : "a" (base_lo | APIC_BASE_ENABLE), "d" (base_hi), "c" (IA32_APIC_BASE_MSR));
+    lapic[LAPIC_SVR / 4] = LAPIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR;
+    lapic[LAPIC_TPR / 4] = 0;
+    lapic[LAPIC_LVT_LINT0 / 4] = LAPIC_LVT_MASKED;
+    lapic[LAPIC_TIMER_DIV / 4] = LAPIC_TIMER_DIV_16;
+    lapic[LAPIC_LVT_TIMER / 4] = LAPIC_LVT_MASKED | APIC_TIMER_VECTOR;
+}
+
+/*
+ * apic_id
+ *   DESCRIPTION: The running CPU's local APIC ID, which IPIs are addressed to
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: APIC ID
+ *   SIDE EFFECTS: none
+ */
+uint32_t apic_id() {
+    return lapic[LAPIC_ID / 4] >> 24;
+}
+
+/*
+ * apic_icr_send
+ *   DESCRIPTION: Sends an IPI once the previous one has left
+ *   INPUTS: dest - destination APIC ID (ignored with a shorthand)
+ *           command - low word of the interrupt command register
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void apic_icr_send(uint32_t dest, uint32_t command) {
+    uint32_t flags;
+
+    cli_and_save(flags);
+    while (lapic[LAPIC_ICR_LO / 4] & ICR_PENDING);
+    lapic[LAPIC_ICR_HI / 4] = dest << 24;
+    lapic[LAPIC_ICR_LO / 4] = command;
+    restore_flags(flags);
+}
+
+/*
+ * apic_send_ipi
+ *   DESCRIPTION: Interrupts another CPU on a vector
+ *   INPUTS: dest - its APIC ID
+ *           vector - interrupt vector
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Doesn't wait for the interrupt to be handled
+ */
+void apic_send_ipi(uint32_t dest, uint32_t vector) {
+    apic_icr_send(dest, ICR_ASSERT | ICR_FIXED | vector);
+}
+
+/*
+ * apic_broadcast_ipi
+ *   DESCRIPTION: Interrupts every other CPU on a vector
+ *   INPUTS: vector - interrupt vector
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Doesn't wait for the interrupts to be handled
+ */
+void apic_broadcast_ipi(uint32_t vector) {
+    apic_icr_send(0, ICR_ALL_BUT_SELF | ICR_ASSERT | ICR_FIXED | vector);
+}
+
+/*
+ * apic_delay_us
+ *   DESCRIPTION: Busy-waits on a one-shot countdown of PIT channel 2
+ *   INPUTS: us - microseconds, at most 54000
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Reprograms PIT channel 2
+ */
+void apic_delay_us(uint32_t us) {
+    uint32_t latch = us * PIT_KHZ / 1000 + 1;
+
+    outb((inb(PIT_GATE_PORT) & ~0x02) | 0x01, PIT_GATE_PORT); // Gate channel 2 on, speaker off
+    outb(0xB0, PIT_CMD_PORT); // Channel 2, lobyte/hibyte, mode 0
+    outb(latch & 0xFF, PIT_CH2_PORT);
+    outb(latch >> 8, PIT_CH2_PORT);
+    while (!(inb(PIT_GATE_PORT) & 0x20));
+}
+
+/*
+ * apic_start_aps
+ *   DESCRIPTION: Wakes every other CPU with the INIT, startup, startup IPI sequence of the MP specification.
+ *                They're addressed all at once (the kernel doesn't read the MP or ACPI tables, so it doesn't
+ *                know their APIC IDs) and start in real mode at the given page.
+ *   INPUTS: start_page - physical page below 1MB holding the startup code, >> 12
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Takes about 10ms. The APs number themselves as they come up, see ap_start.
+ */
+void apic_start_aps(uint32_t start_page) {
+    apic_icr_send(0, ICR_ALL_BUT_SELF | ICR_ASSERT | ICR_INIT);
+    apic_delay_us(AP_INIT_WAIT_US);
+    apic_icr_send(0, ICR_ALL_BUT_SELF | ICR_ASSERT | ICR_STARTUP | start_page);
+    apic_delay_us(AP_SIPI_WAIT_US);
+    apic_icr_send(0, ICR_ALL_BUT_SELF | ICR_ASSERT | ICR_STARTUP | start_page);
+    apic_delay_us(AP_SIPI_WAIT_US);
+}
+
+/*
+ * ioapic_enable_irq
+ *   DESCRIPTION: Unmasks the IOAPIC pin of an ISA IRQ: edge triggered, active high, fixed delivery to this
+ *                CPU on vector APIC_IRQ_VECTOR + irq
+ *   INPUTS: irq_num - ISA IRQ
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Called through enable_irq
+ */
+void ioapic_enable_irq(uint32_t irq_num) {
+    uint32_t flags;
+
+    if (irq_num >= ioapic_pins) {
+        return;
+    }
+    cli_and_save(flags);
+    ioapic_write(IOAPIC_REDTBL + 2 * irq_num, APIC_IRQ_VECTOR + irq_num);
+    restore_flags(flags);
+}
+
+/*
+ * ioapic_disable_irq
+ *   DESCRIPTION: Masks the IOAPIC pin of an ISA IRQ
+ *   INPUTS: irq_num - ISA IRQ
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Called through disable_irq
+ */
+void ioapic_disable_irq(uint32_t irq_num) {
+    uint32_t flags;
+
+    if (irq_num >= ioapic_pins) {
+        return;
+    }
+    cli_and_save(flags);
+    ioapic_write(IOAPIC_REDTBL + 2 * irq_num, IOAPIC_MASKED | (APIC_IRQ_VECTOR + irq_num));
+    restore_flags(flags);
+}
+
+/*
+ * apic_timer_count
+ *   DESCRIPTION: Converts a delay to APIC timer counts, without overflowing for the longest delays
+ *   INPUTS: us - microseconds
+ *   OUTPUTS: none
+ *   RETURN VALUE: counts, at least 1
+ *   SIDE EFFECTS: none
+ */
+static uint32_t apic_timer_count(uint32_t us) {
+    uint32_t count = us / 1000 * lapic_ticks_per_ms + us % 1000 * lapic_ticks_per_ms / 1000;
+
+    return count != 0 ? count : 1;
+}
+
+/*
+ * apic_timer_oneshot
+ *   DESCRIPTION: Starts a one-shot APIC timer countdown, replacing any current one
+ *   INPUTS: us - microseconds until the interrupt (on APIC_TIMER_VECTOR)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Called with interrupts disabled
+ */
+void apic_timer_oneshot(uint32_t us) {
+    lapic[LAPIC_LVT_TIMER / 4] = APIC_TIMER_VECTOR;
+    lapic[LAPIC_TIMER_INIT / 4] = apic_timer_count(us);
+}
+
+/*
+ * apic_timer_periodic
+ *   DESCRIPTION: Starts the APIC timer interrupting every us microseconds
+ *   INPUTS: us - period in microseconds
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void apic_timer_periodic(uint32_t us) {
+    lapic[LAPIC_LVT_TIMER / 4] = LAPIC_TIMER_PERIODIC | APIC_TIMER_VECTOR;
+    lapic[LAPIC_TIMER_INIT / 4] = apic_timer_count(us);
+}
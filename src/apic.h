@@ -0,0 +1,78 @@
+#ifndef APIC_H
+#define APIC_H
+
+#include "types.h"
+
+#define USE_APIC                                // Use the local APIC and IOAPIC when present; comment out to force the 8259
+
+// Where the register pages are mapped: the top of the kernel's first 4MB, which otherwise only maps video memory
+#define LAPIC_VIRT          0x3FE000
+#define IOAPIC_VIRT         0x3FF000
+#define IOAPIC_PHYS         0xFEC00000          // The standard PC address (not read from the ACPI tables)
+
+// Local APIC registers (byte offsets)
+#define LAPIC_ID            0x020
+#define LAPIC_TPR           0x080               // Task priority
+#define LAPIC_EOI           0x0B0
+#define LAPIC_SVR           0x0F0               // Spurious interrupt vector, and the software enable bit
+#define LAPIC_LVT_TIMER     0x320
+#define LAPIC_LVT_LINT0     0x350
+#define LAPIC_TIMER_INIT    0x380               // Initial count
+#define LAPIC_TIMER_CUR     0x390               // Current count
+#define LAPIC_TIMER_DIV     0x3E0               // Divide configuration
+#define LAPIC_ICR_LO        0x300               // Interrupt command: writing the low word sends the IPI
+#define LAPIC_ICR_HI        0x310               // Destination APIC ID in the top byte
+
+#define LAPIC_SVR_ENABLE    0x100
+#define LAPIC_LVT_MASKED    0x10000
+#define LAPIC_TIMER_PERIODIC 0x20000
+#define LAPIC_TIMER_DIV_16  0x3
+#define APIC_SPURIOUS_VECTOR 0xFF
+#define APIC_TIMER_VECTOR   0x20                // Same vector as the PIT, so pit_handler serves either
+#define APIC_IRQ_VECTOR     0x20                // ISA IRQ n arrives on vector APIC_IRQ_VECTOR + n, as with the 8259
+#define APIC_CAL_MS         10                  // Length of the PIT window used to calibrate the APIC timer
+#define APIC_RESCHED_VECTOR 0xF0                // IPI: a process was queued on this CPU, see sched_ipi
+#define APIC_TLB_VECTOR     0xF1                // IPI: flush the TLB, see smp_tlb_shootdown
+
+// Interrupt command register fields
+#define ICR_FIXED           0x000
+#define ICR_INIT            0x500
+#define ICR_STARTUP         0x600               // Vector field is the start page (physical address >> 12)
+#define ICR_PENDING         0x1000              // Delivery status: the last IPI hasn't been sent yet
+#define ICR_ASSERT          0x4000
+#define ICR_ALL_BUT_SELF    0xC0000             // Destination shorthand
+#define AP_INIT_WAIT_US     10000               // INIT to startup IPI, as in the MP specification
+#define AP_SIPI_WAIT_US     200                 // Between the two startup IPIs
+
+// IOAPIC registers, reached through the index register at IOAPIC_VIRT and the data window 0x10 above it
+#define IOAPIC_VER          0x01
+#define IOAPIC_REDTBL       0x10                // Redirection entry n: low word at 0x10 + 2n, high word after it
+#define IOAPIC_MASKED       0x10000
+
+#define IA32_APIC_BASE_MSR  0x1B
+#define APIC_BASE_ENABLE    0x800
+#define CPUID_APIC          (1 << 9)            // CPUID leaf 1, EDX
+#define CPUID_MSR           (1 << 5)
+
+extern int apic_enabled;
+extern volatile uint32_t* lapic;
+
+// See c file for descriptions
+void apic_init();
+void ioapic_enable_irq(uint32_t irq_num);
+void ioapic_disable_irq(uint32_t irq_num);
+void apic_timer_oneshot(uint32_t us);
+void apic_timer_periodic(uint32_t us);
+void apic_init_ap();
+uint32_t apic_id();
+void apic_send_ipi(uint32_t dest, uint32_t vector);
+void apic_broadcast_ipi(uint32_t vector);
+void apic_delay_us(uint32_t us);
+void apic_start_aps(uint32_t start_page);
+
+// Acknowledges the interrupt being serviced: one MMIO write instead of the 8259's port I/O
+static inline void apic_eoi() {
+    lapic[LAPIC_EOI / 4] = 0;
+}
+
+#endif
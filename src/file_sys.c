@@ -2,12 +2,36 @@
 
 
 
+// Open-addressed hash index over dentry names, built once by fileSystem_init.
+// Each slot holds a boot block dentry index + 1, so 0 marks an empty slot.
+static uint8_t dentry_hash[DENTRY_HASH_SIZE];
+
+/*
+ * dentry_name_hash
+ *   DESCRIPTION: FNV-1a hash of a file name. Stops at the first NUL or after MAX_FILE_NAME bytes,
+ *                matching how names are compared in read_dentry_by_name.
+ *   INPUTS: name: file name (need not be NUL terminated if it is MAX_FILE_NAME long)
+ *   RETURN VALUE: slot index in dentry_hash
+ *   SIDE EFFECTS: none
+ */
+static uint32_t dentry_name_hash(const uint8_t *name)
+{
+    uint32_t hash = 2166136261U; // FNV offset basis
+    uint32_t i;
+    for (i = 0; i < MAX_FILE_NAME && name[i] != '\0'; i++)
+    {
+        hash ^= name[i];
+        hash *= 16777619U; // FNV prime
+    }
+    return hash & (DENTRY_HASH_SIZE - 1);
+}
+
 /*
  * fileSystem_init
- *   DESCRIPTION: Function to initialize the file system
+ *   DESCRIPTION: Function to initialize the file system and build the dentry name index
  *   INPUTS: uint8_t* fs_start: file name to start
  *   RETURN VALUE: none
- *   SIDE EFFECTS: none
+ *   SIDE EFFECTS: Rebuilds dentry_hash
  */
 void fileSystem_init(uint8_t *fs_start)
 {
@@ -15,13 +39,31 @@ void fileSystem_init(uint8_t *fs_start)
     g_boot_block = (boot_block_t *)fs_start;
     g_inodes = (inode_t *)(fs_start + BLOCK_SIZE); // inodes start right after the boot block
     g_data_blocks = (data_block_t *)(fs_start + (1 + g_boot_block->num_inodes) * BLOCK_SIZE); // data blocks start right after bootblock + all inodes
+
+    uint32_t i, slot;
+    for (i = 0; i < DENTRY_HASH_SIZE; i++)
+    {
+        dentry_hash[i] = 0;
+    }
+
+    // Insert every dentry with linear probing; the table is never more than half full
+    for (i = 0; i < g_boot_block->num_dir_entries && i < MAX_FILES; i++)
+    {
+        slot = dentry_name_hash(g_boot_block->dir_entries[i].name);
+        while (dentry_hash[slot] != 0)
+        {
+            slot = (slot + 1) & (DENTRY_HASH_SIZE - 1);
+        }
+        dentry_hash[slot] = i + 1;
+    }
 }
 
 // -----------------read dentry by name, read dentry by index and read data--------------------
 
 /*
  * read_dentry_by_name
- *   DESCRIPTION: Function to read a directory entry by name
+ *   DESCRIPTION: Function to read a directory entry by name. Looks the name up in the hash index
+ *                built by fileSystem_init, so the cost does not grow with the directory size.
  *   INPUTS: fname: filename
  *           dentry: directory entry to populate
  *   RETURN VALUE: dentry idx:success, -1=FS_ERROR:failure. Also dentry used as both input and output
@@ -31,11 +73,13 @@ int32_t read_dentry_by_name(const uint8_t *fname, dir_entry_t *dentry)
 {
     if (fname == NULL || strlen((int8_t*)fname) < 1 || strlen((int8_t*)fname) > MAX_FILE_NAME) 
     {return -1;}
+    uint32_t slot = dentry_name_hash(fname);
     uint32_t i;
-    
-    // Loop through directory entries in the boot block
-    for (i = 0; i < g_boot_block->num_dir_entries; i++)
+
+    // Probe the name index until an empty slot ends the chain
+    while (dentry_hash[slot] != 0)
     {
+        i = dentry_hash[slot] - 1;
         // Check if the current directory entry matches the provided name
         if (strncmp((const int8_t *)fname, (const int8_t *)g_boot_block->dir_entries[i].name, MAX_FILE_NAME) == 0)
         {
@@ -43,6 +87,7 @@ int32_t read_dentry_by_name(const uint8_t *fname, dir_entry_t *dentry)
             read_dentry_by_index(i, dentry);
             return i;
         }
+        slot = (slot + 1) & (DENTRY_HASH_SIZE - 1);
     }
     // Return error if the name is not found
     return FS_ERROR;
@@ -79,9 +124,55 @@ int32_t read_dentry_by_index(uint32_t index, dir_entry_t *dentry)
     return FS_SUCCESS;
 }
 
+/*
+ * read_data_span
+ *   DESCRIPTION: Locates the contiguous run of file bytes that starts at offset. A run never crosses
+ *                a data block boundary, so callers can copy (or map) a whole run in one operation
+ *                instead of walking the file one byte at a time.
+ *   INPUTS: inode: inode number
+ *           offset: byte offset within the file
+ *           span: set to the address of the first byte of the run inside g_data_blocks
+ *   RETURN VALUE: number of contiguous bytes available at span (0 at end of file), -1 for a bad inode
+ *                 or a corrupt data block number
+ *   SIDE EFFECTS: none
+ */
+int32_t read_data_span(uint32_t inode, uint32_t offset, const uint8_t **span)
+{
+    // Check if inode is valid
+    if (inode >= g_boot_block->num_inodes)
+    {
+        return FS_ERROR;
+    }
+
+    inode_t *file_inode = &g_inodes[inode]; // Get the inode for the file
+    if (offset >= file_inode->size)
+    {
+        return 0; // Nothing left to read
+    }
+
+    uint32_t block_num = file_inode->blocks[offset / BLOCK_SIZE];
+    if (block_num >= g_boot_block->num_data_blocks)
+    {
+        return FS_ERROR; // Invalid block number
+    }
+
+    uint32_t offset_from_block = offset % BLOCK_SIZE; // in bytes
+    uint32_t span_length = BLOCK_SIZE - offset_from_block;
+
+    // Clamp the run to the end of the file
+    if (span_length > file_inode->size - offset)
+    {
+        span_length = file_inode->size - offset;
+    }
+
+    *span = g_data_blocks[block_num].data + offset_from_block;
+    return (int32_t)span_length;
+}
+
 /*
  * read_data
- *   DESCRIPTION: Function to read data from an inode
+ *   DESCRIPTION: Function to read data from an inode. Copies whole runs within each 4kB data block
+ *                (see read_data_span) rather than a byte at a time.
  *   INPUTS: inode: inode number
  *           offset: offset within data block
  *           buf: buffer to fill with data read
@@ -93,49 +184,169 @@ int32_t read_data(uint32_t inode, uint32_t offset, uint8_t *buf, uint32_t length
 {
 
     // Check if inode is valid
-    if (inode < 0 || inode >= g_boot_block->num_inodes)
+    if (inode >= g_boot_block->num_inodes)
     {
         return -1; // Return error if inode number is invalid
     }
 
-    inode_t *file_inode = &g_inodes[inode]; // Get the inode for the file
+    uint32_t bytes_read = 0;
+    const uint8_t *span;
+    int32_t span_length;
 
-    // Adjust length to avoid reading past the end of the file
-    if (length > file_inode->size - offset)
+    // Copy one block-contiguous run per iteration
+    while (bytes_read < length)
     {
-        length = file_inode->size - offset;
+        span_length = read_data_span(inode, offset + bytes_read, &span);
+        if (span_length <= 0)
+        {
+            break; // End of file or invalid block number, stop reading
+        }
+
+        if (span_length > length - bytes_read)
+        {
+            span_length = length - bytes_read;
+        }
+
+        memcpy(buf + bytes_read, span, span_length);
+
+        // Update the total number of bytes read
+        bytes_read += span_length;
     }
-    uint32_t block_index; 
-    uint32_t offset_from_block; // in bytes
-    uint32_t bytes_read = 0;
-    uint32_t i;
-    // // Iterate through each block
-    for (i = offset; i < offset + length; i++)
+
+    return (int32_t)bytes_read; // Return the total number of bytes read
+}
+
+/*
+ * send_data
+ *   DESCRIPTION: Streams up to count bytes of a file into an output device write operation straight
+ *                from the file system image, one read_data_span run per write, with no bounce buffer.
+ *   INPUTS: inode: inode number
+ *           offset: byte offset to start at, advanced past the bytes sent
+ *           count: maximum number of bytes to send
+ *           out_fd: file descriptor passed to out
+ *           out: write operation of the destination (e.g. terminal_write)
+ *   RETURN VALUE: number of bytes sent (0 at end of file), -1 for a bad inode or if the first write fails
+ *   SIDE EFFECTS: whatever out does (prints to the terminal)
+ */
+int32_t send_data(uint32_t inode, uint32_t *offset, int32_t count, int32_t out_fd, write_func out)
+{
+    const uint8_t *span;
+    int32_t span_length, written;
+    int32_t bytes_sent = 0;
+
+    while (bytes_sent < count)
     {
+        span_length = read_data_span(inode, *offset, &span);
+        if (span_length <= 0)
+        {
+            if (span_length == FS_ERROR && bytes_sent == 0)
+            {
+                return FS_ERROR;
+            }
+            break; // End of file or invalid block number
+        }
 
-        block_index = i / BLOCK_SIZE;
-        offset_from_block = i % BLOCK_SIZE;
-     
-        // Ensure the block number is valid
-        if (file_inode->blocks[block_index] >= g_boot_block->num_data_blocks)
+        if (span_length > count - bytes_sent)
         {
-            break; // Invalid block number, stop reading
+            span_length = count - bytes_sent;
         }
 
-    //     // Copy data from block to buffer ( 1 byte at a time)
-        data_block_t *data_block = &g_data_blocks[file_inode->blocks[block_index]];
-        memcpy(buf + bytes_read, (uint8_t*)data_block + offset_from_block, 1);
+        written = out(out_fd, span, span_length);
+        if (written <= 0)
+        {
+            if (bytes_sent == 0)
+            {
+                return FS_ERROR;
+            }
+            break;
+        }
 
-    // Update the total number of bytes read
-        bytes_read += 1;
+        *offset += written;
+        bytes_sent += written;
+        if (written < span_length)
+        {
+            break; // Destination took less than offered
+        }
     }
 
-    return (int32_t)bytes_read; // Return the total number of bytes read
+    return bytes_sent;
 }
 
 // -----------------Core Driver Functions (for directory and file)--------------------
 
 
+/*
+ * dir_read_entry
+ *   DESCRIPTION: Copies the name of the directory entry at index into buf (without a NUL terminator)
+ *   INPUTS: index: boot block dentry index
+ *           buf: buffer to populate with the file name
+ *           nbytes: size of buf
+ *   RETURN VALUE: number of name bytes copied, -1 for fail
+ *   SIDE EFFECTS: none
+ */
+int32_t dir_read_entry(uint32_t index, void *buf, int32_t nbytes)
+{
+    dir_entry_t dentry;
+    int32_t ret = read_dentry_by_index(index, &dentry);
+    if (ret == FS_ERROR)
+    {
+        return FS_ERROR;
+    }
+    int32_t i;
+
+    // add file name to buffer, stopping at the end of the name or the buffer
+    for (i = 0; i < nbytes && i < MAX_FILE_NAME; i++)
+    {
+        if (dentry.name[i] == '\0')
+        {
+            break;
+        }
+        ((uint8_t *)buf)[i] = dentry.name[i];
+    }
+    return i;
+}
+
+/*
+ * dir_read_records
+ *   DESCRIPTION: Fills buf with as many packed dirent_t records (name, type, inode, size) as fit,
+ *                starting at directory entry *index. Used by getdents so a directory scan takes one or
+ *                two traps instead of one read per name plus an open per file.
+ *   INPUTS: index: first dentry index to return; advanced past the returned records
+ *           buf: buffer to fill with records
+ *           nbytes: size of buf in bytes
+ *   RETURN VALUE: number of bytes written (0 once every entry has been returned), -1 if buf cannot
+ *                 hold a single record
+ *   SIDE EFFECTS: none
+ */
+int32_t dir_read_records(uint32_t *index, dirent_t *buf, int32_t nbytes)
+{
+    if (nbytes < (int32_t)sizeof(dirent_t))
+    {
+        return FS_ERROR;
+    }
+
+    int32_t count = 0;
+    int32_t max_records = nbytes / sizeof(dirent_t);
+    uint32_t i;
+
+    while (count < max_records && *index < g_boot_block->num_dir_entries)
+    {
+        dir_entry_t *dentry = &g_boot_block->dir_entries[*index];
+        for (i = 0; i < MAX_FILE_NAME; i++)
+        {
+            buf[count].name[i] = dentry->name[i];
+        }
+        buf[count].file_type = dentry->file_type;
+        buf[count].inode_num = dentry->inode_num;
+        buf[count].size = dentry->file_type == FILE_TYPE_REG ? g_inodes[dentry->inode_num].size : 0;
+
+        count++;
+        (*index)++;
+    }
+
+    return count * sizeof(dirent_t);
+}
+
 /*
  * dir_read
  *   DESCRIPTION: Read each file name in the directory
@@ -164,28 +375,7 @@ int32_t dir_read(int32_t fd, void *buf, int32_t nbytes)
         return FS_SUCCESS;
     }
     current_pcb->files[fd].filePosition++;
-    dir_entry_t dentry;
-    int32_t ret = read_dentry_by_index(start, &dentry);
-    if (ret == FS_ERROR)
-    {
-        return FS_ERROR;
-    }
-    uint32_t i;
-    
-    // add file name, file type and size to buffer with File Name: File Type: File Size labels
-    for ( i = 0; i < nbytes; i++)
-    {
-        if (dentry.name[i] == '\0')
-        {
-            break;
-        }
-        ((uint8_t *)buf)[i] = dentry.name[i];
-    }
-    // ((uint32_t *)buf)[MAX_FILE_NAME] = dentry.file_type;
-    // ((uint32_t *)buf)[MAX_FILE_NAME + 4] = g_inodes[dentry.inode_num].size;
-    return i;
-    
-    // Check if the file descriptor index is valid
+    return dir_read_entry(start, buf, nbytes);
 }
  
 // // helper function to get file type
@@ -254,6 +444,60 @@ int32_t dir_close(int32_t fd)
     return FS_SUCCESS; // Return success
 }
 
+/*
+ * seek_position
+ *   DESCRIPTION: Shared lseek arithmetic; moves *position relative to the start, itself or end
+ *   INPUTS: position: position to update
+ *           offset: signed distance to move
+ *           whence: SEEK_SET, SEEK_CUR or SEEK_END
+ *           end: position of the end of the file
+ *   RETURN VALUE: new position if success, -1 if whence is invalid or the result is negative
+ *   SIDE EFFECTS: updates *position on success
+ */
+static int32_t seek_position(uint32_t *position, int32_t offset, int32_t whence, uint32_t end)
+{
+    int32_t base;
+    if (whence == SEEK_SET) {
+        base = 0;
+    } else if (whence == SEEK_CUR) {
+        base = (int32_t)*position;
+    } else if (whence == SEEK_END) {
+        base = (int32_t)end;
+    } else {
+        return FS_ERROR;
+    }
+    if (base + offset < 0) { // can't seek before the start
+        return FS_ERROR;
+    }
+    *position = base + offset; // seeking past the end is allowed, reads there return 0
+    return (int32_t)*position;
+}
+
+/*
+ * dir_seek
+ *   DESCRIPTION: Move the directory entry index of fd, e.g. to rewind a listing
+ *   INPUTS: fd: directory file descriptor
+ *           offset: signed number of entries to move
+ *           whence: SEEK_SET, SEEK_CUR or SEEK_END
+ *   RETURN VALUE: new entry index if success, -1 if fail
+ *   SIDE EFFECTS: changes the fd's filePosition
+ */
+int32_t dir_seek(int32_t fd, int32_t offset, int32_t whence)
+{
+    ProcessControlBlock* current_pcb;
+    // Assembly code to get the current PCB
+    // Clear the lower 13 bits then AND with ESP to align it to the 8KB boundary
+    asm volatile (
+        "movl %%esp, %%eax\n"       // Move current ESP value to EAX for manipulation
+        "andl $0xFFFFE000, %%eax\n" // Clear the lower 13 bits to align to 8KB boundary
+        "movl %%eax, %0\n"          // Move the modified EAX value to current_pcb
+        : "=r" (current_pcb)        // Output operands
+        :                            // No input operands
+        : "eax"                      // Clobber list, indicating EAX is modified
+    );
+    return seek_position(&current_pcb->files[fd].filePosition, offset, whence, g_boot_block->num_dir_entries);
+}
+
 
 /*
  * file_read
@@ -281,8 +525,7 @@ int32_t file_read(int32_t fd, void *buf, int32_t nbytes)
     // uint32_t inode_ptr = g_boot_block->dir_entries[fd].inode_num;
     uint32_t file_size = g_inodes[inode_ptr].size; // size in bytes
     if(current_pcb->files[fd].filePosition >= file_size){ // if file position is at or past the end of the file
-        current_pcb->files[fd].filePosition = 0; // reset file position
-        return 0;
+        return 0; // stay at EOF; use lseek to rewind
     }
     uint32_t offset = current_pcb->files[fd].filePosition;
     int32_t transfer_size = read_data(inode_ptr, offset, buf, nbytes);
@@ -297,6 +540,62 @@ int32_t file_read(int32_t fd, void *buf, int32_t nbytes)
 }
 
 
+/*
+ * file_pread
+ *   DESCRIPTION: Reads nbytes bytes of data starting at offset, leaving the file position alone
+ *   INPUTS: fd: file to read from
+ *           buf: buffer to fill with read data
+ *           nbytes: number of data bytes to read
+ *           offset: byte offset in the file to start at
+ *   RETURN VALUE: number of bytes read (0 at or past EOF) if success, -1 if fail
+ *   SIDE EFFECTS: none
+ */
+int32_t file_pread(int32_t fd, void *buf, int32_t nbytes, uint32_t offset)
+{
+    ProcessControlBlock* current_pcb;
+    // Assembly code to get the current PCB
+    // Clear the lower 13 bits then AND with ESP to align it to the 8KB boundary
+    asm volatile (
+        "movl %%esp, %%eax\n"       // Move current ESP value to EAX for manipulation
+        "andl $0xFFFFE000, %%eax\n" // Clear the lower 13 bits to align to 8KB boundary
+        "movl %%eax, %0\n"          // Move the modified EAX value to current_pcb
+        : "=r" (current_pcb)        // Output operands
+        :                            // No input operands
+        : "eax"                      // Clobber list, indicating EAX is modified
+    );
+    uint32_t inode_ptr = current_pcb->files[fd].inode;
+    if (offset >= g_inodes[inode_ptr].size) { // nothing to read at or past the end of the file
+        return 0;
+    }
+    return read_data(inode_ptr, offset, buf, nbytes);
+}
+
+/*
+ * file_seek
+ *   DESCRIPTION: Move the file position of fd so the next read starts there
+ *   INPUTS: fd: file descriptor
+ *           offset: signed byte distance to move
+ *           whence: SEEK_SET, SEEK_CUR or SEEK_END
+ *   RETURN VALUE: new file position if success, -1 if fail
+ *   SIDE EFFECTS: changes the fd's filePosition
+ */
+int32_t file_seek(int32_t fd, int32_t offset, int32_t whence)
+{
+    ProcessControlBlock* current_pcb;
+    // Assembly code to get the current PCB
+    // Clear the lower 13 bits then AND with ESP to align it to the 8KB boundary
+    asm volatile (
+        "movl %%esp, %%eax\n"       // Move current ESP value to EAX for manipulation
+        "andl $0xFFFFE000, %%eax\n" // Clear the lower 13 bits to align to 8KB boundary
+        "movl %%eax, %0\n"          // Move the modified EAX value to current_pcb
+        : "=r" (current_pcb)        // Output operands
+        :                            // No input operands
+        : "eax"                      // Clobber list, indicating EAX is modified
+    );
+    uint32_t file_size = g_inodes[current_pcb->files[fd].inode].size;
+    return seek_position(&current_pcb->files[fd].filePosition, offset, whence, file_size);
+}
+
 /*
  * file_write
  *   DESCRIPTION: Write file to filesystem => Does nothing since read-only file system
@@ -12,6 +12,7 @@
 #define DIR_ENTRY_SIZE 64                                       // Directory entry size in bytes
 #define BOOT_BLOCK_RESERVED 52                                  // Reserved bytes in the boot block
 #define INODE_DATA_BLOCKS ((BLOCK_SIZE / sizeof(uint32_t)) - 1) // Adjust for inode structure size
+#define DENTRY_HASH_SIZE 128                                    // Name index slots (power of two, at least 2 * MAX_FILES)
 
 
 // File types
@@ -28,6 +29,11 @@
 #define FD_AVAILABLE  0
 #define FD_ACTIVE     1
 
+// lseek whence values
+#define SEEK_SET 0 // Offset is absolute
+#define SEEK_CUR 1 // Offset is relative to the current position
+#define SEEK_END 2 // Offset is relative to the end of the file
+
 // Directory entry structure
 typedef struct
 {
@@ -37,6 +43,15 @@ typedef struct
     uint8_t reserved[24];     // Reserved space to fill the structure to 64 bytes
 } dir_entry_t;
 
+// Packed record returned by the getdents system call
+typedef struct
+{
+    uint8_t name[MAX_FILE_NAME]; // File name (not NUL terminated if exactly 32 characters)
+    uint32_t file_type;          // File type
+    uint32_t inode_num;          // Inode number
+    uint32_t size;               // File size in bytes (0 for anything but regular files)
+} dirent_t;
+
 // Boot block structure
 typedef struct
 {
@@ -91,13 +106,20 @@ void fileSystem_init(uint8_t *fs_start); // Function to initialize the file syst
 int read_dentry_by_name(const uint8_t *fname, dir_entry_t *dentry); // Function to read a directory entry by name
 int read_dentry_by_index(uint32_t index, dir_entry_t *dentry); // Function to read a directory entry by index
 int read_data(uint32_t inode, uint32_t offset, uint8_t *buf, uint32_t length); // Function to read data from an inode
+int32_t read_data_span(uint32_t inode, uint32_t offset, const uint8_t **span); // Function to find the block-contiguous run at an offset
+int32_t send_data(uint32_t inode, uint32_t *offset, int32_t count, int32_t out_fd, int (*out)(int32_t, const void*, int32_t)); // Function to stream file data to a device write
 
 // Prototypes for file system abstractions
 int32_t dir_read(int32_t fd, void *buf, int32_t nbytes); // Read each file name in the directory
+int32_t dir_read_entry(uint32_t index, void *buf, int32_t nbytes); // Copy the name of one directory entry
+int32_t dir_read_records(uint32_t *index, dirent_t *buf, int32_t nbytes); // Fill buf with as many dirent_t records as fit
 int32_t dir_write(int32_t fd, const void *buf, int32_t nbytes); // Write directory to filesystem => Does nothing since read-only file system
 int32_t dir_open(const uint8_t *filename); // Opens a directory file (note file types) using read_dentry_by_name, return 0
 int32_t dir_close(int32_t fd); // Close directory, Undo dir_open
+int32_t dir_seek(int32_t fd, int32_t offset, int32_t whence); // Move the directory entry index of fd
 int32_t file_read(int32_t fd, void *buf, int32_t nbytes); // Reads nbytes bytes of data from file into buf using read_data
+int32_t file_pread(int32_t fd, void *buf, int32_t nbytes, uint32_t offset); // Reads at offset without moving the file position
+int32_t file_seek(int32_t fd, int32_t offset, int32_t whence); // Move the file position of fd
 int32_t file_write(int32_t fd, const void *buf, int32_t nbytes); // Write file to filesystem => Does nothing since read-only file system
 int32_t file_open(const uint8_t *filename); // Initialize any temporary structures, return 0
 int32_t file_close(int32_t fd); // Delete any temporary structures (undo tasks in file_open), return 0
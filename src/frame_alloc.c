@@ -0,0 +1,301 @@
+#include "paging.h"
+#include "frame_alloc.h"
+#include "lib.h"
+
+static uint32_t frame_bitmap[FRAME_COUNT / 32];     // One bit per 4kB frame, 1 = in use (or not RAM)
+static uint16_t large_free[LARGE_FRAME_COUNT];      // Free 4kB frames left inside each 4MB frame
+static uint32_t free_frames = 0;                    // Free 4kB frames overall
+static uint16_t frame_shares[FRAME_COUNT];          // Extra references to each 4kB frame (0 = a single owner)
+
+/*
+ * frame_mark
+ *   DESCRIPTION: Sets or clears the bitmap bit of one 4kB frame and keeps the free counters in step
+ *   INPUTS: frame - physical frame number
+ *           used - 1 to mark the frame in use, 0 to mark it free
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Updates frame_bitmap, large_free and free_frames
+ */
+static void frame_mark(uint32_t frame, uint32_t used) {
+    uint32_t mask = 1 << (frame % 32);
+    uint32_t* word = &frame_bitmap[frame / 32];
+
+    if (used && !(*word & mask)) {
+        *word |= mask;
+        large_free[frame / FRAMES_PER_LARGE]--;
+        free_frames--;
+    } else if (!used && (*word & mask)) {
+        *word &= ~mask;
+        large_free[frame / FRAMES_PER_LARGE]++;
+        free_frames++;
+    }
+}
+
+/*
+ * frame_mark_range
+ *   DESCRIPTION: Marks every managed frame that lies completely inside [start, end) as used or free.
+ *                Addresses outside FRAME_MEM_START..FRAME_MEM_END are ignored.
+ *   INPUTS: start, end - physical byte range
+ *           used - 1 to mark in use, 0 to mark free
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Updates the allocator state
+ */
+static void frame_mark_range(uint32_t start, uint32_t end, uint32_t used) {
+    uint32_t frame;
+
+    if (end < start || end > FRAME_MEM_END) {
+        end = FRAME_MEM_END; // Clamp (and catch base + length wrapping past 4GB)
+    }
+    if (start < FRAME_MEM_START) {
+        start = FRAME_MEM_START;
+    }
+    if (start >= end) {
+        return; // Nothing managed inside the range
+    }
+    if (used) {
+        start &= ~(PAGE_SIZE - 1);                     // Any frame the range touches is taken
+        end = (end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    } else {
+        start = (start + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1); // Only whole frames are usable
+        end &= ~(PAGE_SIZE - 1);
+    }
+
+    for (frame = start / PAGE_SIZE; frame < end / PAGE_SIZE; frame++) {
+        frame_mark(frame, used);
+    }
+}
+
+/*
+ * frame_alloc_init
+ *   DESCRIPTION: Seeds the physical frame allocator from the multiboot memory map. Every frame starts out
+ *                in use; frames in regions the map reports as RAM are then released, and the boot modules
+ *                (the file system image) are reserved again in case the loader put them above 8MB.
+ *                Falls back to mem_upper when no memory map was passed.
+ *   INPUTS: mbi - multiboot information structure from the boot loader
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Initializes the allocator state; must run before paging uses any frames
+ */
+void frame_alloc_init(multiboot_info_t* mbi) {
+    memset(frame_bitmap, 0xFF, sizeof(frame_bitmap));
+    memset(large_free, 0, sizeof(large_free));
+    free_frames = 0;
+
+    if (mbi->flags & (1 << 6)) {
+        memory_map_t* mmap;
+        for (mmap = (memory_map_t*)mbi->mmap_addr;
+                (uint32_t)mmap < mbi->mmap_addr + mbi->mmap_length;
+                mmap = (memory_map_t*)((uint32_t)mmap + mmap->size + sizeof(mmap->size))) {
+            if (mmap->type != MMAP_TYPE_RAM || mmap->base_addr_high != 0) {
+                continue; // Reserved, or above 4GB
+            }
+            frame_mark_range(mmap->base_addr_low,
+                             mmap->length_high ? FRAME_MEM_END : mmap->base_addr_low + mmap->length_low, 0);
+        }
+    } else if (mbi->flags & (1 << 0)) {
+        frame_mark_range(0x100000, 0x100000 + mbi->mem_upper * 1024, 0); // mem_upper counts kB above 1MB
+    }
+
+    if (mbi->flags & (1 << 3)) {
+        module_t* mod = (module_t*)mbi->mods_addr;
+        uint32_t i;
+        for (i = 0; i < mbi->mods_count; i++) {
+            frame_mark_range(mod[i].mod_start, mod[i].mod_end, 1);
+        }
+    }
+}
+
+/*
+ * frame_alloc
+ *   DESCRIPTION: Allocates one 4kB physical frame. Frames are taken from partly used 4MB regions first so
+ *                whole 4MB frames stay available for frame_alloc_large.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: physical address of the frame, 0 if memory is exhausted
+ *   SIDE EFFECTS: Marks the frame in use. The frame's contents are not cleared.
+ */
+uint32_t frame_alloc() {
+    uint32_t region, word, bit;
+    uint32_t pick = LARGE_FRAME_COUNT;
+
+    for (region = 0; region < LARGE_FRAME_COUNT; region++) {
+        if (large_free[region] == 0) {
+            continue;
+        }
+        pick = region;
+        if (large_free[region] < FRAMES_PER_LARGE) {
+            break; // Partly used region: best fit
+        }
+    }
+    if (pick == LARGE_FRAME_COUNT) {
+        return 0; // Out of memory
+    }
+
+    for (word = pick * FRAMES_PER_LARGE / 32; word < (pick + 1) * FRAMES_PER_LARGE / 32; word++) {
+        if (frame_bitmap[word] == 0xFFFFFFFF) {
+            continue;
+        }
+        for (bit = 0; bit < 32; bit++) {
+            if (!(frame_bitmap[word] & (1 << bit))) {
+                frame_mark(word * 32 + bit, 1);
+                return (word * 32 + bit) * PAGE_SIZE;
+            }
+        }
+    }
+    return 0; // Not reached: large_free said the region had a free frame
+}
+
+/*
+ * frame_free
+ *   DESCRIPTION: Returns a 4kB frame from frame_alloc to the allocator, or drops one reference to it if
+ *                the frame is shared (see frame_share)
+ *   INPUTS: phys_addr - physical address of the frame
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Marks the frame free. Addresses the allocator does not manage are ignored.
+ */
+void frame_free(uint32_t phys_addr) {
+    if (phys_addr < FRAME_MEM_START || phys_addr >= FRAME_MEM_END) {
+        return;
+    }
+    if (frame_shares[phys_addr / PAGE_SIZE] != 0) {
+        frame_shares[phys_addr / PAGE_SIZE]--; // Someone else still maps it
+        return;
+    }
+    frame_mark(phys_addr / PAGE_SIZE, 0);
+}
+
+/*
+ * frame_share
+ *   DESCRIPTION: Takes another reference to a 4kB frame from frame_alloc, e.g. when fork maps it in a
+ *                second address space copy-on-write. Each reference is dropped with frame_free; the frame
+ *                only goes back to the allocator with the last one.
+ *   INPUTS: phys_addr - physical address of the frame
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Addresses the allocator does not manage are ignored
+ */
+void frame_share(uint32_t phys_addr) {
+    if (phys_addr < FRAME_MEM_START || phys_addr >= FRAME_MEM_END) {
+        return;
+    }
+    frame_shares[phys_addr / PAGE_SIZE]++;
+}
+
+/*
+ * frame_is_shared
+ *   DESCRIPTION: Tells whether more than one reference to a frame exists
+ *   INPUTS: phys_addr - physical address of the frame
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the frame has been shared with frame_share and not yet released, 0 otherwise
+ *   SIDE EFFECTS: none
+ */
+uint32_t frame_is_shared(uint32_t phys_addr) {
+    if (phys_addr < FRAME_MEM_START || phys_addr >= FRAME_MEM_END) {
+        return 0;
+    }
+    return frame_shares[phys_addr / PAGE_SIZE] != 0;
+}
+
+/*
+ * frame_alloc_block
+ *   DESCRIPTION: Allocates count contiguous 4kB frames aligned to count * 4kB, e.g. two for an 8kB kernel
+ *                stack that the PCB lookup finds by masking ESP. Blocks never straddle a bitmap word.
+ *   INPUTS: count - number of frames, a power of two no larger than 32
+ *   OUTPUTS: none
+ *   RETURN VALUE: physical address of the first frame, 0 if no such block is free or count is invalid
+ *   SIDE EFFECTS: Marks the frames in use
+ */
+uint32_t frame_alloc_block(uint32_t count) {
+    uint32_t word, bit, i;
+    uint32_t mask;
+
+    if (count == 0 || count > 32 || (count & (count - 1)) != 0) {
+        return 0;
+    }
+    if (count == 1) {
+        return frame_alloc();
+    }
+    mask = count == 32 ? 0xFFFFFFFF : (1 << count) - 1;
+
+    for (word = 0; word < FRAME_COUNT / 32; word++) {
+        if (frame_bitmap[word] == 0xFFFFFFFF) {
+            continue;
+        }
+        for (bit = 0; bit < 32; bit += count) {
+            if ((frame_bitmap[word] & (mask << bit)) == 0) {
+                for (i = 0; i < count; i++) {
+                    frame_mark(word * 32 + bit + i, 1);
+                }
+                return (word * 32 + bit) * PAGE_SIZE;
+            }
+        }
+    }
+    return 0; // Out of memory (or too fragmented)
+}
+
+/*
+ * frame_free_block
+ *   DESCRIPTION: Returns a block from frame_alloc_block to the allocator
+ *   INPUTS: phys_addr - physical address of the first frame
+ *           count - number of frames passed to frame_alloc_block
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Marks the frames free
+ */
+void frame_free_block(uint32_t phys_addr, uint32_t count) {
+    uint32_t i;
+    for (i = 0; i < count; i++) {
+        frame_free(phys_addr + i * PAGE_SIZE);
+    }
+}
+
+/*
+ * frame_alloc_large
+ *   DESCRIPTION: Allocates one 4MB-aligned 4MB physical frame, for 4MB pages
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: physical address of the frame, 0 if no completely free 4MB region is left
+ *   SIDE EFFECTS: Marks all 1024 4kB frames inside it in use
+ */
+uint32_t frame_alloc_large() {
+    uint32_t region, frame;
+
+    for (region = 0; region < LARGE_FRAME_COUNT; region++) {
+        if (large_free[region] == FRAMES_PER_LARGE) {
+            for (frame = region * FRAMES_PER_LARGE; frame < (region + 1) * FRAMES_PER_LARGE; frame++) {
+                frame_mark(frame, 1);
+            }
+            return region * LARGE_PAGE_SIZE;
+        }
+    }
+    return 0; // Out of memory
+}
+
+/*
+ * frame_free_large
+ *   DESCRIPTION: Returns a 4MB frame from frame_alloc_large to the allocator
+ *   INPUTS: phys_addr - physical address of the frame (4MB aligned)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Marks its 4kB frames free
+ */
+void frame_free_large(uint32_t phys_addr) {
+    if (phys_addr & (LARGE_PAGE_SIZE - 1)) {
+        return; // Not a 4MB frame
+    }
+    frame_mark_range(phys_addr, phys_addr + LARGE_PAGE_SIZE, 0);
+}
+
+/*
+ * frame_free_count
+ *   DESCRIPTION: Reports how much physical memory is left
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of free 4kB frames
+ *   SIDE EFFECTS: none
+ */
+uint32_t frame_free_count() {
+    return free_frames;
+}
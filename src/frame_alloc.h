@@ -0,0 +1,26 @@
+#ifndef FRAME_ALLOC_H
+#define FRAME_ALLOC_H
+
+#include "types.h"
+#include "multiboot.h"
+
+#define FRAME_MEM_START    0x800000    // 8MB: everything below is the kernel, its stacks and the boot modules
+#define FRAME_MEM_END      0x8000000   // 128MB: physical memory the kernel identity maps (the user window starts here)
+#define FRAME_COUNT        (FRAME_MEM_END / PAGE_SIZE)          // 4kB frames tracked, indexed by physical frame number
+#define FRAMES_PER_LARGE   (LARGE_PAGE_SIZE / PAGE_SIZE)        // 4kB frames in one 4MB frame
+#define LARGE_FRAME_COUNT  (FRAME_MEM_END / LARGE_PAGE_SIZE)    // 4MB frames tracked
+#define MMAP_TYPE_RAM      1           // multiboot memory map type for usable RAM
+
+// See c file for descriptions
+void frame_alloc_init(multiboot_info_t* mbi);
+uint32_t frame_alloc();
+void frame_free(uint32_t phys_addr);
+void frame_share(uint32_t phys_addr);
+uint32_t frame_is_shared(uint32_t phys_addr);
+uint32_t frame_alloc_block(uint32_t count);
+void frame_free_block(uint32_t phys_addr, uint32_t count);
+uint32_t frame_alloc_large();
+void frame_free_large(uint32_t phys_addr);
+uint32_t frame_free_count();
+
+#endif
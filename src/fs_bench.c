@@ -0,0 +1,150 @@
+#include "fs_bench.h"
+#include "file_sys.h"
+#include "lib.h"
+
+// File system benchmarks, shared by fs_bench in tests.c (in the kernel) and the Linux host build in
+// host/fs_host.c, which maps filesys_img and runs them natively so file_sys.c can be profiled without QEMU.
+// They only use file_sys.c, lib.c and printf.
+
+#define SMALL_READ_SIZE   16    // Bytes per call for the small-read pattern
+#define RANDOM_READ_SIZE  512   // Bytes per call for the random-offset pattern
+#define RANDOM_READS      256   // Calls per iteration for the random-offset pattern
+
+uint32_t tsc_mhz = 1;
+uint8_t bench_buf[BENCH_BUF_SIZE];
+
+/*
+ * bench_report
+ *   DESCRIPTION: Prints one benchmark result as ns/op and, when bytes were moved, MB/s
+ *   INPUTS: label: benchmark name
+ *           cycles: total TSC cycles spent
+ *           ops: number of operations performed
+ *           bytes: total bytes transferred (0 for metadata benchmarks)
+ *   OUTPUTS: One result line
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void bench_report(int8_t *label, uint32_t cycles, uint32_t ops, uint32_t bytes) {
+    uint32_t us = cycles / tsc_mhz;
+    uint32_t ns_per_op = ops ? (cycles / ops) * 1000 / tsc_mhz : 0;
+
+    if (bytes == 0) {
+        printf("  %s: %u ns/op\n", label, ns_per_op);
+    } else {
+        printf("  %s: %u ns/op, %u MB/s\n", label, ns_per_op, us ? bytes / us : 0); // bytes per us == MB/s
+    }
+}
+
+/*
+ * fs_bench_run
+ *   DESCRIPTION: Runs against the largest regular file in the file system and reports ns/op and MB/s for:
+ *                read_dentry_by_name, sequential whole-file read_data, random-offset read_data,
+ *                small sequential read_data calls, and dir_read over the whole directory
+ *   INPUTS: none
+ *   OUTPUTS: One line per benchmark
+ *   RETURN VALUE: 0 if every read returned the expected byte count, -1 otherwise
+ *   SIDE EFFECTS: Must run after fileSystem_init, with tsc_mhz set
+ */
+int32_t fs_bench_run() {
+    int32_t result = 0;
+    dir_entry_t dentry;
+    uint32_t i, iter, start, cycles, ops, bytes;
+    uint32_t inode = 0;
+    uint32_t size = 0;
+    uint8_t name[MAX_FILE_NAME + 1];
+
+    // Use the largest regular file as the data set
+    for (i = 0; i < g_boot_block->num_dir_entries; i++) {
+        dir_entry_t *entry = &g_boot_block->dir_entries[i];
+        if (entry->file_type == FILE_TYPE_REG && g_inodes[entry->inode_num].size > size) {
+            inode = entry->inode_num;
+            size = g_inodes[inode].size;
+        }
+    }
+    if (size > BENCH_BUF_SIZE) {
+        size = BENCH_BUF_SIZE;
+    }
+
+    // read_dentry_by_name over every name in the directory
+    cycles = ops = 0;
+    for (iter = 0; iter < BENCH_ITERATIONS; iter++) {
+        for (i = 0; i < g_boot_block->num_dir_entries; i++) {
+            strncpy((int8_t*)name, (int8_t*)g_boot_block->dir_entries[i].name, MAX_FILE_NAME);
+            name[MAX_FILE_NAME] = '\0';
+            start = rdtsc();
+            if (read_dentry_by_name(name, &dentry) == -1) {
+                result = -1;
+            }
+            cycles += rdtsc() - start;
+            ops++;
+        }
+    }
+    bench_report("read_dentry_by_name", cycles, ops, 0);
+
+    // Sequential: the whole file in one call, as execute does
+    cycles = ops = bytes = 0;
+    for (iter = 0; iter < BENCH_ITERATIONS; iter++) {
+        start = rdtsc();
+        int32_t ret = read_data(inode, 0, bench_buf, size);
+        cycles += rdtsc() - start;
+        if (ret != size) {
+            result = -1;
+        }
+        bytes += size;
+        ops++;
+    }
+    bench_report("read_data sequential", cycles, ops, bytes);
+
+    // Random offsets: fixed-size reads from pseudo-random positions (LCG so runs are repeatable)
+    uint32_t seed = 391;
+    cycles = ops = bytes = 0;
+    for (iter = 0; iter < BENCH_ITERATIONS; iter++) {
+        for (i = 0; i < RANDOM_READS; i++) {
+            seed = seed * 1103515245 + 12345;
+            uint32_t offset = (seed >> 8) % size;
+            uint32_t expected = size - offset < RANDOM_READ_SIZE ? size - offset : RANDOM_READ_SIZE;
+            start = rdtsc();
+            int32_t ret = read_data(inode, offset, bench_buf, RANDOM_READ_SIZE);
+            cycles += rdtsc() - start;
+            if (ret != expected) {
+                result = -1;
+            }
+            bytes += ret;
+            ops++;
+        }
+    }
+    bench_report("read_data random 512B", cycles, ops, bytes);
+
+    // Small reads: walk the file SMALL_READ_SIZE bytes at a time, as line-oriented tools do
+    cycles = ops = bytes = 0;
+    for (iter = 0; iter < BENCH_ITERATIONS; iter++) {
+        uint32_t offset;
+        for (offset = 0; offset < size; offset += SMALL_READ_SIZE) {
+            start = rdtsc();
+            int32_t ret = read_data(inode, offset, bench_buf + offset, SMALL_READ_SIZE);
+            cycles += rdtsc() - start;
+            bytes += ret;
+            ops++;
+        }
+    }
+    if (bytes != size * BENCH_ITERATIONS) {
+        result = -1;
+    }
+    bench_report("read_data small 16B", cycles, ops, bytes);
+
+    // dir_read: one name per call across the whole directory
+    cycles = ops = 0;
+    for (iter = 0; iter < BENCH_ITERATIONS; iter++) {
+        for (i = 0; i < g_boot_block->num_dir_entries; i++) {
+            start = rdtsc();
+            if (dir_read_entry(i, name, MAX_FILE_NAME) == -1) {
+                result = -1;
+            }
+            cycles += rdtsc() - start;
+            ops++;
+        }
+    }
+    bench_report("dir_read", cycles, ops, 0);
+
+    return result;
+}
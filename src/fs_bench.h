@@ -0,0 +1,31 @@
+#ifndef FS_BENCH_H
+#define FS_BENCH_H
+
+#include "types.h"
+
+#define BENCH_BUF_SIZE 0x10000 // 64kB, larger than any file in filesys_img
+#define BENCH_ITERATIONS 16
+
+extern uint32_t tsc_mhz;                   // TSC ticks per microsecond, set by whoever runs the benchmarks
+extern uint8_t bench_buf[BENCH_BUF_SIZE];  // Scratch buffer the benchmarks read into
+
+// See c file for descriptions
+void bench_report(int8_t *label, uint32_t cycles, uint32_t ops, uint32_t bytes);
+int32_t fs_bench_run();
+
+/*
+ * rdtsc
+ *   DESCRIPTION: Reads the low 32 bits of the CPU time stamp counter. Deltas between two reads
+ *                are used as cycle counts by the benchmarks (wraparound is harmless for short runs).
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: low 32 bits of the TSC
+ *   SIDE EFFECTS: none
+ */
+static inline uint32_t rdtsc() {
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+    return lo;
+}
+
+#endif
@@ -0,0 +1,227 @@
+#include "../types.h"
+#include "../lib.h"
+#include "../file_sys.h"
+#include "../fs_bench.h"
+
+// Linux host shim for the file system code: just enough of a process around file_sys.c, lib.c and
+// fs_bench.c to map filesys_img and run the benchmarks natively (under perf, gdb or valgrind, say)
+// instead of in QEMU. Built with `make fs_bench_host`. Like the kernel it links no C library; it talks
+// to Linux through int $0x80, so it builds with a 32-bit gcc and nothing else.
+
+// Linux i386 system call numbers
+#define LINUX_EXIT           1
+#define LINUX_WRITE          4
+#define LINUX_OPEN           5
+#define LINUX_CLOSE          6
+#define LINUX_LSEEK          19
+#define LINUX_MMAP           90      // The old mmap: one pointer to its six arguments
+#define LINUX_CLOCK_GETTIME  265
+
+#define LINUX_O_RDONLY       0
+#define LINUX_SEEK_END       2
+#define LINUX_PROT_READ      1
+#define LINUX_MAP_PRIVATE    2
+#define LINUX_CLOCK_MONOTONIC 1
+
+#define HOST_CAL_NS          10000000   // Length of the clock_gettime window used to calibrate the TSC
+#define HOST_PRINTF_BUF      32
+
+// Arguments of the old mmap, in order
+typedef struct {
+    uint32_t addr;
+    uint32_t len;
+    uint32_t prot;
+    uint32_t flags;
+    uint32_t fd;
+    uint32_t offset;
+} linux_mmap_args_t;
+
+typedef struct {
+    int32_t sec;
+    int32_t nsec;
+} linux_timespec_t;
+
+uint8_t* filesys_addr;    // Where filesys_img is mapped, as the kernel's multiboot module would be
+int cur_terminal = 0;     // lib.c's putc refers to it; nothing here calls putc
+
+/*
+ * linux_syscall
+ *   DESCRIPTION: Makes a Linux system call with up to three arguments
+ *   INPUTS: num - system call number
+ *           a, b, c - arguments (EBX, ECX, EDX)
+ *   OUTPUTS: none
+ *   RETURN VALUE: the call's result, -errno on failure
+ *   SIDE EFFECTS: whatever the call does
+ */
+static int32_t linux_syscall(uint32_t num, uint32_t a, uint32_t b, uint32_t c) {
+    int32_t ret;
+
+    asm volatile ("int $0x80" : "=a" (ret) : "a" (num), "b" (a), "c" (b), "d" (c) : "memory");
+    return ret;
+}
+
+/*
+ * host_puts
+ *   DESCRIPTION: Writes a NUL-terminated string to standard output
+ *   INPUTS: s - string
+ *   OUTPUTS: s
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void host_puts(const int8_t* s) {
+    linux_syscall(LINUX_WRITE, 1, (uint32_t)s, strlen(s));
+}
+
+/*
+ * printf
+ *   DESCRIPTION: Stands in for lib.c's printf, which writes to video memory (the host build renames
+ *                that one lib_printf). Handles the conversions the benchmarks use: %s, %u, %d, %x, %c, %%.
+ *   INPUTS: format - format string, then its arguments
+ *   OUTPUTS: the formatted string, on standard output
+ *   RETURN VALUE: 0
+ *   SIDE EFFECTS: none
+ */
+int32_t printf(int8_t* format, ...) {
+    int8_t buf[HOST_PRINTF_BUF];
+    int8_t* start = format;
+    __builtin_va_list args;
+
+    __builtin_va_start(args, format);
+    for (; *format != '\0'; format++) {
+        if (*format != '%') {
+            continue;
+        }
+        linux_syscall(LINUX_WRITE, 1, (uint32_t)start, format - start); // Text up to the conversion
+        format++;
+        switch (*format) {
+            case 's':
+                host_puts(__builtin_va_arg(args, int8_t*));
+                break;
+            case 'u':
+                host_puts(itoa(__builtin_va_arg(args, uint32_t), buf, 10));
+                break;
+            case 'd': {
+                int32_t value = __builtin_va_arg(args, int32_t);
+                if (value < 0) {
+                    host_puts("-");
+                    value = -value;
+                }
+                host_puts(itoa((uint32_t)value, buf, 10));
+                break;
+            }
+            case 'x':
+                host_puts(itoa(__builtin_va_arg(args, uint32_t), buf, 16));
+                break;
+            case 'c':
+                buf[0] = (int8_t)__builtin_va_arg(args, int32_t);
+                buf[1] = '\0';
+                host_puts(buf);
+                break;
+            case '%':
+                host_puts("%");
+                break;
+            default:
+                format--; // Not a conversion: print it as it is
+                break;
+        }
+        start = format + 1;
+    }
+    linux_syscall(LINUX_WRITE, 1, (uint32_t)start, format - start);
+    __builtin_va_end(args);
+    return 0;
+}
+
+/*
+ * host_now_ns
+ *   DESCRIPTION: Monotonic clock in nanoseconds, wrapping
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: nanoseconds
+ *   SIDE EFFECTS: none
+ */
+static uint32_t host_now_ns() {
+    linux_timespec_t now;
+
+    linux_syscall(LINUX_CLOCK_GETTIME, LINUX_CLOCK_MONOTONIC, (uint32_t)&now, 0);
+    return now.sec * 1000000000U + now.nsec;
+}
+
+/*
+ * host_tsc_calibrate
+ *   DESCRIPTION: Measures the TSC rate against the monotonic clock over HOST_CAL_NS, as tsc_calibrate
+ *                does against PIT channel 2 in the kernel
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Sets tsc_mhz
+ */
+static void host_tsc_calibrate() {
+    uint32_t start_ns = host_now_ns();
+    uint32_t start = rdtsc();
+
+    while (host_now_ns() - start_ns < HOST_CAL_NS);
+    tsc_mhz = (rdtsc() - start) / (HOST_CAL_NS / 1000);
+    if (tsc_mhz == 0) {
+        tsc_mhz = 1;
+    }
+}
+
+/*
+ * host_main
+ *   DESCRIPTION: Maps the file system image named on the command line (filesys_img by default) read-only,
+ *                initializes file_sys.c on it and runs fs_bench_run
+ *   INPUTS: argc, argv - from the initial stack
+ *   OUTPUTS: The TSC rate, then one line per benchmark
+ *   RETURN VALUE: exit status: 0 if the benchmarks passed, 1 if not, 2 if the image couldn't be mapped
+ *   SIDE EFFECTS: none
+ */
+static int32_t host_main(int32_t argc, int8_t** argv) {
+    int8_t* path = argc > 1 ? argv[1] : "filesys_img";
+    linux_mmap_args_t map;
+    int32_t fd, size;
+
+    if ((fd = linux_syscall(LINUX_OPEN, (uint32_t)path, LINUX_O_RDONLY, 0)) < 0) {
+        printf("fs_bench_host: can't open %s\n", path);
+        return 2;
+    }
+    size = linux_syscall(LINUX_LSEEK, fd, 0, LINUX_SEEK_END);
+    map.addr = 0;
+    map.len = size;
+    map.prot = LINUX_PROT_READ;
+    map.flags = LINUX_MAP_PRIVATE;
+    map.fd = fd;
+    map.offset = 0;
+    filesys_addr = (uint8_t*)linux_syscall(LINUX_MMAP, (uint32_t)&map, 0, 0);
+    linux_syscall(LINUX_CLOSE, fd, 0, 0);
+    if (size < BLOCK_SIZE || (uint32_t)filesys_addr >= (uint32_t)-4096) {
+        printf("fs_bench_host: can't map %s\n", path);
+        return 2;
+    }
+
+    fileSystem_init(filesys_addr);
+    host_tsc_calibrate();
+    printf("%s: %u bytes, TSC: %u MHz\n", path, size, tsc_mhz);
+    return fs_bench_run() == 0 ? 0 : 1;
+}
+
+/*
+ * host_start
+ *   DESCRIPTION: Process entry: passes argc and argv from the initial stack to host_main, then exits
+ *                with its return value
+ *   INPUTS: [ESP] - argc, followed by argv
+ *   OUTPUTS: none
+ *   RETURN VALUE: never returns
+ *   SIDE EFFECTS: none
+ */
+void __attribute__((noreturn)) host_start(uint32_t* sp) {
+    linux_syscall(LINUX_EXIT, host_main(sp[0], (int8_t**)&sp[1]), 0, 0);
+    for (;;);
+}
+
+asm (
+    ".globl _start\n"
+    "_start:\n"
+    "    xorl %ebp, %ebp\n"     // Outermost frame
+    "    pushl %esp\n"          // host_start(initial stack)
+    "    call host_start\n"
+);
@@ -4,6 +4,7 @@
 
 #include "i8259.h"
 #include "lib.h"
+#include "apic.h"
 
 /* Interrupt masks to determine which interrupts are enabled and disabled */
 uint8_t master_mask = 0xFF; /* IRQs 0-7  */
@@ -55,7 +56,8 @@ void i8259_init(void) {
  * enable_irq
  *   DESCRIPTION: Enables (unmasks) a specific IRQ line on the 8259 PIC, allowing the system to
  *                receive hardware interrupts on that line. It adjusts the IRQ masks for either
- *                the master or slave PIC depending on the IRQ number.
+ *                the master or slave PIC depending on the IRQ number. Unmasks the IOAPIC pin instead once
+ *                apic_init has taken over.
  *   INPUTS: irq_num - The IRQ line number to be enabled.
  *   OUTPUTS: none
  *   RETURN VALUE: none
@@ -64,6 +66,11 @@ void i8259_init(void) {
 void enable_irq(uint32_t irq_num) {
     uint8_t new_mask;
 
+    if (apic_enabled) { // apic_init took over: the 8259 stays masked
+        ioapic_enable_irq(irq_num);
+        return;
+    }
+
     // If IRQ is connected to the primary PIC (IRQ >= 8)
     if(irq_num >= 8) {
         // Create and output new secondary PIC mask w/ new enable bit
@@ -83,7 +90,8 @@ void enable_irq(uint32_t irq_num) {
  * disable_irq
  *   DESCRIPTION: Disables (masks) a specific IRQ line on the 8259 PIC, preventing the system from
  *                receiving hardware interrupts on that line. It adjusts the IRQ masks for either
- *                the master or slave PIC depending on the IRQ number.
+ *                the master or slave PIC depending on the IRQ number. Masks the IOAPIC pin instead once
+ *                apic_init has taken over.
  *   INPUTS: irq_num - The IRQ line number to be disabled.
  *   OUTPUTS: none
  *   RETURN VALUE: none
@@ -92,6 +100,11 @@ void enable_irq(uint32_t irq_num) {
 void disable_irq(uint32_t irq_num) {
     uint8_t new_mask;
 
+    if (apic_enabled) {
+        ioapic_disable_irq(irq_num);
+        return;
+    }
+
     // If IRQ is connected to the primary PIC (IRQ >= 8)
     if(irq_num >= 8) { 
         // If IRQ is connected to the secondary PIC (IRQ >= 8)
@@ -113,13 +126,18 @@ void disable_irq(uint32_t irq_num) {
  *   DESCRIPTION: Sends an End-Of-Interrupt (EOI) signal to the 8259 PIC for a specific IRQ line.
  *                This signals the PIC that the interrupt has been handled and the PIC can resume
  *                sending interrupt requests. For interrupts from the slave PIC, an EOI is also sent
- *                to the master PIC for the cascade IRQ (IRQ 2).
+ *                to the master PIC for the cascade IRQ (IRQ 2). Once apic_init has taken over it's a single
+ *                write to the local APIC's EOI register instead of port I/O.
  *   INPUTS: irq_num - The IRQ line number that has been handled.
  *   OUTPUTS: none
  *   RETURN VALUE: none
  *   SIDE EFFECTS: Signals the 8259 PIC to resume sending interrupts for the specified IRQ line.
  */
 void send_eoi(uint32_t irq_num) {
+    if (apic_enabled) {
+        apic_eoi(); // The local APIC knows which interrupt is in service
+        return;
+    }
     if(irq_num >= 8) { // If IRQ is connected to secondary PIC (IRQ >= 8)
         outb(EOI + (irq_num - 8), SLAVE_8259_PORT); // Send EOI for approriate IRQ port on secondary pic (offset 8)
         outb(EOI + 2, MASTER_8259_PORT); // Send EOI for IRQ 2 on the primary pic
@@ -6,6 +6,9 @@
 #include "keyboard.h"
 #include "sys_calls.h"
 #include "pit.h"
+#include "paging.h"
+#include "apic.h"
+#include "smp.h"
 
 /*
  * read_cr2
@@ -32,7 +35,8 @@ uint32_t read_cr2() {
  *   OUTPUTS: Prints exception details to the screen.
  *   RETURN VALUE: none
  *   SIDE EFFECTS: Can halt the system for critical exceptions. Invokes specific handlers for
- *                 RTC, keyboard, and system calls.
+ *                 RTC, keyboard, and system calls. Holds the kernel lock throughout, except for a
+ *                 TLB shootdown.
  */
 void exc_handler(int vector) {
     uint32_t eax, ebx, ecx, edx;
@@ -42,6 +46,20 @@ void exc_handler(int vector) {
     asm("mov %%ecx, %0" : "=r"(ecx)); // Read ECX into ecx
     asm("mov %%edx, %0" : "=r"(edx)); // Read EDX into edx
 
+    // A TLB shootdown is answered without the kernel lock: the CPU that sent it may be holding it
+    if(vector == APIC_TLB_VECTOR) {
+        tlb_flush();
+        apic_eoi();
+        return;
+    }
+    kernel_lock();
+
+    // Demand paging: a missing user page is loaded and the faulting instruction retried
+    if(vector == 0x0E && page_fault_handler(read_cr2()) == 0) { // 0x0E: Page Fault vector number
+        kernel_unlock();
+        return;
+    }
+
     // Range check for defined CPU exceptions
     if(vector >= 0 && vector <= 0x13) { // 0x00 to 0x13: CPU exception vectors
         printf("Exception %d\n", vector);
@@ -85,13 +103,21 @@ void exc_handler(int vector) {
     // Hardware interrupt handling
     if(vector == 0x28) { // 0x28: RTC interrupt vector number
         RTC_handler();
+        sched_preempt(); // Run a process the interrupt woke, if it's owed the CPU
     }
     else if(vector == 0x21) { // 0x21: Keyboard interrupt vector number
         keyboard_handler();
-    } else if(vector == 0x20) {
+        cli(); // keyboard_handler re-enables interrupts on its way out
+        sched_preempt();
+    } else if(vector == 0x20) { // 0x20: PIT, or the APIC timer in its place
         pit_handler();
+    } else if(vector == APIC_RESCHED_VECTOR) { // Another CPU queued a process here
+        apic_eoi();
+        sched_ipi();
     }
+    // 0xFF: APIC spurious interrupt, nothing to do and no EOI
 
+    kernel_unlock();
 }
 
 /*
@@ -223,7 +249,20 @@ void setup_IDT() {
 
     SET_IDT_ENTRY(entry, PIT_linkage);
     set_IDT_entry_metadata(&entry, interrupt);
-    idt[0x20] = entry; // 0x20 PIT interrupt vector
+    idt[0x20] = entry; // 0x20 PIT interrupt vector (or the APIC timer)
+
+    SET_IDT_ENTRY(entry, spurious_linkage);
+    set_IDT_entry_metadata(&entry, interrupt);
+    idt[0xFF] = entry; // 0xFF APIC spurious interrupt vector
+
+    // Interprocessor interrupts, see smp.c
+    SET_IDT_ENTRY(entry, resched_linkage);
+    set_IDT_entry_metadata(&entry, interrupt);
+    idt[APIC_RESCHED_VECTOR] = entry;
+
+    SET_IDT_ENTRY(entry, tlb_shootdown_linkage);
+    set_IDT_entry_metadata(&entry, interrupt);
+    idt[APIC_TLB_VECTOR] = entry;
 
     // Additional entry setup for system call
     SET_IDT_ENTRY(entry, system_call_linkage);
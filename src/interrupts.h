@@ -8,6 +8,9 @@
 extern void RTC_linkage();
 extern void keyboard_linkage();
 extern void PIT_linkage();
+extern void spurious_linkage();
+extern void resched_linkage();
+extern void tlb_shootdown_linkage();
 
 extern void division_error_linkage();
 extern void debug_linkage();
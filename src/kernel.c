@@ -6,6 +6,7 @@
 #include "x86_desc.h"
 #include "lib.h"
 #include "i8259.h"
+#include "apic.h"
 #include "RTC.h"
 #include "debug.h"
 #include "tests.h"
@@ -15,6 +16,12 @@
 #include "file_sys.h"
 #include "sys_calls.h"
 #include "pit.h"
+#include "frame_alloc.h"
+#include "kmalloc.h"
+#include "process.h"
+#include "wait_queue.h"
+#include "timer.h"
+#include "smp.h"
 #define RUN_TESTS
 
 
@@ -145,8 +152,14 @@ void entry(unsigned long magic, unsigned long addr) {
         tss.esp0 = 0x800000;
         ltr(KERNEL_TSS);
     }
+    frame_alloc_init(mbi); // Hand the RAM from the multiboot memory map to the frame allocator
     setup_kernel_paging(); // Map the kernel and video memory to pages
     enable_paging(); // Enable paging on the OS
+    kmalloc_init(); // Kernel heap size classes, backed by the frame allocator
+    wait_queue_init(); // Wait queue entries come from a kmem cache
+    process_table_init(); // Process table sized by the RAM the frame allocator found
+    smp_init(); // This is CPU 0; it holds the kernel lock until the first shell starts
+    sched_init(); // Run queues, one slot per PID
 
     // Sets up IDT
     setup_IDT();
@@ -157,11 +170,14 @@ void entry(unsigned long magic, unsigned long addr) {
 
     /* Init the PIC */
     i8259_init();
+    apic_init(); // Moves interrupts to the IOAPIC and local APIC if there are any
 
     /* Initialize and enable to keyboard*/
     keyboard_init();
     RTC_init(); // Initalize and enable the RTC
     pit_init();
+    timer_init(); // Kernel timer wheel, run from the PIT interrupt
+    smp_start(); // Start the other CPUs, if the APICs are in use
     enable_cursor();
     update_cursor(0,0);
     
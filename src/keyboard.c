@@ -2,6 +2,7 @@
 #include "sys_calls.h"
 #include "pit.h"
 #include "lib.h"
+#include "wait_queue.h"
 
 // Directory of letters assocated with each scan code for lowercase
 char scan_codes_table[SCAN_CODES] = {
@@ -37,6 +38,7 @@ static int shift_flag;
 static int caps_lock_flag;
 static int ctrl_flag;
 static volatile int enter_flag[NUM_TERMINALS];
+static wait_queue_t terminal_wait[NUM_TERMINALS]; // terminal_read callers sleeping until enter
 static int newline_flag;
 static int alt_flag;
 int cur_terminal;
@@ -135,6 +137,7 @@ void keyboard_handler(void) {
         keyboard_buffer[cur_terminal - 1][keyboard_index[cur_terminal - 1]] = '\0';
         putc_keyboard('\n');
         keyboard_index[cur_terminal - 1] = 0;
+        wait_queue_wake(&terminal_wait[cur_terminal - 1]); // Line is complete, wake the reader
     }
 
     if (keyboard_index[cur_terminal - 1] == MAX_LINE && keyboard_index[cur_terminal - 1] + 1 < BUFFER_SIZE) { // adds new line when end of line is reached
@@ -255,18 +258,21 @@ void keyboard_handler(void) {
         memcpy(VIDEO_MEM, videomem_buffer[selected_terminal - 1], FOUR_KB);
 
         cur_terminal = selected_terminal; // Set the current terminal to match the terminal just selected
+        vidmap_display(selected_terminal); // Point each terminal's user video page at the screen or its buffer
         update_cursor(screen_x[cur_terminal-1], screen_y[cur_terminal-1]);
         
         // If no terminal exists, boot it up!
         if(!(base_shell_booted_bitmask & (1 << (selected_terminal - 1)))) { 
             register uint32_t saved_ebp asm("ebp");
             current_PCB->schedEBP = (void*)saved_ebp; // save ebp for scheduling
+            sched_enqueue(current_PCB); // The interrupted process resumes here on its next turn
 
             // set up and switch vid memory
             shell_init_boot = selected_terminal;
-            cur_process = selected_terminal;
             send_eoi(1);
             CONTEXT_SAVE_CALL(execute, (uint8_t*)"shell"); // Save context of sys call and execuate a new shell in a new thread
+            sti(); // Only reached if the shell couldn't start; its EOI has been sent already
+            return;
         }
     }
 
@@ -282,7 +288,7 @@ void keyboard_handler(void) {
         : "eax"                     // Clobber list, eax is modified
     );
 
-    outb(0x61, 0x20); // Marco to send end EOI for keyboard | 0x61 encoding for EOI | 0x20 PIC i/o port
+    send_eoi(1); // End of interrupt for the keyboard (IRQ 1), to the local APIC when it's in charge
     sti();
 }
 
@@ -294,16 +300,22 @@ void keyboard_handler(void) {
  *           bytes - the maximum number of bytes to read into the buffer
  *   OUTPUTS: none
  *   RETURN VALUE: The number of characters read into the buffer, excluding the null terminator
- *   SIDE EFFECTS: Blocks execution until the enter key is pressed
+ *   SIDE EFFECTS: Sleeps on the terminal's wait queue until the enter key is pressed
  */
 int terminal_read(int32_t fd, void* buffer, int32_t bytes) {
     if(bytes == 0) { // Check if the requested number of bytes to read is 0
         return 0; // If yes, return 0 immediately
     }
 
-    enter_flag[cur_process - 1] = 0; // Reset enter flag
+    uint32_t flags;
+    int terminal = get_current_process();
 
-    while(!enter_flag[cur_process - 1]); // Wait for enter to be pressed
+    cli_and_save(flags);
+    enter_flag[terminal] = 0; // Reset enter flag
+    while(!enter_flag[terminal]) { // Sleep until enter is pressed
+        wait_queue_sleep(&terminal_wait[terminal]);
+    }
+    restore_flags(flags);
 
     int end_flag = 0; // Flag to indicate the end of reading
 
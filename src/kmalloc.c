@@ -0,0 +1,284 @@
+#include "kmalloc.h"
+#include "frame_alloc.h"
+#include "paging.h"
+#include "lib.h"
+
+static kmem_cache_t size_caches[KMALLOC_NUM_CLASSES];   // General purpose kmalloc size classes
+static const int8_t* size_cache_names[KMALLOC_NUM_CLASSES] = {
+    "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128",
+    "kmalloc-256", "kmalloc-512", "kmalloc-1024", "kmalloc-2048"
+};
+static kmem_cache_t* cache_list = NULL;                  // Every initialized cache, newest first
+static uint32_t page_allocs = 0;                         // kmalloc requests served with a whole frame
+
+#define SLAB_HEADER_SIZE ((sizeof(kmem_slab_t) + 7) & ~7)   // Objects start 8-byte aligned after the header
+
+/*
+ * slab_unlink
+ *   DESCRIPTION: Removes a slab from one of a cache's singly linked slab lists
+ *   INPUTS: list - head of the list
+ *           slab - slab to remove
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Updates the list
+ */
+static void slab_unlink(kmem_slab_t** list, kmem_slab_t* slab) {
+    while (*list != NULL) {
+        if (*list == slab) {
+            *list = slab->next;
+            return;
+        }
+        list = &(*list)->next;
+    }
+}
+
+/*
+ * slab_new
+ *   DESCRIPTION: Takes a frame from the frame allocator and carves it into free objects for a cache
+ *   INPUTS: cache - cache the slab belongs to
+ *   OUTPUTS: none
+ *   RETURN VALUE: the new slab, NULL if physical memory is exhausted
+ *   SIDE EFFECTS: Allocates a frame
+ */
+static kmem_slab_t* slab_new(kmem_cache_t* cache) {
+    uint32_t frame = frame_alloc();
+    uint32_t i;
+
+    if (frame == 0) {
+        return NULL;
+    }
+
+    kmem_slab_t* slab = (kmem_slab_t*)frame; // Frames are identity mapped for the kernel
+    uint8_t* obj = (uint8_t*)frame + SLAB_HEADER_SIZE;
+    slab->next = NULL;
+    slab->cache = cache;
+    slab->in_use = 0;
+    slab->free_list = NULL;
+    for (i = 0; i < cache->objs_per_slab; i++) {
+        *(void**)obj = slab->free_list;
+        slab->free_list = obj;
+        obj += cache->obj_size;
+    }
+    cache->slabs++;
+    return slab;
+}
+
+/*
+ * kmem_cache_init
+ *   DESCRIPTION: Sets up a cache of fixed-size objects. Subsystems keep their hot objects (process control
+ *                blocks, wait queue entries, ...) in their own cache so they pack densely and show up
+ *                separately in kmem_stats.
+ *   INPUTS: cache - cache to initialize (usually a static in the owning subsystem)
+ *           name - name shown by kmem_stats
+ *           obj_size - size of each object in bytes, at most KMALLOC_MAX_SLAB
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if obj_size is 0 or too large for a slab
+ *   SIDE EFFECTS: Adds the cache to the statistics list
+ */
+int32_t kmem_cache_init(kmem_cache_t* cache, const int8_t* name, uint32_t obj_size) {
+    if (obj_size == 0 || obj_size > KMALLOC_MAX_SLAB) {
+        return -1;
+    }
+
+    memset(cache, 0, sizeof(kmem_cache_t));
+    strncpy(cache->name, name, KMEM_NAME_LEN - 1);
+    cache->obj_size = (obj_size + 3) & ~3; // Room for the free list link, word aligned
+    cache->objs_per_slab = (PAGE_SIZE - SLAB_HEADER_SIZE) / cache->obj_size;
+
+    uint32_t flags;
+    cli_and_save(flags);
+    cache->next_cache = cache_list;
+    cache_list = cache;
+    restore_flags(flags);
+    return 0;
+}
+
+/*
+ * kmem_cache_alloc
+ *   DESCRIPTION: Allocates one object from a cache. A partly used slab is preferred, then the spare empty
+ *                slab; only when neither exists is a new frame taken.
+ *   INPUTS: cache - cache to allocate from
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to the object (contents undefined), NULL if memory is exhausted
+ *   SIDE EFFECTS: Updates the cache statistics
+ */
+void* kmem_cache_alloc(kmem_cache_t* cache) {
+    kmem_slab_t* slab;
+    void* obj;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    if (cache->partial != NULL) {
+        slab = cache->partial;
+        cache->hits++;
+    } else if (cache->empty != NULL) {
+        slab = cache->empty;
+        cache->empty = NULL;
+        slab->next = cache->partial;
+        cache->partial = slab;
+        cache->hits++;
+    } else {
+        slab = slab_new(cache);
+        if (slab == NULL) {
+            restore_flags(flags);
+            return NULL;
+        }
+        slab->next = cache->partial;
+        cache->partial = slab;
+        cache->misses++;
+    }
+
+    obj = slab->free_list;
+    slab->free_list = *(void**)obj;
+    slab->in_use++;
+    if (slab->free_list == NULL) { // Slab is now full
+        cache->partial = slab->next;
+        slab->next = cache->full;
+        cache->full = slab;
+    }
+    restore_flags(flags);
+    return obj;
+}
+
+/*
+ * kmem_cache_free
+ *   DESCRIPTION: Returns an object to its cache. When a slab empties it is kept as the cache's spare, or
+ *                handed back to the frame allocator if the cache already has one.
+ *   INPUTS: cache - cache the object came from
+ *           obj - object from kmem_cache_alloc
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: May free a frame
+ */
+void kmem_cache_free(kmem_cache_t* cache, void* obj) {
+    kmem_slab_t* slab = (kmem_slab_t*)((uint32_t)obj & ~(PAGE_SIZE - 1));
+    uint32_t flags;
+
+    if (obj == NULL || slab->cache != cache) {
+        return; // Not one of ours
+    }
+
+    cli_and_save(flags);
+    if (slab->free_list == NULL) { // Was full: it has room again
+        slab_unlink(&cache->full, slab);
+        slab->next = cache->partial;
+        cache->partial = slab;
+    }
+    *(void**)obj = slab->free_list;
+    slab->free_list = obj;
+    slab->in_use--;
+    cache->frees++;
+
+    if (slab->in_use == 0) {
+        slab_unlink(&cache->partial, slab);
+        if (cache->empty == NULL) {
+            slab->next = NULL;
+            cache->empty = slab;
+        } else {
+            cache->slabs--;
+            frame_free((uint32_t)slab);
+        }
+    }
+    restore_flags(flags);
+}
+
+/*
+ * kmalloc_init
+ *   DESCRIPTION: Sets up the general purpose size classes used by kmalloc
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Must run after frame_alloc_init and before any kmalloc
+ */
+void kmalloc_init() {
+    uint32_t i;
+    for (i = 0; i < KMALLOC_NUM_CLASSES; i++) {
+        kmem_cache_init(&size_caches[i], size_cache_names[i], KMALLOC_MIN_SIZE << i);
+    }
+}
+
+/*
+ * kmalloc
+ *   DESCRIPTION: Allocates kernel memory. Requests up to KMALLOC_MAX_SLAB bytes come from the smallest size
+ *                class that fits; larger ones, up to a page, get a frame of their own.
+ *   INPUTS: size - number of bytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to the memory, NULL if size is 0, larger than a page, or memory is exhausted
+ *   SIDE EFFECTS: none
+ */
+void* kmalloc(uint32_t size) {
+    uint32_t i;
+
+    if (size == 0) {
+        return NULL;
+    }
+    for (i = 0; i < KMALLOC_NUM_CLASSES; i++) {
+        if (size <= (KMALLOC_MIN_SIZE << i)) {
+            return kmem_cache_alloc(&size_caches[i]);
+        }
+    }
+    if (size <= PAGE_SIZE) {
+        uint32_t frame = frame_alloc();
+        if (frame != 0) {
+            page_allocs++;
+        }
+        return (void*)frame; // Page aligned, which is how kfree tells it from a slab object
+    }
+    return NULL;
+}
+
+/*
+ * kzalloc
+ *   DESCRIPTION: kmalloc, with the memory cleared
+ *   INPUTS: size - number of bytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to the zeroed memory, NULL on failure
+ *   SIDE EFFECTS: none
+ */
+void* kzalloc(uint32_t size) {
+    void* ptr = kmalloc(size);
+    if (ptr != NULL) {
+        memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+/*
+ * kfree
+ *   DESCRIPTION: Frees memory from kmalloc (or from any kmem cache). Slab objects never sit on a page
+ *                boundary because the slab header does, so a page aligned pointer is a whole-frame allocation.
+ *   INPUTS: ptr - memory to free, NULL is ignored
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void kfree(void* ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    if (((uint32_t)ptr & (PAGE_SIZE - 1)) == 0) {
+        page_allocs--;
+        frame_free((uint32_t)ptr);
+        return;
+    }
+    kmem_slab_t* slab = (kmem_slab_t*)((uint32_t)ptr & ~(PAGE_SIZE - 1));
+    kmem_cache_free(slab->cache, ptr);
+}
+
+/*
+ * kmem_stats
+ *   DESCRIPTION: Prints the size, hit/miss counts and memory held by every cache
+ *   INPUTS: none
+ *   OUTPUTS: One line per cache
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void kmem_stats() {
+    kmem_cache_t* cache;
+
+    for (cache = cache_list; cache != NULL; cache = cache->next_cache) {
+        printf("%s: %u B, %u slabs, %u hits, %u misses, %u frees\n",
+               cache->name, cache->obj_size, cache->slabs, cache->hits, cache->misses, cache->frees);
+    }
+    printf("page sized: %u live, %u free frames\n", page_allocs, frame_free_count());
+}
@@ -0,0 +1,45 @@
+#ifndef KMALLOC_H
+#define KMALLOC_H
+
+#include "types.h"
+
+#define KMALLOC_MIN_SIZE     16      // Smallest size class
+#define KMALLOC_NUM_CLASSES  8       // 16, 32, ... 2048 bytes
+#define KMALLOC_MAX_SLAB     2048    // Larger requests (up to PAGE_SIZE) get a whole frame
+#define KMEM_NAME_LEN        16
+
+// One page-sized slab; the header sits at the start of the frame and the objects follow it
+typedef struct kmem_slab_t {
+    struct kmem_slab_t* next;        // Next slab on the cache's partial or full list
+    struct kmem_cache_t* cache;      // Owning cache, found from an object by masking to the page
+    void* free_list;                 // Free objects, linked through their first word
+    uint32_t in_use;                 // Objects currently allocated from this slab
+} kmem_slab_t;
+
+// A cache of equally sized objects
+typedef struct kmem_cache_t {
+    int8_t name[KMEM_NAME_LEN];
+    uint32_t obj_size;               // Bytes per object (rounded up to 4)
+    uint32_t objs_per_slab;
+    kmem_slab_t* partial;            // Slabs with at least one free object
+    kmem_slab_t* full;               // Slabs with no free objects
+    kmem_slab_t* empty;              // At most one completely free slab, kept to avoid thrashing
+    struct kmem_cache_t* next_cache; // Every cache, for kmem_stats
+    // Statistics
+    uint32_t hits;                   // Allocations served from an existing slab
+    uint32_t misses;                 // Allocations that had to take a new frame
+    uint32_t frees;
+    uint32_t slabs;                  // Frames currently held
+} kmem_cache_t;
+
+// See c file for descriptions
+void kmalloc_init();
+int32_t kmem_cache_init(kmem_cache_t* cache, const int8_t* name, uint32_t obj_size);
+void* kmem_cache_alloc(kmem_cache_t* cache);
+void kmem_cache_free(kmem_cache_t* cache, void* obj);
+void* kmalloc(uint32_t size);
+void* kzalloc(uint32_t size);
+void kfree(void* ptr);
+void kmem_stats();
+
+#endif
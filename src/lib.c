@@ -217,11 +217,9 @@ void putc(uint8_t c, int keyboard_print) {
         : "eax"                      // Clobber list, indicating EAX is modified
     );
 
-    int cur_process_local;
-    if(base_shell_booted_bitmask == 0) {
-        cur_process_local = 1;
-    } else {
-        cur_process_local = get_base_process_pcb(current_PCB)->processID;
+    int cur_process_local = current_PCB->terminal;
+    if(cur_process_local == 0) {
+        cur_process_local = 1; // Kernel context (boot, idle) prints to terminal 1
     }
 
     // Assembly code to get the current PCB
@@ -1,5 +1,9 @@
 #include "paging.h"
 #include "lib.h"
+#include "sys_calls.h"
+#include "frame_alloc.h"
+#include "shm.h"
+#include "smp.h"
 
 /*
  * Configures a page directory entry for a 4MB page.
@@ -63,8 +67,10 @@ void set_pt_entry(pt_entry_t* ptentry, uint32_t user, uint32_t offset) {
  * setup_kernel_paging
  *   DESCRIPTION: Configures the initial paging setup for the kernel. This involves setting up
  *                a Page Directory Table (PDT) entry for the kernel space with large pages (4MB),
- *                a PDT entry for the first 4MB of physical memory to use standard 4KB pages, and
- *                setting up a Page Table (PT) entry specifically for video memory.
+ *                supervisor-only 4MB identity mappings for the physical memory the frame allocator
+ *                manages (8MB-128MB), a PDT entry for the first 4MB of physical memory to use
+ *                standard 4KB pages, and setting up a Page Table (PT) entry specifically for video memory.
+ *                The 4MB kernel entries are global; per-process page directories copy them from pdt.
  *   INPUTS: none
  *   OUTPUTS: Modifies the global Page Directory Table (pdt) and the first Page Table (pt0)
  *   RETURN VALUE: none
@@ -76,9 +82,20 @@ void setup_kernel_paging() {
     pdt_entry_page_t kernal_page;
 
     pdt_entry_page_setup(&kernal_page, 0x01, 0);
+    kernal_page.g = 1;          // Global; shared by every page directory, so it survives CR3 loads
 
     pdt[1] = kernal_page.val;   // Maps the second 4MB of virtual memory to a 4MB page in PDT
 
+    // Identity map the rest of the physical memory below the user window (8MB-128MB) for the kernel only,
+    // so frames handed out by frame_alloc can be cleared and filled through their physical address
+    uint32_t i;
+    for (i = FRAME_MEM_START / LARGE_PAGE_SIZE; i < FRAME_MEM_END / LARGE_PAGE_SIZE; i++) {
+        pdt_entry_page_t phys_page;
+        pdt_entry_page_setup(&phys_page, i, 0);
+        phys_page.g = 1;
+        pdt[i] = phys_page.val;
+    }
+
     pdt_entry_table_t first_mb;
 
     // Setup the first Page Directory entry for the first 4MB of physical memory
@@ -110,6 +127,33 @@ void setup_kernel_paging() {
     pt_entry_t video_memory_page3;
     set_pt_entry(&video_memory_page3, 0, 3);
     pt0[0xB8 + 3] = video_memory_page3.val;
+
+    vidmap_display(1); // Terminal 1 is on screen at boot
+}
+
+/*
+ * kernel_map_mmio
+ *   DESCRIPTION: Maps one page of device registers into the kernel's first 4MB (pt0), uncached. Every page
+ *                directory shares pt0, so the registers can be reached from any process.
+ *   INPUTS: virt - page-aligned virtual address below 4MB that pt0 doesn't map yet
+ *           phys - page-aligned physical address of the registers
+ *   OUTPUTS: Modifies pt0
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Invalidates the page's TLB entry
+ */
+void kernel_map_mmio(uint32_t virt, uint32_t phys) {
+    pt_entry_t page;
+
+    page.val = 0;
+    page.p = 1;                 // Present
+    page.rw = 1;                // Read/Write
+    page.us = 0;                // Supervisor only
+    page.pwt = 1;               // Write-through and cache disabled: register accesses must reach the device
+    page.pcd = 1;
+    page.g = 1;                 // Global, like the rest of the kernel
+    page.address_31_12 = phys >> 12;
+    pt0[virt >> 12] = page.val;
+    tlb_invalidate_page(virt);
 }
 
 /*
@@ -128,3 +172,599 @@ void enable_paging() {
     load_page_directory(pdt); // Load the address of the global page directory table into CR3.
     enable_paging_bit(); // Set the paging enable bit in CR0 to activate paging.
 }
+
+/*
+ * tlb_invalidate_page
+ *   DESCRIPTION: Drops the TLB entry (and any cached directory entry) for the page holding one linear
+ *                address, leaving the rest of the TLB warm. Use after changing a single PTE or PDE.
+ *   INPUTS: addr - any linear address inside the page
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Executes invlpg
+ */
+void tlb_invalidate_page(uint32_t addr) {
+    asm volatile ("invlpg (%0)" : : "r" (addr) : "memory");
+}
+
+/*
+ * tlb_invalidate_range
+ *   DESCRIPTION: Drops the TLB entries for every page in [start, end). Past TLB_INVLPG_MAX pages a single
+ *                full flush is cheaper than one invlpg per page, so it falls back to tlb_flush.
+ *   INPUTS: start - first linear address of the range
+ *           end - linear address just past the range
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Invalidates TLB entries
+ */
+void tlb_invalidate_range(uint32_t start, uint32_t end) {
+    uint32_t addr;
+
+    if (end <= start) {
+        return;
+    }
+    if ((end - start) / PAGE_SIZE > TLB_INVLPG_MAX) {
+        tlb_flush();
+        return;
+    }
+    for (addr = start & ~(PAGE_SIZE - 1); addr < end; addr += PAGE_SIZE) {
+        tlb_invalidate_page(addr);
+    }
+}
+
+/*
+ * tlb_flush
+ *   DESCRIPTION: Flushes every non-global TLB entry by reloading CR3. The global kernel mappings survive.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Empties the user part of the TLB
+ */
+void tlb_flush() {
+    flush_tlb();
+}
+
+/*
+ * tlb_flush_global
+ *   DESCRIPTION: Flushes the whole TLB, global entries included, by toggling CR4.PGE. Only needed after
+ *                changing a global (kernel) mapping.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Empties the TLB
+ */
+void tlb_flush_global() {
+    asm volatile (
+        "movl %%cr4, %%eax\n"
+        "andl $~0x80, %%eax\n"   // Clearing PGE invalidates every entry, global ones included
+        "movl %%eax, %%cr4\n"
+        "orl $0x80, %%eax\n"
+        "movl %%eax, %%cr4\n"
+        :
+        :
+        : "eax", "memory"
+    );
+}
+
+/*
+ * user_paging_setup
+ *   DESCRIPTION: Builds the page directory of a newly executed process: the kernel entries of pdt, plus
+ *                its user program window. The directory and the window's page table are frames from the
+ *                frame allocator, kept while the process slot is reused (a base shell restarting).
+ *                Every 4KB page in the window starts out not present; pages are filled in by
+ *                page_fault_handler the first time the program touches them. Video memory is only mapped
+ *                once the process calls vidmap.
+ *   INPUTS: pcb - process whose address space is (re)built
+ *   OUTPUTS: Sets pcb->pageDirectory and pcb->userPageTable
+ *   RETURN VALUE: 0 on success, -1 if physical memory is exhausted
+ *   SIDE EFFECTS: Switches to the new page directory
+ */
+int32_t user_paging_setup(ProcessControlBlock* pcb) {
+    int i;
+    pdt_entry_table_t user_table;
+
+    if (pcb->pageDirectory == NULL) {
+        pcb->pageDirectory = (uint32_t*)frame_alloc();
+        pcb->userPageTable = (uint32_t*)frame_alloc();
+        if (pcb->pageDirectory == NULL || pcb->userPageTable == NULL) {
+            frame_free((uint32_t)pcb->pageDirectory);
+            frame_free((uint32_t)pcb->userPageTable);
+            pcb->pageDirectory = NULL;
+            pcb->userPageTable = NULL;
+            return -1;
+        }
+        memset(pcb->userPageTable, 0, PAGE_SIZE);
+    } else {
+        user_paging_release(pcb); // Drop the previous program's pages
+    }
+
+    for (i = 0; i < NUM_DIR_ETRY; i++) {
+        pcb->pageDirectory[i] = i < USER_PDT_IDX ? pdt[i] : 0; // Share the kernel's entries, nothing above 128MB yet
+    }
+
+    user_table.val = 0;
+    user_table.p = 1;           // Present
+    user_table.rw = 1;          // Read/Write
+    user_table.us = 1;          // User accessible
+    user_table.ps = 0;          // Points to a page table of 4KB pages
+    user_table.address = (uint32_t)pcb->userPageTable >> 12;
+    pcb->pageDirectory[USER_PDT_IDX] = user_table.val;
+
+    user_paging_switch(pcb);
+    return 0;
+}
+
+/*
+ * user_paging_release
+ *   DESCRIPTION: Gives the frames behind a process's private (writable or copy-on-write) pages back to the
+ *                frame allocator and marks every page of its user window not present. Read-only text pages
+ *                point into the file system image and are simply unmapped. The mmap region is dropped entirely, page
+ *                tables included, and its shared memory segments are detached.
+ *   INPUTS: pcb - process whose user window is released
+ *   OUTPUTS: Clears pcb->userPageTable, the mmap region of pcb->pageDirectory and pcb->mappings
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Frees physical frames; the caller must flush the TLB (user_paging_switch does)
+ *                 before the window is used again
+ */
+void user_paging_release(ProcessControlBlock* pcb) {
+    int i;
+    pt_entry_t user_page;
+    pdt_entry_table_t user_table;
+
+    if (pcb->userPageTable == NULL) {
+        return;
+    }
+    for (i = 0; i < NUM_DIR_ETRY; i++) {
+        user_page.val = pcb->userPageTable[i];
+        if (user_page.p && (user_page.rw || (user_page.avl & PTE_AVL_COW))) {
+            frame_free(user_page.address_31_12 << 12);
+        }
+        pcb->userPageTable[i] = 0; // Not present
+    }
+
+    // The mmap region: every present page is a private frame, then the table itself goes
+    for (i = MMAP_START / LARGE_PAGE_SIZE; i < MMAP_END / LARGE_PAGE_SIZE; i++) {
+        user_table.val = pcb->pageDirectory[i];
+        if (user_table.p) {
+            uint32_t* table = (uint32_t*)(user_table.address << 12);
+            int j;
+            for (j = 0; j < NUM_DIR_ETRY; j++) {
+                user_page.val = table[j];
+                if (user_page.p) {
+                    frame_free(user_page.address_31_12 << 12);
+                }
+            }
+            frame_free((uint32_t)table);
+            pcb->pageDirectory[i] = 0;
+        }
+    }
+    for (i = 0; i < MAX_MAPPINGS; i++) {
+        if (pcb->mappings[i].end != 0 && pcb->mappings[i].shm != 0) {
+            shm_unref(pcb->mappings[i].shm - 1); // Detach
+        }
+    }
+    memset(pcb->mappings, 0, sizeof(pcb->mappings));
+}
+
+/*
+ * user_paging_destroy
+ *   DESCRIPTION: Frees a process's whole address space: its user pages, the window's page table and the
+ *                page directory
+ *   INPUTS: pcb - process being torn down; must not be the directory currently loaded in CR3
+ *   OUTPUTS: Clears pcb->pageDirectory and pcb->userPageTable
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Frees physical frames
+ */
+void user_paging_destroy(ProcessControlBlock* pcb) {
+    user_paging_release(pcb);
+    frame_free((uint32_t)pcb->userPageTable);
+    frame_free((uint32_t)pcb->pageDirectory);
+    pcb->userPageTable = NULL;
+    pcb->pageDirectory = NULL;
+}
+
+/*
+ * user_paging_switch
+ *   DESCRIPTION: Switches to the page directory of the given process. Used when execute, halt or the
+ *                scheduler change which process is running. Only the CR3 load is needed: no shared table
+ *                is written, and the global kernel entries stay in the TLB.
+ *   INPUTS: pcb - process whose page directory should be loaded
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Loads CR3, dropping the previous process's (non-global) TLB entries
+ */
+void user_paging_switch(ProcessControlBlock* pcb) {
+    load_page_directory(pcb->pageDirectory);
+}
+
+/*
+ * user_paging_vidmap
+ *   DESCRIPTION: Maps the video memory page table of a terminal at 136MB in a process's page directory
+ *   INPUTS: pcb - process calling vidmap
+ *           terminal - terminal (1-3) the process runs on
+ *   OUTPUTS: Updates pcb->pageDirectory[VID_PDT_IDX]
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Invalidates the TLB entry for VID_MEM
+ */
+void user_paging_vidmap(ProcessControlBlock* pcb, uint32_t terminal) {
+    pdt_entry_table_t vidmem;
+
+    vidmem.val = 0;
+    vidmem.p = 1;  // present
+    vidmem.us = 1; // user
+    vidmem.rw = 1;
+    vidmem.address = (uint32_t)pt_vidmap[terminal - 1] >> 12;
+    pcb->pageDirectory[VID_PDT_IDX] = vidmem.val;
+    tlb_invalidate_page(VID_MEM); // Only this one translation (and its cached directory entry) can be stale
+}
+
+/*
+ * user_pte
+ *   DESCRIPTION: Finds the page table entry that maps a user address in a process's page directory
+ *   INPUTS: pcb - process to look in
+ *           addr - user virtual address (the user window or the mmap region)
+ *           alloc - nonzero to allocate a zeroed page table if the address has none yet
+ *   OUTPUTS: May install a new page table in pcb->pageDirectory
+ *   RETURN VALUE: pointer to the entry, NULL if there's no page table (or none could be allocated)
+ *   SIDE EFFECTS: May allocate a frame
+ */
+static uint32_t* user_pte(ProcessControlBlock* pcb, uint32_t addr, int alloc) {
+    pdt_entry_table_t table;
+    uint32_t pde_idx = addr / LARGE_PAGE_SIZE;
+
+    table.val = pcb->pageDirectory[pde_idx];
+    if (!table.p) {
+        uint32_t frame = alloc ? frame_alloc() : 0;
+        if (frame == 0) {
+            return NULL;
+        }
+        memset((void*)frame, 0, PAGE_SIZE);
+        table.val = 0;
+        table.p = 1;    // Present
+        table.rw = 1;   // Read/Write
+        table.us = 1;   // User accessible
+        table.ps = 0;   // Points to a page table of 4KB pages
+        table.address = frame >> 12;
+        pcb->pageDirectory[pde_idx] = table.val;
+    }
+    return (uint32_t*)(table.address << 12) + (addr % LARGE_PAGE_SIZE) / PAGE_SIZE;
+}
+
+/*
+ * user_paging_unmap
+ *   DESCRIPTION: Unmaps the pages of [start, end) and gives their private frames back, so the next touch
+ *                demand-fills a fresh zero page. Used when sbrk shrinks the heap and by munmap.
+ *   INPUTS: pcb - process whose pages are unmapped
+ *           start, end - page aligned user address range
+ *   OUTPUTS: Clears the page table entries
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Frees physical frames, invalidates the range in the TLB
+ */
+void user_paging_unmap(ProcessControlBlock* pcb, uint32_t start, uint32_t end) {
+    uint32_t addr;
+    pt_entry_t user_page;
+
+    for (addr = start; addr < end; addr += PAGE_SIZE) {
+        uint32_t* pte = user_pte(pcb, addr, 0);
+        if (pte == NULL) {
+            addr = (addr | (LARGE_PAGE_SIZE - 1)) - PAGE_SIZE + 1; // No table: skip to the next 4MB
+            continue;
+        }
+        user_page.val = *pte;
+        if (user_page.p && (user_page.rw || (user_page.avl & PTE_AVL_COW))) {
+            frame_free(user_page.address_31_12 << 12);
+        }
+        *pte = 0;
+    }
+    tlb_invalidate_range(start, end);
+}
+
+/*
+ * fork_table
+ *   DESCRIPTION: Copies one user page table for fork. Every private page (writable or already copy-on-write)
+ *                becomes read-only and copy-on-write in both tables, with one more reference on its frame.
+ *                Shared memory pages stay writable in both, also with one more reference; read-only text
+ *                pages still point into the file system image and are copied as they are.
+ *   INPUTS: parent_table - page table of the forking process
+ *           child_table - empty page table of the child
+ *   OUTPUTS: Fills child_table, write protects parent_table
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: The caller must flush the parent's TLB
+ */
+static void fork_table(uint32_t* parent_table, uint32_t* child_table) {
+    int i;
+    pt_entry_t user_page;
+
+    for (i = 0; i < NUM_DIR_ETRY; i++) {
+        user_page.val = parent_table[i];
+        if (user_page.p && (user_page.avl & PTE_AVL_SHARED)) {
+            frame_share(user_page.address_31_12 << 12); // Shared memory stays shared
+        } else if (user_page.p && (user_page.rw || (user_page.avl & PTE_AVL_COW))) {
+            user_page.rw = 0;
+            user_page.avl |= PTE_AVL_COW;
+            frame_share(user_page.address_31_12 << 12);
+            parent_table[i] = user_page.val;
+        }
+        child_table[i] = user_page.val;
+    }
+}
+
+/*
+ * user_paging_fork
+ *   DESCRIPTION: Gives a forked process a copy-on-write copy of its parent's address space: the user window,
+ *                the mmap region and the vidmap entry. No page is copied here; both processes share every
+ *                frame read-only, and the first write on either side makes a private copy (cow_fault).
+ *   INPUTS: parent - forking process, its directory must be the one loaded in CR3
+ *           child - new process without an address space
+ *   OUTPUTS: Sets child->pageDirectory and child->userPageTable
+ *   RETURN VALUE: 0 on success, -1 if physical memory ran out (whatever was built is left in child, for
+ *                 user_paging_destroy)
+ *   SIDE EFFECTS: Write protects the parent's private pages and flushes its TLB
+ */
+int32_t user_paging_fork(ProcessControlBlock* parent, ProcessControlBlock* child) {
+    int i;
+    pdt_entry_table_t user_table;
+
+    child->pageDirectory = (uint32_t*)frame_alloc();
+    if (child->pageDirectory == NULL) {
+        return -1;
+    }
+    child->userPageTable = (uint32_t*)frame_alloc();
+    if (child->userPageTable == NULL) {
+        frame_free((uint32_t)child->pageDirectory);
+        child->pageDirectory = NULL;
+        return -1;
+    }
+
+    for (i = 0; i < NUM_DIR_ETRY; i++) {
+        child->pageDirectory[i] = i < USER_PDT_IDX || i == VID_PDT_IDX ? parent->pageDirectory[i] : 0;
+    }
+    user_table.val = parent->pageDirectory[USER_PDT_IDX];
+    user_table.address = (uint32_t)child->userPageTable >> 12;
+    child->pageDirectory[USER_PDT_IDX] = user_table.val;
+
+    int32_t ret = 0;
+    fork_table(parent->userPageTable, child->userPageTable);
+    for (i = MMAP_START / LARGE_PAGE_SIZE; i < MMAP_END / LARGE_PAGE_SIZE; i++) {
+        user_table.val = parent->pageDirectory[i];
+        if (!user_table.p) {
+            continue;
+        }
+        uint32_t* table = user_pte(child, i * LARGE_PAGE_SIZE, 1);
+        if (table == NULL) {
+            ret = -1; // Out of physical memory
+            break;
+        }
+        fork_table((uint32_t*)(user_table.address << 12), table);
+    }
+
+    tlb_flush(); // The parent's writable translations are stale
+    return ret;
+}
+
+/*
+ * vidmap_display
+ *   DESCRIPTION: Points the user video memory page of each terminal at the right physical page: the screen
+ *                (0xB8000) for the terminal being displayed, its backing buffer for the others. Called on
+ *                boot and whenever the displayed terminal changes, so the scheduler never touches these tables.
+ *   INPUTS: terminal - terminal (1-3) now on screen
+ *   OUTPUTS: Updates entry 0 of every pt_vidmap table
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Invalidates the TLB entry for VID_MEM, here and on the other CPUs
+ */
+void vidmap_display(uint32_t terminal) {
+    uint32_t t;
+    pt_entry_t vidmem_pt;
+
+    for (t = 1; t <= NUM_VIDMAP_PT; t++) {
+        vidmem_pt.val = 0;
+        vidmem_pt.p = 1;  // present
+        vidmem_pt.us = 1; // user
+        vidmem_pt.rw = 1;
+        vidmem_pt.address_31_12 = VID_MEM_PHYSICAL / PAGE_SIZE + (t == terminal ? 0 : t);
+        pt_vidmap[t - 1][0] = vidmem_pt.val;
+    }
+    // Here only the running address space can hold a stale 136MB translation; every other process's
+    // entries are dropped by the CR3 load that switches to it. The other CPUs' running processes may
+    // have one too.
+    tlb_invalidate_page(VID_MEM);
+    smp_tlb_shootdown();
+}
+
+/*
+ * cow_fault
+ *   DESCRIPTION: Resolves a write to a copy-on-write page. While another address space still maps the frame,
+ *                the page is copied to a new frame and the reference on the old one dropped; the last owner
+ *                just gets write access back.
+ *   INPUTS: pte - page table entry of the page, present with PTE_AVL_COW set
+ *           page_start - user address of the page
+ *   OUTPUTS: Makes the entry writable
+ *   RETURN VALUE: 0 on success, -1 if physical memory ran out
+ *   SIDE EFFECTS: May allocate a frame, invalidates the page's TLB entry
+ */
+static int32_t cow_fault(uint32_t* pte, uint32_t page_start) {
+    pt_entry_t user_page;
+
+    user_page.val = *pte;
+    uint32_t old_frame = user_page.address_31_12 << 12;
+    if (frame_is_shared(old_frame)) {
+        uint32_t frame = frame_alloc();
+        if (frame == 0) {
+            return -1; // Out of physical memory
+        }
+        memcpy((void*)frame, (void*)old_frame, PAGE_SIZE); // Both through the kernel's identity mapping
+        frame_free(old_frame); // Drop this process's reference, the others keep the frame
+        user_page.address_31_12 = frame >> 12;
+    }
+    user_page.rw = 1;
+    user_page.avl &= ~PTE_AVL_COW;
+    *pte = user_page.val;
+    tlb_invalidate_page(page_start);
+    return 0;
+}
+
+/*
+ * mmap_fault
+ *   DESCRIPTION: Demand-zero fill for the mmap region: if the address lies in one of the process's
+ *                mappings, a zeroed frame is mapped read/write there (allocating the page table first
+ *                if this is the first page in its 4MB). Pages of shared memory segments map the segment's
+ *                frame instead. Writes to copy-on-write pages go to cow_fault.
+ *   INPUTS: pcb - faulting process
+ *           fault_addr - faulting address, inside [MMAP_START, MMAP_END)
+ *   OUTPUTS: Maps the page
+ *   RETURN VALUE: 0 if the page was mapped, -1 if the address isn't mapped or memory ran out
+ *   SIDE EFFECTS: Allocates frames
+ */
+static int32_t mmap_fault(ProcessControlBlock* pcb, uint32_t fault_addr) {
+    int i;
+    pt_entry_t user_page;
+
+    for (i = 0; i < MAX_MAPPINGS; i++) {
+        if (fault_addr >= pcb->mappings[i].start && fault_addr < pcb->mappings[i].end) {
+            break;
+        }
+    }
+    if (i == MAX_MAPPINGS) {
+        return -1; // Not mapped
+    }
+
+    uint32_t* pte = user_pte(pcb, fault_addr, 1);
+    if (pte == NULL) {
+        return -1; // Out of physical memory
+    }
+    user_page.val = *pte;
+    if (user_page.p) {
+        if (user_page.avl & PTE_AVL_COW) {
+            return cow_fault(pte, fault_addr & ~(PAGE_SIZE - 1));
+        }
+        return -1; // Already present: a real protection fault
+    }
+
+    user_page.val = 0;
+    user_page.p = 1;    // Present
+    user_page.rw = 1;   // Read/Write
+    user_page.us = 1;   // User accessible
+
+    uint32_t frame;
+    if (pcb->mappings[i].shm != 0) {
+        // Shared memory: the segment's frame for this offset, the same one every attached process maps
+        frame = shm_frame(pcb->mappings[i].shm - 1, (fault_addr - pcb->mappings[i].start) / PAGE_SIZE);
+        if (frame == 0) {
+            return -1; // Out of physical memory
+        }
+        frame_share(frame); // This page table's reference
+        user_page.avl = PTE_AVL_SHARED;
+    } else {
+        frame = frame_alloc();
+        if (frame == 0) {
+            return -1; // Out of physical memory
+        }
+        memset((void*)frame, 0, PAGE_SIZE); // Zero through the identity mapping, before the process can see it
+    }
+
+    user_page.address_31_12 = frame >> 12;
+    *pte = user_page.val;
+    return 0;
+}
+
+/*
+ * page_fault_handler
+ *   DESCRIPTION: Demand-loads one 4KB page of the current process's user program window: the image and
+ *                heap below the program break, or the stack in the top USER_STACK_SIZE of the window.
+ *                Faults in the mmap region are handed to mmap_fault.
+ *                With EXEC_IN_PLACE, whole pages of read-only text (below the PCB's textEnd) are mapped
+ *                read-only straight onto the file system data block that holds them, so every process
+ *                running the same program shares that memory and nothing is copied. All other pages get
+ *                a fresh 4KB frame from frame_alloc, are zero filled, and then any bytes of the
+ *                program image that fall inside them are copied in. A write to a read-only text page
+ *                (from the program, or from the kernel on its behalf) lands here too and swaps in a
+ *                private copy of that page, and so does a write to a page shared copy-on-write by fork.
+ *   INPUTS: fault_addr - faulting linear address (CR2)
+ *   OUTPUTS: Maps the page in the process's user page table
+ *   RETURN VALUE: 0 if the fault was resolved and the instruction can be retried,
+ *                 -1 if the address is not a demand-loadable user page or physical memory ran out
+ *   SIDE EFFECTS: Writes the newly mapped page
+ */
+int32_t page_fault_handler(uint32_t fault_addr) {
+    ProcessControlBlock* current_pcb;
+    // Assembly code to get the current PCB
+    // Clear the lower 13 bits then AND with ESP to align it to the 8KB boundary
+    asm volatile (
+        "movl %%esp, %%eax\n"       // Move current ESP value to EAX for manipulation
+        "andl $0xFFFFE000, %%eax\n" // Clear the lower 13 bits to align to 8KB boundary
+        "movl %%eax, %0\n"          // Move the modified EAX value to current_pcb
+        : "=r" (current_pcb)        // Output operands
+        :                            // No input operands
+        : "eax"                      // Clobber list, indicating EAX is modified
+    );
+
+    uint32_t* page_table = current_pcb->userPageTable;
+    if (page_table == NULL) {
+        return -1; // Kernel context has no user window
+    }
+
+    if (fault_addr >= MMAP_START && fault_addr < MMAP_END) {
+        return mmap_fault(current_pcb, fault_addr);
+    }
+    if (fault_addr < USER_MEM_START || fault_addr >= USER_MEM_START + LARGE_PAGE_SIZE) {
+        return -1; // Outside the user program window
+    }
+    if (fault_addr >= PAGE_ROUND_UP(current_pcb->brk) && fault_addr < USER_STACK - USER_STACK_SIZE) {
+        return -1; // Between the heap and the stack
+    }
+
+    uint32_t page_idx = (fault_addr - USER_MEM_START) / PAGE_SIZE;
+    uint32_t page_start = USER_MEM_START + page_idx * PAGE_SIZE;
+    pt_entry_t user_page;
+    user_page.val = page_table[page_idx];
+
+    if (user_page.p && user_page.rw) {
+        return -1; // Writable page already present: a real protection fault
+    }
+    if (user_page.p && (user_page.avl & PTE_AVL_COW)) {
+        return cow_fault(&page_table[page_idx], page_start); // Private page shared since a fork
+    }
+    int was_present = user_page.p; // Read-only text page being written: replace it with a private copy
+
+#ifdef EXEC_IN_PLACE
+    const uint8_t* block;
+    if (!was_present && page_start + PAGE_SIZE <= current_pcb->textEnd &&
+        read_data_span(current_pcb->imageInode, page_start - PROGRAM_START, &block) == PAGE_SIZE &&
+        ((uint32_t)block & (PAGE_SIZE - 1)) == 0) {
+        user_page.val = 0;
+        user_page.p = 1;    // Present
+        user_page.rw = 0;   // Read only, shared with every process running this program
+        user_page.us = 1;   // User accessible
+        user_page.address_31_12 = (uint32_t)block >> 12; // The data block itself (kernel memory is identity mapped)
+        page_table[page_idx] = user_page.val;
+        return 0;
+    }
+#endif
+
+    uint32_t frame = frame_alloc();
+    if (frame == 0) {
+        return -1; // Out of physical memory
+    }
+
+    user_page.val = 0;
+    user_page.p = 1;    // Present
+    user_page.rw = 1;   // Read/Write
+    user_page.us = 1;   // User accessible
+    user_page.address_31_12 = frame >> 12;
+    page_table[page_idx] = user_page.val;
+    if (was_present) {
+        tlb_invalidate_page(page_start); // Drop the cached read-only translation
+    }
+    // Otherwise no TLB flush is needed: the processor never caches not-present translations
+
+    memset((void*)page_start, 0, PAGE_SIZE);
+
+    // Copy the slice of the program image [PROGRAM_START, PROGRAM_START + imageSize) inside this page
+    uint32_t image_end = PROGRAM_START + current_pcb->imageSize;
+    uint32_t copy_start = page_start > PROGRAM_START ? page_start : PROGRAM_START;
+    uint32_t copy_end = page_start + PAGE_SIZE < image_end ? page_start + PAGE_SIZE : image_end;
+    if (copy_start < copy_end) {
+        read_data(current_pcb->imageInode, copy_start - PROGRAM_START, (uint8_t*)copy_start, copy_end - copy_start);
+    }
+
+    return 0;
+}
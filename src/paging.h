@@ -3,10 +3,40 @@
 
 #include "x86_desc.h"
 
+#define PAGE_SIZE       4096        // 4kB page
+#define LARGE_PAGE_SIZE 0x400000    // 4MB page
+#define USER_MEM_START  0x8000000   // 128MB: start of the 4MB user program window
+#define USER_PDT_IDX    32          // Page Directory Table index for the user program window
+#define USER_STACK_SIZE 0x100000    // Top 1MB of the user window is kept for the stack; the heap can't grow into it
+#define MMAP_START      0x9000000   // 144MB: anonymous mmap region, its page tables are allocated on first use
+#define MMAP_END        0x10000000  // 256MB
+#define PAGE_ROUND_UP(addr) (((addr) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
+#define TLB_INVLPG_MAX  32          // Larger ranges are flushed whole instead of page by page
+#define PTE_AVL_COW     0x1         // pt_entry_t.avl bit: a private frame mapped read-only until it's written (fork)
+#define PTE_AVL_SHARED  0x2         // pt_entry_t.avl bit: a shared memory segment frame, fork keeps it shared
+
+// Map read-only program text straight from the file system image instead of copying it
+#define EXEC_IN_PLACE
+
 // See c file for descriptions
 void set_pt_entry(pt_entry_t* ptentry, uint32_t user, uint32_t offset);
 void setup_kernel_paging();
 void enable_paging();
+void kernel_map_mmio(uint32_t virt, uint32_t phys);
+void tlb_invalidate_page(uint32_t addr);
+void tlb_invalidate_range(uint32_t start, uint32_t end);
+void tlb_flush();
+void tlb_flush_global();
+struct ProcessControlBlock;
+int32_t user_paging_setup(struct ProcessControlBlock* pcb);
+void user_paging_release(struct ProcessControlBlock* pcb);
+void user_paging_destroy(struct ProcessControlBlock* pcb);
+void user_paging_switch(struct ProcessControlBlock* pcb);
+void user_paging_vidmap(struct ProcessControlBlock* pcb, uint32_t terminal);
+void user_paging_unmap(struct ProcessControlBlock* pcb, uint32_t start, uint32_t end);
+int32_t user_paging_fork(struct ProcessControlBlock* parent, struct ProcessControlBlock* child);
+void vidmap_display(uint32_t terminal);
+int32_t page_fault_handler(uint32_t fault_addr);
 
 extern void load_page_directory(unsigned int*);
 extern void enable_paging_bit();
@@ -2,19 +2,224 @@
 #include "lib.h"
 #include "i8259.h"
 #include "sys_calls.h"
+#include "process.h"
+#include "kmalloc.h"
+#include "timer.h"
+#include "apic.h"
+#include "smp.h"
 
-int cur_process = 1; // Global variable for the current thread being computed
+// Weight of each nice level (-20..19) in the fair scheduler, in units of NICE_0_WEIGHT. Each step is
+// about 1.25x, so one nice level is roughly a 10% difference in CPU share.
+static const uint32_t sched_nice_weight[NICE_LEVELS] = {
+    88761, 71755, 56483, 46273, 36291, 29154, 23254, 18705, 14949, 11916, // -20 .. -11
+     9548,  7620,  6100,  4904,  3906,  3121,  2501,  1991,  1586,  1277, // -10 .. -1
+     1024,   820,   655,   526,   423,   335,   272,   215,   172,   137, //   0 .. 9
+      110,    87,    70,    56,    45,    36,    29,    23,    18,    15  //  10 .. 19
+};
 
+// Each CPU has a run queue (cpu_t.run_heap): runnable processes waiting for that CPU, a binary min-heap on
+// vruntime (one slot per PID). Running processes are never on one, and neither are blocked ones. A CPU
+// with nothing left to run steals from the busiest queue, see sched_steal. vruntime is relative to the
+// CPU's min_vruntime, and is rebased when a process moves.
+//
+// A queue is guarded by its CPU's rq_lock rather than the kernel lock, so an idle CPU can find or steal
+// work, and a wakeup can queue it, without waiting out a system call on another CPU. Only one rq_lock is
+// held at a time. The kernel lock is still taken before a process from a queue is moved or run: a CPU
+// that queues its current process (schedule, the keyboard's shell boot) holds it until that process has
+// been switched out.
+
+volatile uint32_t pit_interrupts = 0; // Scheduler timer interrupts since pit_init, on all CPUs
+volatile uint32_t idle_interrupts = 0; // Those that found their CPU in the idle context
+
+// Clock: time is kept by folding each finished PIT countdown into clock_us. When the APIC timer raises the
+// scheduler interrupt instead, PIT channel 0 just counts down freely and clock_sync folds in its progress.
+static uint32_t clock_us = 0;         // pit_time_us() when the current countdown started
+static uint32_t clock_carry = 0;      // Counts * 1000 not yet folded into clock_us (less than PIT_KHZ)
+static uint32_t pit_count = PIT_DIVISOR; // Counts loaded for the current countdown (PIT count at the last clock_sync)
+static int pit_apic_timer = 0;        // The APIC timer raises the scheduler interrupt, see pit_init
+
+static void sched_idle();
+static void pit_rearm(ProcessControlBlock* running);
+static void sched_switch(ProcessControlBlock* current, ProcessControlBlock* next, int save);
+
+#ifdef TICKLESS
+/*
+ * pit_program
+ *   DESCRIPTION: Starts a one-shot countdown on PIT channel 0 (mode 0, interrupt on terminal count)
+ *   INPUTS: counts - PIT input clocks until the interrupt, at most 0xFFFF
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Reprograms the PIT. Called with interrupts disabled.
+ */
+static void pit_program(uint32_t counts) {
+    outb(0x30, 0x43); // Channel 0, lobyte/hibyte, mode 0
+    outb(counts & 0xFF, 0x40);
+    outb(counts >> 8, 0x40);
+    pit_count = counts;
+}
+
+static void clock_fold(uint32_t counts);
+static void clock_sync();
+static uint32_t pit_elapsed();
+
+/*
+ * pit_shot
+ *   DESCRIPTION: Ends the current countdown where it is and starts one for the next deadline, on the PIT
+ *                or the APIC timer
+ *   INPUTS: us - microseconds until the interrupt, at most PIT_MAX_SHOT_US
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Reprograms the timer. Called with interrupts disabled.
+ */
+static void pit_shot(uint32_t us) {
+    if (us < PIT_MIN_SHOT_US) {
+        us = PIT_MIN_SHOT_US; // Overdue: interrupt as soon as is sensible
+    }
+    if (pit_apic_timer) {
+        clock_sync();
+        apic_timer_oneshot(us);
+    } else {
+        clock_fold(pit_elapsed()); // Close the current countdown where it is
+        pit_program(us * PIT_KHZ / 1000);
+    }
+    this_cpu()->pit_deadline = clock_us + us;
+}
+#endif
+
+/*
+ * pit_init
+ *   DESCRIPTION: Starts the scheduler interrupt: one-shot countdowns in tickless mode, otherwise a PIT_HZ
+ *                tick. With the APICs enabled the APIC timer raises it (on the same vector) and PIT channel 0
+ *                is left running freely with its IRQ masked, only as the clock; every APIC timer deadline is
+ *                within the PIT's 0x10000 count wrap, so clock_sync never misses one.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Must run after apic_init
+ */
 void pit_init() {
-    int divisor = PIT_FREQ / 100; // Calculate the divisor for the PIT
+    if (apic_enabled) {
+        pit_apic_timer = 1;
+        outb(0x34, 0x43); // Mode 2 with a count of 0 (0x10000): a free-running clock
+        outb(0, 0x40);
+        outb(0, 0x40);
+        pit_count = 0;
+#ifdef TICKLESS
+        apic_timer_oneshot(PIT_MAX_SHOT_US);
+        cpus[0].pit_deadline = PIT_MAX_SHOT_US;
+#else
+        apic_timer_periodic(SCHED_TICK_US);
+#endif
+        return;
+    }
+#ifdef TICKLESS
+    pit_program(PIT_MAX_SHOT_US * PIT_KHZ / 1000); // Nothing to schedule yet: the longest countdown
+    cpus[0].pit_deadline = PIT_MAX_SHOT_US;
+#else
+    int divisor = PIT_DIVISOR; // Calculate the divisor for the PIT
     outb(0x34, 0x43); // Set the PIT to mode 2, rate generator
-    outb(divisor & 0xFF, 0x40); // Set the PIT to 50ms
-    outb((divisor >> 8), 0x40); // Set the PIT to 50ms
+    outb(divisor & 0xFF, 0x40); // Set the PIT to 10ms
+    outb((divisor >> 8), 0x40); // Set the PIT to 10ms
+#endif
     enable_irq(0); // Enable the PIT on the PIC
 
 }
- 
-void pit_handler() {
+
+/*
+ * sched_init
+ *   DESCRIPTION: Allocates each CPU's run queue, one slot for every PID the process table can hold
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Must run after process_table_init and smp_init, and before the first execute
+ */
+void sched_init() {
+    uint32_t i;
+
+    for (i = 0; i < MAX_CPUS; i++) {
+        cpus[i].run_heap = kzalloc(process_table_size * sizeof(ProcessControlBlock*));
+    }
+}
+
+/*
+ * pit_elapsed
+ *   DESCRIPTION: PIT input clocks since the current countdown started. In one-shot mode the counter keeps
+ *                going past zero (wrapping to 0xFFFF), so this stays right until 0x10000 counts (~55ms)
+ *                after the start, which the PIT interrupt comes well before.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: elapsed counts
+ *   SIDE EFFECTS: Latches PIT channel 0. Called with interrupts disabled.
+ */
+static uint32_t pit_elapsed() {
+    uint32_t count;
+
+    outb(0x00, 0x43); // Latch channel 0's count
+    count = inb(0x40);
+    count |= inb(0x40) << 8;
+    return (pit_count - count) & 0xFFFF;
+}
+
+/*
+ * clock_fold
+ *   DESCRIPTION: Adds a finished countdown to clock_us, carrying the sub-microsecond remainder so no time is
+ *                lost to rounding
+ *   INPUTS: counts - PIT input clocks to add
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Called with interrupts disabled
+ */
+static void clock_fold(uint32_t counts) {
+    clock_carry += counts * 1000;
+    clock_us += clock_carry / PIT_KHZ;
+    clock_carry %= PIT_KHZ;
+}
+
+/*
+ * clock_sync
+ *   DESCRIPTION: APIC timer mode: folds how far the free-running PIT has counted since the last sync into
+ *                clock_us. Has to run at least every 0x10000 counts (~55ms).
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Latches PIT channel 0. Called with interrupts disabled.
+ */
+static void clock_sync() {
+    uint32_t elapsed = pit_elapsed();
+
+    clock_fold(elapsed);
+    pit_count = (pit_count - elapsed) & 0xFFFF;
+}
+
+/*
+ * pit_time_us
+ *   DESCRIPTION: Microseconds since pit_init: the finished countdowns plus how far the PIT is into the
+ *                current one. Works the same for the periodic tick and tickless mode. Wraps after about
+ *                71 minutes, so only differences are meaningful.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: time in microseconds
+ *   SIDE EFFECTS: Latches PIT channel 0
+ */
+uint32_t pit_time_us() {
+    uint32_t flags;
+    uint32_t now;
+
+    cli_and_save(flags);
+    now = clock_us + (clock_carry + pit_elapsed() * 1000) / PIT_KHZ;
+    restore_flags(flags);
+    return now;
+}
+
+/*
+ * sched_current
+ *   DESCRIPTION: Finds the PCB of the running process (or IDLE_PCB) by masking ESP
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: current PCB
+ *   SIDE EFFECTS: none
+ */
+static ProcessControlBlock* sched_current() {
     ProcessControlBlock* current_PCB;
     // Assembly code to get the current PCB
     // Mask the lower 13 bits then AND with ESP to align it to the 8KB boundary
@@ -26,63 +231,701 @@ void pit_handler() {
         :                            // No input operands
         : "eax"                      // Clobber list, indicating EAX is modified
     );
+    return current_PCB;
+}
+
+/*
+ * sched_before
+ *   DESCRIPTION: Heap order: whether a should run before b. Compares the difference so vruntime can wrap.
+ *   INPUTS: a, b - processes to compare
+ *   OUTPUTS: none
+ *   RETURN VALUE: nonzero if a has the smaller vruntime
+ *   SIDE EFFECTS: none
+ */
+static inline int sched_before(ProcessControlBlock* a, ProcessControlBlock* b) {
+    return (int32_t)(a->vruntime - b->vruntime) < 0;
+}
+
+/*
+ * sched_cpu_idle
+ *   DESCRIPTION: Whether a CPU is up and has nothing to do: in its idle context with an empty run queue
+ *   INPUTS: cpu - CPU to look at
+ *   OUTPUTS: none
+ *   RETURN VALUE: nonzero if it's idle
+ *   SIDE EFFECTS: none
+ */
+static inline int sched_cpu_idle(cpu_t* cpu) {
+    return cpu->started && cpu->current == cpu->idle && cpu->run_count == 0;
+}
+
+/*
+ * sched_migrate
+ *   DESCRIPTION: Moves a process that isn't running or queued to another CPU, keeping its vruntime the same
+ *                distance from that CPU's min_vruntime as it was from its old one's
+ *   INPUTS: pcb - process to move
+ *           cpu - where it runs from now on
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void sched_migrate(ProcessControlBlock* pcb, cpu_t* cpu) {
+    pcb->vruntime += cpu->min_vruntime - cpus[pcb->cpu].min_vruntime;
+    pcb->cpu = cpu->id;
+}
+
+/*
+ * sched_select_cpu
+ *   DESCRIPTION: Picks the CPU a process that's becoming runnable should queue on: the one it last ran on,
+ *                unless that one is busy and another is idle
+ *   INPUTS: pcb - process that isn't running or queued
+ *   OUTPUTS: none
+ *   RETURN VALUE: CPU to queue it on (it has been moved there)
+ *   SIDE EFFECTS: Called with interrupts disabled
+ */
+static cpu_t* sched_select_cpu(ProcessControlBlock* pcb) {
+    cpu_t* cpu = &cpus[pcb->cpu];
+    uint32_t i;
+
+    if (sched_cpu_idle(cpu)) {
+        return cpu;
+    }
+    for (i = 0; i < MAX_CPUS; i++) {
+        if (sched_cpu_idle(&cpus[i])) {
+            sched_migrate(pcb, &cpus[i]);
+            return &cpus[i];
+        }
+    }
+    return cpu;
+}
+
+/*
+ * sched_kick
+ *   DESCRIPTION: Tells another CPU its run queue changed, so it picks up the work (if idle), preempts (if
+ *                need_resched is set) or gives its current process a timeslice (if it was alone)
+ *   INPUTS: cpu - CPU to interrupt
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Sends a reschedule IPI unless cpu is this one
+ */
+static void sched_kick(cpu_t* cpu) {
+    if (cpu != this_cpu()) {
+        apic_send_ipi(cpu->apic_id, APIC_RESCHED_VECTOR);
+    }
+}
+
+/*
+ * sched_kick_idle
+ *   DESCRIPTION: Wakes an idle CPU, if there is one, so it can steal from a run queue that just grew
+ *   INPUTS: busy - CPU whose queue grew
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: May send a reschedule IPI
+ */
+static void sched_kick_idle(cpu_t* busy) {
+    uint32_t i;
+
+    for (i = 0; i < MAX_CPUS; i++) {
+        if (&cpus[i] != busy && sched_cpu_idle(&cpus[i])) {
+            sched_kick(&cpus[i]);
+            return;
+        }
+    }
+}
+
+/*
+ * sched_enqueue_on
+ *   DESCRIPTION: Adds a runnable process to a CPU's run queue, ordered by its vruntime. If the CPU wasn't
+ *                idle, an idle one is woken to steal work.
+ *   INPUTS: cpu - CPU whose queue it goes on (pcb->cpu)
+ *           pcb - process to run; must not be running elsewhere or already queued
+ *   OUTPUTS: none
+ *   RETURN VALUE: length of the queue once it was added
+ *   SIDE EFFECTS: Called with interrupts disabled; the kernel lock isn't needed
+ */
+static uint32_t sched_enqueue_on(cpu_t* cpu, ProcessControlBlock* pcb) {
+    ProcessControlBlock** run_heap = cpu->run_heap;
+    uint32_t i, parent, count;
+
+    spin_lock(&cpu->rq_lock);
+    for (i = cpu->run_count++; i > 0; i = parent) { // Sift up
+        parent = (i - 1) / 2;
+        if (!sched_before(pcb, run_heap[parent])) {
+            break;
+        }
+        run_heap[i] = run_heap[parent];
+    }
+    run_heap[i] = pcb;
+    count = cpu->run_count;
+    spin_unlock(&cpu->rq_lock);
+    if (count == 1) {
+        if (cpu == this_cpu()) {
+            pit_rearm(sched_current()); // The current process isn't alone any more: it gets a timeslice
+        } else {
+            sched_kick(cpu);
+        }
+    }
+    if (cpu->current != cpu->idle) {
+        sched_kick_idle(cpu);
+    }
+    return count;
+}
+
+/*
+ * sched_enqueue
+ *   DESCRIPTION: Queues a runnable process on the CPU it last ran on, or on an idle one if that's busy. The
+ *                current process (queued by the keyboard before it boots a shell in its place) stays on
+ *                this CPU's queue: this CPU is known by it until it's switched out.
+ *   INPUTS: pcb - process to run; must not be running elsewhere or already queued (idle contexts are
+ *                 ignored)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void sched_enqueue(ProcessControlBlock* pcb) {
+    uint32_t flags;
+
+    if (pcb == cpus[pcb->cpu].idle) {
+        return;
+    }
+    cli_and_save(flags);
+    sched_enqueue_on(pcb == sched_current() ? this_cpu() : sched_select_cpu(pcb), pcb);
+    restore_flags(flags);
+}
+
+/*
+ * sched_dequeue
+ *   DESCRIPTION: Takes the process with the smallest vruntime off a CPU's run queue. Called with interrupts
+ *                disabled; the kernel lock isn't needed.
+ *   INPUTS: cpu - CPU whose queue to take from
+ *   OUTPUTS: none
+ *   RETURN VALUE: next process to run, NULL if the queue is empty
+ *   SIDE EFFECTS: none
+ */
+static ProcessControlBlock* sched_dequeue(cpu_t* cpu) {
+    ProcessControlBlock** run_heap = cpu->run_heap;
+    ProcessControlBlock* pcb;
+    ProcessControlBlock* last;
+    uint32_t i, child;
+
+    spin_lock(&cpu->rq_lock);
+    if (cpu->run_count == 0) {
+        spin_unlock(&cpu->rq_lock);
+        return NULL;
+    }
+    pcb = run_heap[0];
+    last = run_heap[--cpu->run_count];
+    for (i = 0; (child = 2 * i + 1) < cpu->run_count; i = child) { // Sift the last entry down from the root
+        if (child + 1 < cpu->run_count && sched_before(run_heap[child + 1], run_heap[child])) {
+            child++;
+        }
+        if (!sched_before(run_heap[child], last)) {
+            break;
+        }
+        run_heap[i] = run_heap[child];
+    }
+    run_heap[i] = last;
+    spin_unlock(&cpu->rq_lock);
+    return pcb;
+}
+
+/*
+ * sched_steal
+ *   DESCRIPTION: Work stealing: takes a waiting process from the CPU with the longest run queue, if it has
+ *                at least min_waiting. The victim's last heap slot is taken, which is a leaf, so its heap
+ *                needs no repair; it's also likely to be one that would have waited longest there. The
+ *                queue lengths are only a hint until the victim's rq_lock is held, so its length is checked
+ *                again under it.
+ *   INPUTS: cpu - CPU that wants work
+ *           min_waiting - shortest queue worth stealing from
+ *   OUTPUTS: none
+ *   RETURN VALUE: stolen process (not queued, and not yet moved: the caller does that with sched_migrate
+ *                 while holding the kernel lock), NULL if nothing qualifies
+ *   SIDE EFFECTS: Called with interrupts disabled; the kernel lock isn't needed
+ */
+static ProcessControlBlock* sched_steal(cpu_t* cpu, uint32_t min_waiting) {
+    cpu_t* victim = NULL;
+    ProcessControlBlock* pcb = NULL;
+    uint32_t i;
+
+    for (i = 0; i < MAX_CPUS; i++) {
+        if (&cpus[i] != cpu && cpus[i].run_count >= min_waiting &&
+            (victim == NULL || cpus[i].run_count > victim->run_count)) {
+            victim = &cpus[i];
+        }
+    }
+    if (victim == NULL) {
+        return NULL;
+    }
+    spin_lock(&victim->rq_lock);
+    if (victim->run_count >= min_waiting) {
+        pcb = victim->run_heap[--victim->run_count];
+    }
+    spin_unlock(&victim->rq_lock);
+    return pcb;
+}
 
-    int saved_process = cur_process; // Save current thread nimber before advancing
+/*
+ * sched_update_min
+ *   DESCRIPTION: Advances a CPU's min_vruntime to the smallest vruntime among its current process and its
+ *                run queue, never moving it backwards
+ *   INPUTS: cpu - this CPU
+ *           current - its running process, or its idle context
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Called with interrupts disabled
+ */
+static void sched_update_min(cpu_t* cpu, ProcessControlBlock* current) {
+    ProcessControlBlock* min = NULL;
 
-    // Advance the thread in round robin fashion
-    cur_process++;
-    if(cur_process == MAX_THREADS) {
-        cur_process = 1;
+    if (current != cpu->idle && current->state == PROC_RUNNABLE) {
+        min = current;
     }
-    if(cur_process == 2 && !(base_shell_booted_bitmask & 0x2)) { // bitmask logic
-        cur_process++;
+    spin_lock(&cpu->rq_lock);
+    if (cpu->run_count != 0 && (min == NULL || sched_before(cpu->run_heap[0], min))) {
+        min = cpu->run_heap[0];
     }
-    if(cur_process == NUM_TERMINALS && !(base_shell_booted_bitmask & 0x4)) { // bitmask logic
-        cur_process = 1;
+    if (min != NULL && (int32_t)(min->vruntime - cpu->min_vruntime) > 0) {
+        cpu->min_vruntime = min->vruntime;
     }
+    spin_unlock(&cpu->rq_lock);
+}
+
+/*
+ * sched_account
+ *   DESCRIPTION: Charges a running process for the time since it was last charged: run time as is, and
+ *                virtual runtime scaled by NICE_0_WEIGHT / weight (lower weights age faster)
+ *   INPUTS: pcb - running process
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Called with interrupts disabled
+ */
+static void sched_account(ProcessControlBlock* pcb) {
+    uint32_t now = pit_time_us();
+    uint32_t delta = now - pcb->execStart;
+
+    if ((int32_t)delta < 0) {
+        delta = 0; // A periodic tick that reloaded the PIT but hasn't been counted yet
+    }
+    if (delta > SCHED_MAX_CHARGE_US) {
+        delta = SCHED_MAX_CHARGE_US; // Interrupts were off for ages; also keeps the product below in 32 bits
+    }
+    pcb->execStart = now;
+    pcb->runUs += delta;
+    pcb->vruntime += delta * NICE_0_WEIGHT / sched_nice_weight[pcb->nice - NICE_MIN];
+}
+
+/*
+ * pit_rearm
+ *   DESCRIPTION: Tickless mode: programs this CPU's timer for its next deadline. While other processes are
+ *                waiting the current one gets a SCHED_TICK_US timeslice, as with the periodic tick. When
+ *                it's the only runnable process, or the CPU is idle, there's nothing to decide, and the
+ *                countdown is as long as the PIT allows (the clock needs at least that). Either way it's
+ *                cut short if a kernel timer is due first. No-op with the periodic tick.
+ *   INPUTS: running - process that will be running when the countdown ends (or the idle context)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Reprograms the timer. Called with interrupts disabled.
+ */
+static void pit_rearm(ProcessControlBlock* running) {
+#ifdef TICKLESS
+    cpu_t* cpu = this_cpu();
+    uint32_t us = PIT_MAX_SHOT_US;
+
+    if (cpu->run_count != 0 && running != cpu->idle) {
+        us = SCHED_TICK_US;
+    }
+    pit_shot(timer_next_us(pit_time_us(), us));
+#endif
+}
 
-    if(saved_process != cur_process) {
-        // Get the PCB of the active process on the active thread
-        ProcessControlBlock* top_PCB = get_top_process_pcb((ProcessControlBlock*)(BASE_MEM - (cur_process + 1) * PCB_MEM));
+/*
+ * pit_deadline_changed
+ *   DESCRIPTION: Tickless mode: moves this CPU's timer interrupt earlier if a kernel timer was just added
+ *                that's due before it. Leaves a later deadline alone, so the running process keeps its
+ *                timeslice. No-op with the periodic tick, which runs the timers every PIT_HZ anyway.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: May reprogram the timer. Called with interrupts disabled.
+ */
+void pit_deadline_changed() {
+#ifdef TICKLESS
+    uint32_t now = pit_time_us();
+    int32_t remaining = (int32_t)(this_cpu()->pit_deadline - now);
+    uint32_t next;
 
+    if (remaining <= 0) {
+        return; // The interrupt is due already
+    }
+    next = timer_next_us(now, remaining);
+    if (next < (uint32_t)remaining) {
+        pit_shot(next);
+    }
+#endif
+}
+
+/*
+ * sched_idle
+ *   DESCRIPTION: Body of a CPU's idle context, which runs on its idle stack (the boot stack on CPU 0)
+ *                whenever no process can run there. Takes work from its own run queue, or steals it from
+ *                another CPU's, under the run queue locks alone; failing both it halts until an interrupt
+ *                (perhaps a reschedule IPI) comes. The kernel lock is only taken once there's a process to
+ *                switch to. Nothing on the idle stack is worth keeping, so it's entered fresh each time and
+ *                never saved. Time spent here is counted by sched_switch (idle_us) and pit_handler
+ *                (idle_interrupts).
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: never returns
+ *   SIDE EFFECTS: Enables interrupts while halted. Entered holding the kernel lock, which it releases.
+ */
+static void sched_idle() {
+    cpu_t* cpu = this_cpu();
+    ProcessControlBlock* next;
+
+    kernel_unlock();
+    while (1) {
+        cli();
+        if ((next = sched_dequeue(cpu)) != NULL || (next = sched_steal(cpu, 1)) != NULL) {
+            kernel_lock(); // Once it's held, next has been switched out wherever it ran
+            sched_migrate(next, cpu); // No change if it came from this CPU's own queue
+            sched_switch(cpu->idle, next, 0);
+        }
+        asm volatile ("sti; hlt" : : : "memory"); // sti takes effect after hlt starts, so no wakeup is lost
+    }
+}
+
+/*
+ * sched_ap_start
+ *   DESCRIPTION: Joins an application processor to the scheduler: starts its timer interrupt the way
+ *                pit_init did the boot CPU's, then runs its idle context
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: never returns
+ *   SIDE EFFECTS: Called by ap_main holding the kernel lock
+ */
+void sched_ap_start() {
+    cli();
+#ifdef TICKLESS
+    apic_timer_oneshot(PIT_MAX_SHOT_US);
+    this_cpu()->pit_deadline = pit_time_us() + PIT_MAX_SHOT_US;
+#else
+    apic_timer_periodic(SCHED_TICK_US);
+#endif
+    this_cpu()->idle_since = pit_time_us();
+    sched_idle();
+}
+
+/*
+ * sched_switch
+ *   DESCRIPTION: Switches this CPU from the current process to another. The current process's context is
+ *                this function's frame: its EBP goes in schedEBP, and when the process is picked again
+ *                (on whichever CPU) return_to_parent unwinds to here and sched_switch returns to its
+ *                caller. Switching to the idle context starts sched_idle on a fresh frame at the top of
+ *                this CPU's idle stack.
+ *   INPUTS: current - running process
+ *           next - process to run
+ *           save - 0 if the current context is never resumed (halted or idle), so it isn't saved
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Switches page directory and kernel stack. Called with interrupts disabled and the kernel
+ *                 lock held, which passes to next.
+ */
+static void __attribute__((noinline)) sched_switch(ProcessControlBlock* current, ProcessControlBlock* next, int save) {
+    cpu_t* cpu = this_cpu();
+
+    if (save) {
         // Save current EBP
         register uint32_t saved_ebp asm("ebp");
-        current_PCB->schedEBP = (void*)saved_ebp; // Save the current EBP for the current scheduling process
+        current->schedEBP = (void*)saved_ebp; // Save the current EBP for the current scheduling process
+    }
 
-        pdt_entry_page_t new_page;
+    if (next->wakePending) { // First run since a wakeup: that's the wakeup latency
+        uint32_t latency = pit_time_us() - next->wakeTime;
+        if ((int32_t)latency < 0) {
+            latency = 0; // The tick that wrapped the PIT count hasn't been counted yet
+        }
+        next->wakePending = 0;
+        next->wakeups++;
+        next->wakeLatencyTotal += latency;
+        if (latency > next->wakeLatencyMax) {
+            next->wakeLatencyMax = latency;
+        }
+    }
 
-        // Restore parent paging
-        pdt_entry_page_setup(&new_page, top_PCB->processID + 1, 1); // Create entry for 0x02 (zero indexed) 4mb page in user mode (1)
-        pdt[32] = new_page.val; // Restore paging parent into the 32nd (zero indexed) 4mb virtual memory page
-        flush_tlb();// Flushes the Translation Lookaside Buffer (TLB)
+    if (next != cpu->idle) {
+        next->execStart = pit_time_us(); // Charged from here by sched_account
+    }
 
-        // Sets the kernel stack pointer for the task state segment (TSS) to the parent's kernel stack.
-        tss.esp0 = (uint32_t)(BASE_MEM - top_PCB->processID * PCB_MEM); // Adjusts ESP0 for the parent process.
-        tss.ss0 = KERNEL_DS; // Sets the stack segment to the kernel's data segment.
+    // Idle time accounting: the idle context is only ever left through here
+    if (current == cpu->idle) {
+        cpu->idle_us += pit_time_us() - cpu->idle_since;
+    }
 
-        pt_entry_t vidmem_pt;
-        vidmem_pt.p = 1; // present on
-        vidmem_pt.us = 1; // user access enabled
-        vidmem_pt.rw = 1; // read write privlages enabled
+    if (next == cpu->idle) {
+        cpu->idle_since = pit_time_us();
+        // Frame for return_to_parent to pop: EBP, then the return address sched_idle
+        uint32_t* idle_frame = (uint32_t*)KERNEL_STACK_TOP(next);
+        idle_frame[-1] = (uint32_t)sched_idle;
+        idle_frame[-2] = 0;
+        next->schedEBP = &idle_frame[-2];
+        next->lockDepth = 1; // sched_idle starts out holding the lock
+    }
 
-        // Update userspace video memory to display to the correct terminal
-        if(cur_terminal == cur_process) {
-            vidmem_pt.address_31_12 = VID_MEM_PHYSICAL/4096; // 4096 = 4kB
-        } else {
-            vidmem_pt.address_31_12 = VID_MEM_PHYSICAL + cur_process;
-        }
-        pt_vidmap[0] = vidmem_pt.val;
-        flush_tlb();
+    // Switch to the next process's page directory (its vidmap table already tracks the displayed terminal)
+    user_paging_switch(next);
+
+    // Make it this CPU's current process, with the TSS pointing at its kernel stack
+    smp_set_current(next);
+
+    pit_rearm(next); // Deadline for the new situation: a timeslice, or none if next runs alone
+
+    // Context switch to prexisiting thread
+    return_to_parent(next->schedEBP); // Return to the next process with the saved EBP (scheduling)
+}
 
-        send_eoi(0);
-        // Context switch to prexisiting thread
-        return_to_parent(top_PCB->schedEBP); // Return to the parent process with the saved EBP (scheduling)
+/*
+ * pit_handler
+ *   DESCRIPTION: Scheduler interrupt, on each CPU: the periodic tick, or in tickless mode the deadline
+ *                pit_rearm set. Runs the kernel timers that are due, charges the running process
+ *                (sched_account) and switches to the process with the smallest vruntime if that's now
+ *                someone else (which covers any process a timer woke), then sets the next deadline. A CPU
+ *                whose run queue is empty also takes a process from one with two or more waiting.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: May switch processes
+ */
+void pit_handler() {
+    ProcessControlBlock* current_PCB = sched_current();
+    cpu_t* cpu = this_cpu();
+    ProcessControlBlock* stolen;
+    int preempt;
+
+    pit_interrupts++;
+    if (pit_apic_timer) {
+        clock_sync();
+    } else {
+#ifndef TICKLESS
+        clock_fold(pit_count); // A whole period has passed; the PIT has already reloaded itself
+#endif
     }
-    
-    
     send_eoi(0); // Send end of interrupt for the PIT to the pic
+    timer_run(pit_time_us());
+    if (current_PCB == cpu->idle) {
+        idle_interrupts++;
+        pit_rearm(current_PCB);
+        return; // sched_idle picks the next process itself
+    }
+
+    sched_account(current_PCB);
+    sched_update_min(cpu, current_PCB);
+    if (cpu->run_count == 0 && (stolen = sched_steal(cpu, 2)) != NULL) {
+        sched_migrate(stolen, cpu);
+        sched_enqueue_on(cpu, stolen); // Even the load out: two running here, not one here and three there
+    }
+    cpu->need_resched = 0; // Decided here instead
+    spin_lock(&cpu->rq_lock);
+    preempt = cpu->run_count != 0 && sched_before(cpu->run_heap[0], current_PCB);
+    spin_unlock(&cpu->rq_lock);
+    if (preempt) {
+        schedule(); // Someone has had less than their share
+    }
+    pit_rearm(current_PCB);
+}
+
+/*
+ * schedule
+ *   DESCRIPTION: Gives up the CPU. A still runnable current process goes back on this CPU's run queue; a
+ *                blocked one (wait_queue_sleep) stays off it until woken. Runs the runnable process with
+ *                the smallest vruntime, one stolen from another CPU if none is queued here, or the idle
+ *                context if nothing can run. Returns once this process is picked again (or right away if
+ *                it's still the best choice).
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Must be called with interrupts disabled
+ */
+void schedule() {
+    ProcessControlBlock* current_PCB = sched_current();
+    cpu_t* cpu = this_cpu();
+    ProcessControlBlock* next;
+
+    if (current_PCB == cpu->idle) {
+        return; // sched_idle picks the next process itself
+    }
+    sched_account(current_PCB);
+    if (current_PCB->state == PROC_RUNNABLE) {
+        if (cpu->run_count == 0) {
+            return; // Nothing else to run
+        }
+        sched_enqueue_on(cpu, current_PCB);
+    }
+    if ((next = sched_dequeue(cpu)) == NULL && (next = sched_steal(cpu, 1)) != NULL) {
+        sched_migrate(next, cpu);
+    }
+    if (next == current_PCB) {
+        return;
+    }
+    sched_switch(current_PCB, next != NULL ? next : cpu->idle, 1);
+}
+
+/*
+ * sched_wakeup
+ *   DESCRIPTION: Makes a blocked process runnable again, on the CPU it last ran on or an idle one. A long
+ *                sleep doesn't bank CPU time: its vruntime is raised to at most SCHED_SLEEPER_CREDIT behind
+ *                that CPU's min_vruntime, which is still enough for it to run before the CPU-bound
+ *                processes. If it's far enough ahead of the process running there, sched_preempt switches
+ *                to it when the interrupt that woke it (or the reschedule IPI) returns.
+ *   INPUTS: pcb - blocked process
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Records the wakeup time for the latency statistics
+ */
+void sched_wakeup(ProcessControlBlock* pcb) {
+    ProcessControlBlock* running;
+    cpu_t* cpu;
+    uint32_t flags, count;
+
+    cli_and_save(flags);
+    cpu = sched_select_cpu(pcb);
+    if ((int32_t)(pcb->vruntime - (cpu->min_vruntime - SCHED_SLEEPER_CREDIT)) < 0) {
+        pcb->vruntime = cpu->min_vruntime - SCHED_SLEEPER_CREDIT;
+    }
+    pcb->state = PROC_RUNNABLE;
+    pcb->wakeTime = pit_time_us();
+    pcb->wakePending = 1;
+    count = sched_enqueue_on(cpu, pcb);
+    running = cpu->current;
+    if (running != cpu->idle && running->state == PROC_RUNNABLE && !cpu->need_resched &&
+        (int32_t)(running->vruntime - pcb->vruntime) > SCHED_WAKEUP_GRAN_US) {
+        cpu->need_resched = 1;
+        if (count != 1) {
+            sched_kick(cpu); // Not already kicked by sched_enqueue_on
+        }
+    }
+    restore_flags(flags);
+}
+
+/*
+ * sched_preempt
+ *   DESCRIPTION: Acts on a wakeup that should preempt the current process. Called on the way out of the
+ *                keyboard and RTC interrupts and the reschedule IPI, so an interactive process doesn't
+ *                wait for the next tick.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Must be called with interrupts disabled; may switch processes
+ */
+void sched_preempt() {
+    cpu_t* cpu = this_cpu();
+
+    if (cpu->need_resched) {
+        cpu->need_resched = 0;
+        schedule();
+    }
+}
+
+/*
+ * sched_ipi
+ *   DESCRIPTION: Reschedule IPI: another CPU queued a process here. An idle CPU picks it up once its hlt
+ *                returns; a busy one preempts if the wakeup asked for it, and otherwise makes sure the
+ *                current process now has a timeslice.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: May switch processes
+ */
+void sched_ipi() {
+    ProcessControlBlock* current_PCB = sched_current();
+
+    if (current_PCB == this_cpu()->idle) {
+        return;
+    }
+    sched_preempt();
+    pit_rearm(current_PCB);
+}
+
+/*
+ * sched_fork
+ *   DESCRIPTION: Sets up a new process's scheduling state. It inherits its creator's nice value and CPU,
+ *                and starts no earlier than that CPU's min_vruntime, so it can't starve the processes
+ *                already running.
+ *   INPUTS: pcb - new process
+ *           parent - process that executed or forked it, NULL for a base shell
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void sched_fork(ProcessControlBlock* pcb, ProcessControlBlock* parent) {
+    cpu_t* cpu = this_cpu();
+
+    pcb->state = PROC_RUNNABLE;
+    pcb->nice = parent != NULL ? parent->nice : 0;
+    pcb->cpu = cpu->id;
+    pcb->execStart = pit_time_us();
+    pcb->vruntime = cpu->min_vruntime;
+    if (parent != NULL && (int32_t)(parent->vruntime - cpu->min_vruntime) > 0) {
+        pcb->vruntime = parent->vruntime;
+    }
+}
+
+/*
+ * sched_idle_time
+ *   DESCRIPTION: Microseconds the CPUs have spent in their idle contexts since boot, summed, including the
+ *                current idle periods. Wraps like pit_time_us, so only differences are meaningful.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: idle time in microseconds
+ *   SIDE EFFECTS: none
+ */
+uint32_t sched_idle_time() {
+    uint32_t flags;
+    uint32_t total = 0;
+    uint32_t now, i;
+
+    cli_and_save(flags);
+    now = pit_time_us();
+    for (i = 0; i < MAX_CPUS; i++) {
+        if (!cpus[i].started) {
+            continue;
+        }
+        total += cpus[i].idle_us;
+        if (cpus[i].current == cpus[i].idle) {
+            total += now - cpus[i].idle_since;
+        }
+    }
+    restore_flags(flags);
+    return total;
+}
+
+/*
+ * sched_exit
+ *   DESCRIPTION: Leaves a process that has been torn down (a forked child's halt) for the next runnable one
+ *                or the idle context. Its context isn't saved.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: never returns
+ *   SIDE EFFECTS: Must be called with interrupts disabled
+ */
+void sched_exit() {
+    cpu_t* cpu = this_cpu();
+    ProcessControlBlock* next = sched_dequeue(cpu);
+
+    if (next == NULL && (next = sched_steal(cpu, 1)) != NULL) {
+        sched_migrate(next, cpu);
+    }
+    sched_switch(sched_current(), next != NULL ? next : cpu->idle, 0);
 }
 
+/*
+ * get_current_process
+ *   DESCRIPTION: Index of the terminal the running process belongs to, for the per-terminal keyboard
+ *                and RTC state
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: terminal number - 1 (0-2), -1 in an idle/boot context
+ *   SIDE EFFECTS: none
+ */
 int get_current_process() {
-    return cur_process-1;
+    return (int)sched_current()->terminal - 1;
 }
@@ -4,15 +4,43 @@
 #ifndef _PIT_H
 #define _PIT_H
 #define PIT_FREQ 1193182
-#define MAX_THREADS 4
+#define PIT_HZ 100                              // Scheduler ticks per second
+#define PIT_DIVISOR (PIT_FREQ / PIT_HZ)
+#define PIT_KHZ (PIT_FREQ / 1000)               // PIT input clocks per millisecond
+#define TICKLESS                                // One-shot PIT set for the next deadline; comment out for a periodic PIT_HZ tick
+#define PIT_MAX_SHOT_US 50000                   // Longest one-shot countdown (the 16-bit counter allows ~54.9ms)
+#define PIT_MIN_SHOT_US 20                      // Shortest one, for deadlines that have already passed
+#define SCHED_MAX_CHARGE_US 1000000             // Most run time charged at once
+#define SCHED_TICK_US (1000000 / PIT_HZ)        // Timeslice while other processes are waiting
+#define SCHED_SLEEPER_CREDIT SCHED_TICK_US      // How far behind min_vruntime a woken process may start
+#define SCHED_WAKEUP_GRAN_US (SCHED_TICK_US / 2) // Lead a woken process needs to preempt the current one
+#define NICE_MIN (-20)
+#define NICE_MAX 19
+#define NICE_LEVELS (NICE_MAX - NICE_MIN + 1)
+#define NICE_0_WEIGHT 1024
 #define BASE_MEM 0x800000
 #define PCB_MEM 0x2000
 
+struct ProcessControlBlock;
+
 // Desciptions provided in the c file
 
 void pit_init();
 void pit_handler();
+void schedule();
+void sched_init();
+void sched_enqueue(struct ProcessControlBlock* pcb);
+void sched_wakeup(struct ProcessControlBlock* pcb);
+void sched_preempt();
+void sched_ipi();
+void sched_ap_start();
+void sched_fork(struct ProcessControlBlock* pcb, struct ProcessControlBlock* parent);
+uint32_t pit_time_us();
+void pit_deadline_changed();
+uint32_t sched_idle_time();
+void sched_exit();
 
-extern int cur_process;
+extern volatile uint32_t pit_interrupts;
+extern volatile uint32_t idle_interrupts;
 extern int get_current_process();
 #endif
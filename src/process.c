@@ -0,0 +1,142 @@
+#include "process.h"
+#include "frame_alloc.h"
+#include "kmalloc.h"
+#include "lib.h"
+
+ProcessControlBlock** process_table = NULL;   // Indexed by PID, NULL for free PIDs
+uint32_t process_table_size = 0;              // Number of PIDs (including the unused PID 0)
+uint32_t process_count = 0;                   // Live processes
+static uint32_t next_pid = FIRST_AUX_PID;     // Where the search for a free PID resumes
+static ProcessControlBlock* dead_stack = NULL; // Kernel stack of the last halted process, freed once it's off it
+
+/*
+ * process_reap
+ *   DESCRIPTION: Frees the kernel stack a halted process was still running on when it was destroyed.
+ *                Safe as soon as any later process_create/process_destroy runs, since by then execution
+ *                has moved to another stack.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Frees frames
+ */
+static void process_reap() {
+    if (dead_stack != NULL) {
+        frame_free_block((uint32_t)dead_stack, KSTACK_FRAMES);
+        dead_stack = NULL;
+    }
+}
+
+/*
+ * process_table_init
+ *   DESCRIPTION: Sizes the process table by the RAM the frame allocator has (PROC_FRAMES_ESTIMATE frames a
+ *                process, clamped to PROC_TABLE_MIN..PROC_TABLE_MAX) and allocates it. Also clears the PCB
+ *                slot of the boot stack so kernel context is recognized as PID 0 with only the kernel's
+ *                page directory; the scheduler later idles in this context.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Must run after kmalloc_init and before the first execute
+ */
+void process_table_init() {
+    process_table_size = frame_free_count() / PROC_FRAMES_ESTIMATE;
+    if (process_table_size < PROC_TABLE_MIN) {
+        process_table_size = PROC_TABLE_MIN;
+    }
+    if (process_table_size > PROC_TABLE_MAX) {
+        process_table_size = PROC_TABLE_MAX;
+    }
+    process_table = kzalloc(process_table_size * sizeof(ProcessControlBlock*));
+    if (process_table == NULL) {
+        process_table_size = 0;
+    }
+
+    memset(IDLE_PCB, 0, sizeof(ProcessControlBlock)); // Boot context: PID 0
+    IDLE_PCB->pageDirectory = pdt; // Kernel mappings only, for the scheduler's idle context
+}
+
+/*
+ * process_create
+ *   DESCRIPTION: Allocates a PID and an 8kB-aligned kernel stack from the frame allocator, and places a
+ *                zeroed PCB at the base of the stack (where masking ESP finds it). The PID says nothing
+ *                about where the stack or the process's memory live.
+ *   INPUTS: pid - a specific PID to take (the base shells use their terminal number), or -1 for any
+ *                 free PID from FIRST_AUX_PID up
+ *   OUTPUTS: none
+ *   RETURN VALUE: the new PCB, NULL if the table is full, the PID is taken, or memory is exhausted
+ *   SIDE EFFECTS: Adds the process to process_table
+ */
+ProcessControlBlock* process_create(int32_t pid) {
+    uint32_t i;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    process_reap();
+
+    if (pid < 0) {
+        for (i = 0; i < process_table_size - FIRST_AUX_PID; i++) {
+            uint32_t candidate = FIRST_AUX_PID + (next_pid - FIRST_AUX_PID + i) % (process_table_size - FIRST_AUX_PID);
+            if (process_table[candidate] == NULL) {
+                pid = candidate;
+                break;
+            }
+        }
+    }
+    if (pid <= 0 || pid >= process_table_size || process_table[pid] != NULL) {
+        restore_flags(flags);
+        return NULL; // Table full or PID in use
+    }
+
+    ProcessControlBlock* pcb = (ProcessControlBlock*)frame_alloc_block(KSTACK_FRAMES);
+    if (pcb == NULL) {
+        restore_flags(flags);
+        return NULL; // Out of memory
+    }
+
+    memset(pcb, 0, sizeof(ProcessControlBlock));
+    pcb->processID = pid;
+    process_table[pid] = pcb;
+    process_count++;
+    if (pid >= FIRST_AUX_PID) {
+        next_pid = pid + 1 < process_table_size ? pid + 1 : FIRST_AUX_PID;
+    }
+    restore_flags(flags);
+    return pcb;
+}
+
+/*
+ * process_destroy
+ *   DESCRIPTION: Removes a process from the table and frees its kernel stack. The caller is usually the
+ *                process itself (halt), still running on that stack, so the free is deferred until the
+ *                next create/destroy.
+ *   INPUTS: pcb - process to remove; its address space must already be gone (user_paging_destroy)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Frees the PID
+ */
+void process_destroy(ProcessControlBlock* pcb) {
+    uint32_t flags;
+
+    cli_and_save(flags);
+    process_reap();
+    if (pcb->processID > 0 && pcb->processID < process_table_size && process_table[pcb->processID] == pcb) {
+        process_table[pcb->processID] = NULL;
+        process_count--;
+    }
+    dead_stack = pcb;
+    restore_flags(flags);
+}
+
+/*
+ * process_lookup
+ *   DESCRIPTION: Finds the PCB of a PID
+ *   INPUTS: pid - process ID
+ *   OUTPUTS: none
+ *   RETURN VALUE: the PCB, NULL if no such process is running
+ *   SIDE EFFECTS: none
+ */
+ProcessControlBlock* process_lookup(int32_t pid) {
+    if (pid <= 0 || pid >= process_table_size) {
+        return NULL;
+    }
+    return process_table[pid];
+}
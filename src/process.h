@@ -0,0 +1,30 @@
+#ifndef PROCESS_H
+#define PROCESS_H
+
+#include "types.h"
+#include "sys_calls.h"
+#include "pit.h"
+
+#define PROC_FRAMES_ESTIMATE  32                         // 4kB frames budgeted per process when sizing the table
+#define PROC_TABLE_MIN        8                          // Three base shells plus a few programs, whatever the RAM
+#define PROC_TABLE_MAX        (PAGE_SIZE / sizeof(void*)) // The table itself is one page
+#define KSTACK_FRAMES         (PCB_MEM / PAGE_SIZE)      // Frames in one kernel stack (PCB at its base)
+#define FIRST_AUX_PID         (NUM_TERMINALS + 1)        // PIDs 1-3 are the base shells of terminals 1-3
+
+// The boot stack's PCB slot (PID 0): kernel context before the first shell, then the idle context
+#define IDLE_PCB ((ProcessControlBlock*)(BASE_MEM - PCB_MEM))
+
+// Top of the kernel stack that holds a PCB, for tss.esp0
+#define KERNEL_STACK_TOP(pcb) ((uint32_t)(pcb) + PCB_MEM)
+
+extern ProcessControlBlock** process_table;   // Indexed by PID, NULL for free PIDs
+extern uint32_t process_table_size;
+extern uint32_t process_count;
+
+// See c file for descriptions
+void process_table_init();
+ProcessControlBlock* process_create(int32_t pid);
+void process_destroy(ProcessControlBlock* pcb);
+ProcessControlBlock* process_lookup(int32_t pid);
+
+#endif
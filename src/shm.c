@@ -0,0 +1,156 @@
+#include "shm.h"
+#include "paging.h"
+#include "frame_alloc.h"
+#include "kmalloc.h"
+#include "lib.h"
+
+static ShmSegment segments[SHM_MAX_SEGMENTS]; // Indexed by segment ID
+
+/*
+ * shm_find
+ *   DESCRIPTION: Looks a segment up by key
+ *   INPUTS: key - nonzero segment key
+ *   OUTPUTS: none
+ *   RETURN VALUE: the segment ID, -1 if no segment has that key
+ *   SIDE EFFECTS: none
+ */
+int32_t shm_find(uint32_t key) {
+    int32_t id;
+
+    if (key == 0) {
+        return -1;
+    }
+    for (id = 0; id < SHM_MAX_SEGMENTS; id++) {
+        if (segments[id].key == key) {
+            return id;
+        }
+    }
+    return -1;
+}
+
+/*
+ * shm_get
+ *   DESCRIPTION: Returns the segment with a key, creating it with size bytes (rounded up to whole pages) if it
+ *                doesn't exist. No memory is allocated until a page is touched; pages start out zeroed.
+ *   INPUTS: key - nonzero segment key
+ *           size - bytes the caller needs; an existing segment must be at least that big
+ *   OUTPUTS: none
+ *   RETURN VALUE: the segment ID, -1 if size is invalid or too big for an existing segment, or the table is full
+ *   SIDE EFFECTS: May allocate the segment's frame list
+ */
+int32_t shm_get(uint32_t key, uint32_t size) {
+    int32_t id;
+    uint32_t flags;
+
+    if (key == 0 || size == 0 || size > SHM_MAX_PAGES * PAGE_SIZE) {
+        return -1;
+    }
+    cli_and_save(flags);
+    id = shm_find(key);
+    if (id != -1) {
+        restore_flags(flags);
+        return PAGE_ROUND_UP(size) / PAGE_SIZE <= segments[id].pages ? id : -1;
+    }
+
+    for (id = 0; id < SHM_MAX_SEGMENTS; id++) {
+        if (segments[id].key == 0) {
+            break;
+        }
+    }
+    if (id == SHM_MAX_SEGMENTS) {
+        restore_flags(flags);
+        return -1; // Table full
+    }
+    segments[id].pages = PAGE_ROUND_UP(size) / PAGE_SIZE;
+    segments[id].frames = kzalloc(segments[id].pages * sizeof(uint32_t));
+    if (segments[id].frames == NULL) {
+        restore_flags(flags);
+        return -1; // Out of memory
+    }
+    segments[id].key = key;
+    segments[id].attached = 0;
+    restore_flags(flags);
+    return id;
+}
+
+/*
+ * shm_size
+ *   DESCRIPTION: Reports the size of a segment
+ *   INPUTS: id - segment ID
+ *   OUTPUTS: none
+ *   RETURN VALUE: size in bytes (whole pages), 0 for an unused ID
+ *   SIDE EFFECTS: none
+ */
+uint32_t shm_size(int32_t id) {
+    if (id < 0 || id >= SHM_MAX_SEGMENTS || segments[id].key == 0) {
+        return 0;
+    }
+    return segments[id].pages * PAGE_SIZE;
+}
+
+/*
+ * shm_ref
+ *   DESCRIPTION: Counts one more mapping of a segment (an attach, or a fork copying one)
+ *   INPUTS: id - segment ID
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void shm_ref(int32_t id) {
+    if (id >= 0 && id < SHM_MAX_SEGMENTS && segments[id].key != 0) {
+        segments[id].attached++;
+    }
+}
+
+/*
+ * shm_unref
+ *   DESCRIPTION: Drops one mapping of a segment. With the last one the segment is removed and its frames are
+ *                released (processes that still had pages mapped hold their own references).
+ *   INPUTS: id - segment ID
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: May free frames and the key
+ */
+void shm_unref(int32_t id) {
+    uint32_t i;
+    uint32_t flags;
+
+    if (id < 0 || id >= SHM_MAX_SEGMENTS || segments[id].key == 0) {
+        return;
+    }
+    cli_and_save(flags);
+    if (segments[id].attached > 0 && --segments[id].attached == 0) {
+        for (i = 0; i < segments[id].pages; i++) {
+            frame_free(segments[id].frames[i]); // 0 (never touched) is ignored
+        }
+        kfree(segments[id].frames);
+        segments[id].frames = NULL;
+        segments[id].key = 0;
+    }
+    restore_flags(flags);
+}
+
+/*
+ * shm_frame
+ *   DESCRIPTION: Finds the frame behind one page of a segment, allocating and zeroing it on first use. The
+ *                segment keeps that reference; a page table mapping the frame takes one more (frame_share).
+ *   INPUTS: id - segment ID
+ *           page - page index inside the segment
+ *   OUTPUTS: none
+ *   RETURN VALUE: physical address of the frame, 0 if the page is out of range or memory ran out
+ *   SIDE EFFECTS: May allocate a frame
+ */
+uint32_t shm_frame(int32_t id, uint32_t page) {
+    if (id < 0 || id >= SHM_MAX_SEGMENTS || segments[id].key == 0 || page >= segments[id].pages) {
+        return 0;
+    }
+    if (segments[id].frames[page] == 0) {
+        uint32_t frame = frame_alloc();
+        if (frame == 0) {
+            return 0; // Out of physical memory
+        }
+        memset((void*)frame, 0, PAGE_SIZE);
+        segments[id].frames[page] = frame;
+    }
+    return segments[id].frames[page];
+}
@@ -0,0 +1,25 @@
+#ifndef SHM_H
+#define SHM_H
+
+#include "types.h"
+
+#define SHM_MAX_SEGMENTS  16         // Segments that can exist at once
+#define SHM_MAX_PAGES     256        // Largest segment: 1MB of 4kB pages
+
+// A shared memory segment: frames mapped at the same offsets in every process attached to it
+typedef struct ShmSegment {
+    uint32_t key;                    // Name processes agree on, 0 for a free slot
+    uint32_t pages;                  // Size in 4kB pages
+    uint32_t attached;               // Mappings of it in all processes (fork inherits them)
+    uint32_t* frames;                // Frame of each page, 0 until some process touches it (kmalloc'd)
+} ShmSegment;
+
+// See c file for descriptions
+int32_t shm_get(uint32_t key, uint32_t size);
+int32_t shm_find(uint32_t key);
+uint32_t shm_size(int32_t id);
+void shm_ref(int32_t id);
+void shm_unref(int32_t id);
+uint32_t shm_frame(int32_t id, uint32_t page);
+
+#endif
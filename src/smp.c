@@ -0,0 +1,290 @@
+#include "smp.h"
+#include "apic.h"
+#include "pit.h"
+#include "process.h"
+#include "paging.h"
+#include "frame_alloc.h"
+#include "lib.h"
+#include "sys_calls.h"
+
+cpu_t cpus[MAX_CPUS];
+static tss_t ap_tss[MAX_CPUS - 1];    // TSS of CPU n is ap_tss[n - 1]
+
+// The big kernel lock. The kernel was written for one CPU, with interrupts disabled around its critical
+// sections; with more CPUs running, whichever CPU is in the kernel holds this lock, so those sections
+// still never overlap. See kernel_lock.
+static spinlock_t kernel_spinlock = { 0 };
+
+// Handed to ap_start (boot.S) as the APs come up
+volatile uint32_t ap_next_cpu = 1;    // Index the next AP to check in takes
+uint32_t ap_cpu_limit = 1;            // APs that get an index at or past this park
+uint32_t ap_stack_top[MAX_CPUS];      // Top of each AP's idle stack
+
+extern uint8_t ap_trampoline[];
+extern uint8_t ap_trampoline_end[];
+extern uint8_t ap_gdt_desc[];
+
+/*
+ * smp_current_pcb
+ *   DESCRIPTION: Finds the PCB of the running process (or the idle context) by masking ESP. Every kernel
+ *                stack, the idle ones included, has its PCB at its base, so this works on any CPU.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: current PCB
+ *   SIDE EFFECTS: none
+ */
+static ProcessControlBlock* smp_current_pcb() {
+    ProcessControlBlock* current_PCB;
+    asm volatile (
+        "movl %%esp, %%eax\n"       // Move current ESP value to EAX for manipulation
+        "andl $0xFFFFE000, %%eax\n" // Clear the lower 13 bits to align to 8KB boundary
+        "movl %%eax, %0\n"          // Move the modified EAX value to current_pcb
+        : "=r" (current_PCB)
+        :
+        : "eax"
+    );
+    return current_PCB;
+}
+
+/*
+ * this_cpu
+ *   DESCRIPTION: The running CPU's entry in cpus[], from the PCB of whatever it's running
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: this CPU
+ *   SIDE EFFECTS: none
+ */
+cpu_t* this_cpu() {
+    return &cpus[smp_current_pcb()->cpu];
+}
+
+/*
+ * smp_online
+ *   DESCRIPTION: How many CPUs are running the scheduler
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: CPU count, at least 1
+ *   SIDE EFFECTS: none
+ */
+uint32_t smp_online() {
+    uint32_t i, count = 0;
+
+    for (i = 0; i < MAX_CPUS; i++) {
+        if (cpus[i].started) {
+            count++;
+        }
+    }
+    return count;
+}
+
+/*
+ * kernel_lock
+ *   DESCRIPTION: Takes the big kernel lock. Every way into the kernel (interrupts, exceptions, system calls)
+ *                takes it and every way back out releases it. The idle loop only takes it to switch. It
+ *                nests, and the depth is kept in the PCB of the running process so it follows the process
+ *                across context switches, which always happen with the lock held.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Spins, with interrupts disabled, while another CPU holds it
+ */
+void kernel_lock() {
+    ProcessControlBlock* pcb = smp_current_pcb();
+    uint32_t flags;
+
+    cli_and_save(flags);
+    if (pcb->lockDepth++ == 0) {
+        spin_lock(&kernel_spinlock);
+    }
+    restore_flags(flags);
+}
+
+/*
+ * kernel_unlock
+ *   DESCRIPTION: Undoes one kernel_lock, releasing the lock when the outermost one is undone
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void kernel_unlock() {
+    ProcessControlBlock* pcb = smp_current_pcb();
+    uint32_t flags;
+
+    cli_and_save(flags);
+    if (--pcb->lockDepth == 0) {
+        spin_unlock(&kernel_spinlock);
+    }
+    restore_flags(flags);
+}
+
+/*
+ * kernel_lock_release
+ *   DESCRIPTION: Releases the kernel lock outright, for execute: it leaves for user mode from inside a
+ *                system call whose frames, and lock depth, stay behind for halt to return through
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Must be the last thing before the iret, on a stack no other CPU can resume
+ */
+void kernel_lock_release() {
+    spin_unlock(&kernel_spinlock);
+}
+
+/*
+ * smp_set_current
+ *   DESCRIPTION: Makes a process the running one on this CPU: records it in both directions and points
+ *                this CPU's TSS at its kernel stack, for the next interrupt from user mode
+ *   INPUTS: pcb - process about to run (or this CPU's idle context)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Called with interrupts disabled
+ */
+void smp_set_current(ProcessControlBlock* pcb) {
+    cpu_t* cpu = this_cpu();
+
+    cpu->current = pcb;
+    pcb->cpu = cpu->id;
+    cpu->tss->esp0 = KERNEL_STACK_TOP(pcb);
+    cpu->tss->ss0 = KERNEL_DS;
+}
+
+/*
+ * smp_tlb_shootdown
+ *   DESCRIPTION: Makes every other CPU flush its TLB, after a change to page tables that processes running
+ *                there might share (the per-terminal video tables). Doesn't wait: a CPU with interrupts
+ *                off is in the kernel and flushes before it next returns to user mode.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void smp_tlb_shootdown() {
+    if (smp_online() > 1) {
+        apic_broadcast_ipi(APIC_TLB_VECTOR);
+    }
+}
+
+/*
+ * smp_init
+ *   DESCRIPTION: Sets up the boot CPU as CPU 0, running the boot context on the boot stack, enables
+ *                SYSENTER on it, and takes the kernel lock for it; the first execute releases it
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Must run after process_table_init (which clears the boot PCB) and before sched_init
+ */
+void smp_init() {
+    cpu_t* cpu = &cpus[0];
+
+    cpu->id = 0;
+    cpu->tss = &tss;
+    cpu->idle = IDLE_PCB;
+    cpu->current = IDLE_PCB;
+    cpu->started = 1;
+    IDLE_PCB->cpu = 0;
+    sysenter_init(cpu->tss);
+    kernel_lock();
+}
+
+/*
+ * smp_tss_setup
+ *   DESCRIPTION: Fills in an AP's TSS and its GDT descriptor, like entry() does for the boot CPU
+ *   INPUTS: index - CPU index, at least 1
+ *   OUTPUTS: Modifies ap_tss and ap_tss_desc_ptr
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void smp_tss_setup(uint32_t index) {
+    seg_desc_t the_tss_desc;
+    tss_t* cpu_tss = cpus[index].tss;
+
+    the_tss_desc.granularity   = 0x0;
+    the_tss_desc.opsize        = 0x0;
+    the_tss_desc.reserved      = 0x0;
+    the_tss_desc.avail         = 0x0;
+    the_tss_desc.seg_lim_19_16 = TSS_SIZE & 0x000F0000;
+    the_tss_desc.present       = 0x1;
+    the_tss_desc.dpl           = 0x0;
+    the_tss_desc.sys           = 0x0;
+    the_tss_desc.type          = 0x9;
+    the_tss_desc.seg_lim_15_00 = TSS_SIZE & 0x0000FFFF;
+
+    SET_TSS_PARAMS(the_tss_desc, cpu_tss, tss_size);
+    ap_tss_desc_ptr[index - 1] = the_tss_desc;
+
+    cpu_tss->ldt_segment_selector = KERNEL_LDT;
+    cpu_tss->ss0 = KERNEL_DS;
+    cpu_tss->esp0 = KERNEL_STACK_TOP(cpus[index].idle);
+}
+
+/*
+ * smp_start
+ *   DESCRIPTION: Brings up the other CPUs when the APICs are in use: gives each possible AP an idle stack and
+ *                a TSS, copies the startup code below 1MB and sends the startup IPIs, then waits
+ *                AP_START_WAIT_US for them to check in. Each one ends up in its own idle loop (ap_main),
+ *                waiting for the kernel lock, which this CPU holds until the first shell starts.
+ *   INPUTS: none
+ *   OUTPUTS: Prints how many CPUs are online
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Must run after apic_init, pit_init and timer_init
+ */
+void smp_start() {
+    uint32_t i;
+
+    if (!apic_enabled) {
+        return;
+    }
+    cpus[0].apic_id = apic_id();
+
+    for (i = 1; i < MAX_CPUS; i++) {
+        ProcessControlBlock* idle = (ProcessControlBlock*)frame_alloc_block(KSTACK_FRAMES);
+        if (idle == NULL) {
+            break;
+        }
+        memset(idle, 0, sizeof(ProcessControlBlock));
+        idle->pageDirectory = pdt; // Kernel mappings only, like the boot CPU's idle context
+        idle->cpu = i;
+        cpus[i].id = i;
+        cpus[i].idle = idle;
+        cpus[i].current = idle;
+        cpus[i].tss = &ap_tss[i - 1];
+        cpus[i].idle_since = pit_time_us(); // Idle from here on, as far as cpustat is concerned
+        smp_tss_setup(i);
+        ap_stack_top[i] = KERNEL_STACK_TOP(idle);
+    }
+    ap_cpu_limit = i;
+
+    // The APs run the copy with paging off; the kernel only needs the page mapped to write it
+    kernel_map_mmio(AP_TRAMPOLINE, AP_TRAMPOLINE);
+    memcpy((void*)AP_TRAMPOLINE, ap_trampoline, ap_trampoline_end - ap_trampoline);
+    asm volatile ("sgdt (%0)" : : "r" (AP_TRAMPOLINE + (ap_gdt_desc - ap_trampoline)) : "memory");
+
+    apic_start_aps(AP_TRAMPOLINE >> 12);
+    apic_delay_us(AP_START_WAIT_US);
+    printf("%d CPUs online\n", smp_online());
+}
+
+/*
+ * ap_main
+ *   DESCRIPTION: C entry of an application processor, called by ap_start on its idle stack with paging on.
+ *                Enables its local APIC, loads its TSS, enables SYSENTER, checks in, and joins the scheduler
+ *                once it has the kernel lock.
+ *   INPUTS: index - its CPU index
+ *   OUTPUTS: none
+ *   RETURN VALUE: never returns
+ *   SIDE EFFECTS: none
+ */
+void ap_main(uint32_t index) {
+    cpu_t* cpu = &cpus[index];
+
+    apic_init_ap();
+    cpu->apic_id = apic_id();
+    lldt(KERNEL_LDT);
+    ltr(AP_TSS + 8 * (index - 1));
+    sysenter_init(cpu->tss);
+    cpu->started = 1;
+
+    kernel_lock();
+    sched_ap_start();
+}
@@ -0,0 +1,84 @@
+#ifndef SMP_H
+#define SMP_H
+
+#include "types.h"
+#include "x86_desc.h"
+
+#define AP_START_WAIT_US 20000                  // How long smp_start gives the APs to check in
+
+struct ProcessControlBlock;
+
+// A lock for the few moments one CPU needs something to itself; the holder must not sleep
+typedef struct spinlock_t {
+    volatile uint32_t locked;
+} spinlock_t;
+
+// Everything the scheduler keeps per CPU. Only the CPU itself touches its entry, except for the run
+// queue, which others may add to or steal from (under rq_lock, not the kernel lock).
+typedef struct cpu_t {
+    uint32_t id;                               // Index in cpus[]
+    uint32_t apic_id;                          // Local APIC ID, where IPIs for this CPU go
+    volatile uint32_t started;                 // Running the scheduler
+    tss_t* tss;                                // Its TSS (CPU 0 has the boot tss)
+    struct ProcessControlBlock* current;       // Running process, or idle
+    struct ProcessControlBlock* idle;          // Idle context: the PCB at the base of this CPU's idle stack
+    spinlock_t rq_lock;                        // Guards run_heap and run_count; never held with another one
+    struct ProcessControlBlock** run_heap;     // Run queue, a min-heap on vruntime (see pit.c)
+    uint32_t run_count;
+    uint32_t min_vruntime;                     // Never decreases: the smallest vruntime runnable here
+    int need_resched;                          // A wakeup should preempt the current process, see sched_preempt
+    uint32_t idle_us;                          // Microseconds spent in the idle context, up to idle_since
+    uint32_t idle_since;                       // pit_time_us() when the idle context was last entered
+    uint32_t pit_deadline;                     // Tickless: pit_time_us() when this CPU's timer interrupt is due
+} cpu_t;
+
+extern cpu_t cpus[MAX_CPUS];
+
+// See c file for descriptions
+void smp_init();
+void smp_start();
+cpu_t* this_cpu();
+uint32_t smp_online();
+void smp_set_current(struct ProcessControlBlock* pcb);
+void smp_tlb_shootdown();
+void kernel_lock();
+void kernel_unlock();
+void kernel_lock_release();
+void ap_main(uint32_t index);
+
+/*
+ * spin_lock
+ *   DESCRIPTION: Takes a spinlock, waiting with plain reads (and pause) until it looks free so the waiting
+ *                CPUs don't keep stealing the cache line from the holder
+ *   INPUTS: lock - lock to take
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Spins
+ */
+static inline void spin_lock(spinlock_t* lock) {
+    uint32_t taken;
+
+    do {
+        while (lock->locked) {
+            asm volatile ("pause");
+        }
+        taken = 1;
+        asm volatile ("xchgl %0, %1" : "+r" (taken), "+m" (lock->locked) : : "memory");
+    } while (taken != 0);
+}
+
+/*
+ * spin_unlock
+ *   DESCRIPTION: Releases a spinlock. A plain store is enough on x86: it isn't reordered with the holder's
+ *                earlier loads and stores.
+ *   INPUTS: lock - lock held by this CPU
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static inline void spin_unlock(spinlock_t* lock) {
+    asm volatile ("" : : : "memory");
+    lock->locked = 0;
+}
+
+#endif
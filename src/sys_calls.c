@@ -1,12 +1,13 @@
 #include "sys_calls.h"
 #include "pit.h"
+#include "process.h"
+#include "shm.h"
+#include "timer.h"
+#include "smp.h"
 
-// The currently active process control block index, initially 0
-int aux_processes = 0; // Number of non base shell active processes
 uint8_t base_shell_live_bitmask = 0x00; // Representing shells currently open, Shell 3 | Shell 2 | Shell 1 (LSB)
 uint8_t base_shell_booted_bitmask = 0x00; // Representing shells currently booted, Shell 3 | Shell 2 | Shell 1 (LSB) 
 int shell_init_boot = 1; // Global variable used to boot the correct shell
-uint8_t active_processes[6]; // Array to store the active processes
 
 /*
  * Halts a process and handles the termination or switching to another process.
@@ -47,29 +48,35 @@ int32_t halt(uint32_t status) {
     // Set the exit status in the PCB
     current_pcb->exitStatus = status;
 
+    // A forked process has no parent waiting on it: tear it down and run whatever is next
+    if (current_pcb->forked) {
+        user_paging_switch(IDLE_PCB); // Kernel-only directory, so this one can be freed
+        user_paging_destroy(current_pcb);
+        process_destroy(current_pcb); // Free the PID; the kernel stack we're still on is freed later
+        sched_exit();
+    }
+
     // Special handling for when the shell (process ID 1) is halted.
     if (current_pcb->processID >= 1 && current_pcb->processID <= 3) {
         // If the current process is the shell, restart the shell
         base_shell_live_bitmask &= ~(1 << (current_pcb->processID - 1));
         execute((uint8_t*)"shell");
     } else {
-        pdt_entry_page_t new_page;
         // If the current process ics not the shell, return to the parent process
-        // Restore parent paging
-        
-        pdt_entry_page_setup(&new_page, ((ProcessControlBlock*)current_pcb->parentPCB)->processID + 1, 1); // Create entry for 0x02 (zero indexed) 4mb page in user mode (1)
-        pdt[32] = new_page.val; // Restore paging parent into the 32nd (zero indexed) 4mb virtual memory page
-        flush_tlb();// Flushes the Translation Lookaside Buffer (TLB)
-
-        // Sets the kernel stack pointer for the task state segment (TSS) to the parent's kernel stack.
-        // The calculation for esp0 adjusts the stack pointer based on the process ID, ensuring each process has a unique kernel stack in memory.
-        // The magic number 0x800000 represents the start of kernel memory, and 0x2000 (8KB) is the size allocated for each process's kernel stack.
-        tss.esp0 = (uint32_t)(BASE_MEM - (((ProcessControlBlock*)current_pcb->parentPCB)->processID) * PCB_MEM); // Adjusts ESP0 for the parent process.
-        tss.ss0 = KERNEL_DS; // Sets the stack segment to the kernel's data segment.
+        ProcessControlBlock* parent_pcb = (ProcessControlBlock*)current_pcb->parentPCB;
+        // Restore parent paging, then free this process's address space now that it's no longer loaded
+        user_paging_switch(parent_pcb);
+        user_paging_destroy(current_pcb);
+
+        // The parent runs on this CPU now (it may have last run on another), with this CPU's TSS pointing
+        // at its kernel stack. The PCB sits at the base of its 8KB (0x2000) kernel stack.
+        smp_set_current(parent_pcb);
         // Restore parent process control block
-        active_processes[(int)((int)((ProcessControlBlock*)current_pcb->processID) - 1)] = 0; // Set the process as inactive
-        aux_processes--; // Decrement the active process count to reflect the process termination.
-        ((ProcessControlBlock*)current_pcb->parentPCB)->childPCB = 0;
+        parent_pcb->childPCB = 0;
+        parent_pcb->state = PROC_RUNNABLE; // The parent takes over this process's turn on the CPU
+        parent_pcb->vruntime = current_pcb->vruntime; // and the CPU time it used, so a chain is one fair share
+        parent_pcb->execStart = current_pcb->execStart;
+        process_destroy(current_pcb); // Free the PID; the kernel stack we're still on is freed later
     }
     
     uint32_t parent_ebp = (uint32_t)((ProcessControlBlock*)current_pcb->parentPCB)->EBP;// Retrieves the saved Base Pointer (EBP) of the parent process.
@@ -83,7 +90,9 @@ FileOperationsTable dir_operations_table = {
     .read = dir_read,
     .write = dir_write,
     .open = dir_open,
-    .close = dir_close
+    .close = dir_close,
+    .seek = dir_seek,
+    .pread = NULL
 };
 
 // Global definition of file operation function pointers for regular files.
@@ -91,7 +100,9 @@ FileOperationsTable file_operations_table = {
     .read = file_read,
     .write = file_write,
     .open = file_open,
-    .close = file_close
+    .close = file_close,
+    .seek = file_seek,
+    .pread = file_pread
 };
 
 // Definition of stdout file descriptor.
@@ -129,6 +140,60 @@ FileOperationsTable rtc_operations_table = {
 };
 
 
+/*
+ * Reads the program headers of an image to lay out its address space:
+ *  - text_end: where execute-in-place mapping has to stop, the first page touched by a writable PT_LOAD
+ *    segment (data/bss) or the last whole page of the file, whichever comes first. Pages below this
+ *    address hold only read-only text and can be mapped straight from the file system.
+ *  - image_end: the end of the last PT_LOAD segment including its bss (at least the end of the file),
+ *    rounded up to a page. This is the initial program break.
+ *
+ * Inputs: inode - inode of the program image
+ *         image_size - size of the program image in bytes
+ *         text_end, image_end - filled in as described above (page aligned virtual addresses)
+ * Returns: None.
+ * Side Effects: None.
+ */
+static void elf_layout(uint32_t inode, uint32_t image_size, uint32_t* text_end, uint32_t* image_end) {
+    uint32_t phoff;
+    uint16_t phentsize, phnum;
+    uint32_t phdr[ELF_PHDR_WORDS];
+    int i;
+
+    *text_end = PROGRAM_START + image_size;
+    *image_end = PROGRAM_START + image_size;
+
+    if (read_data(inode, ELF_PHOFF_OFFSET, (uint8_t*)&phoff, 4) != 4 ||
+        read_data(inode, ELF_PHENTSIZE_OFFSET, (uint8_t*)&phentsize, 2) != 2 ||
+        read_data(inode, ELF_PHNUM_OFFSET, (uint8_t*)&phnum, 2) != 2) {
+        phnum = 0;
+        *text_end = PROGRAM_START; // Malformed header: copy every page
+    }
+
+    for (i = 0; i < phnum; i++) {
+        if (read_data(inode, phoff + i * phentsize, (uint8_t*)phdr, sizeof(phdr)) != sizeof(phdr)) {
+            *text_end = PROGRAM_START;
+            break;
+        }
+        if (phdr[ELF_P_TYPE] != ELF_PT_LOAD) {
+            continue;
+        }
+        // Only the virtual addresses are used; elfconvert flattens the file so offset == vaddr - PROGRAM_START
+        if ((phdr[ELF_P_FLAGS] & ELF_PF_W) && phdr[ELF_P_VADDR] < *text_end) {
+            *text_end = phdr[ELF_P_VADDR];
+        }
+        if (phdr[ELF_P_VADDR] + phdr[ELF_P_MEMSZ] > *image_end) {
+            *image_end = phdr[ELF_P_VADDR] + phdr[ELF_P_MEMSZ];
+        }
+    }
+
+    *text_end &= ~(PAGE_SIZE - 1); // Round down so a page shared with data is copied
+    if (*image_end > USER_STACK - USER_STACK_SIZE) {
+        *image_end = USER_STACK - USER_STACK_SIZE; // Bogus segment sizes: leave no room for a heap
+    }
+    *image_end = PAGE_ROUND_UP(*image_end);
+}
+
 /*
  * Attempts to load and execute a new program, replacing the current executing program.
  *
@@ -184,8 +249,8 @@ int32_t execute(const uint8_t* command_user) {
         RETURN(-1); // Return command not found
     }
 
-    int next_pid;
-    uint8_t shell_to_reboot;
+    int next_pid = -1; // Any free PID unless a base shell is (re)booting
+    uint8_t shell_to_reboot = 0;
     int base_boot = 0; // If this is the first process in a thread
 
     // If process getting booted is a shell...
@@ -194,12 +259,6 @@ int32_t execute(const uint8_t* command_user) {
             // Initially booting up a shell
             next_pid = shell_init_boot;
             base_boot = 1;
-            
-            active_processes[shell_init_boot - 1] = 1; // Set the shell as an active process
-            base_shell_booted_bitmask |= 1 << (shell_init_boot - 1); // Update the new shell on the booted shell mask
-            base_shell_live_bitmask = base_shell_booted_bitmask;
-
-            shell_init_boot = 0; // Set the initial boot flag to none
         } else if((shell_to_reboot = (base_shell_booted_bitmask ^ base_shell_live_bitmask)) != 0) {
             // If a base shell is open but not alive (rebooting)
             if(shell_to_reboot == 1) {
@@ -209,69 +268,52 @@ int32_t execute(const uint8_t* command_user) {
             } else if(shell_to_reboot == 4) {
                 next_pid = 3;
             }
-            base_shell_live_bitmask = base_shell_booted_bitmask; // Updated the live shells to accont for rebooted shell
             base_boot = 1;
-        } else {
-            // Secondary shell process is started
-            int i;
-            for(i = 3; i < 6; i++) { // Loop through the active ( non base shell) processes to find an available PID
-                if(active_processes[i] == 0) {
-                    next_pid = i; // Set the next PID to the available PID
-                    active_processes[i] = 1; // Set the shell process as active
-                    break;
-                }
-            }
-
-            next_pid++;
-            aux_processes++;
-        }
-    } else {
-        // Secondary non-shell process has started
-        // Secondary shell process is started
-        int i;
-        for(i = 3; i < 6; i++) { // Loop through the active ( non base shell) processes to find an available PID
-            if(active_processes[i] == 0) { // Check if the process is active
-                next_pid = i; // Set the next PID to the available PID
-                active_processes[i] = 1; // Set the non shell process as active
-                break;
-            }
         }
+    }
 
-        next_pid++; // Increment the PID
-        aux_processes++; // Increment the number of active ( non base shell) processes
+    // A rebooting base shell keeps its PCB and kernel stack (halt is still running on it); everything
+    // else gets a fresh PID and kernel stack from the process table
+    ProcessControlBlock* new_PCB = base_boot ? process_lookup(next_pid) : NULL;
+    if (new_PCB == NULL) {
+        new_PCB = process_create(next_pid);
     }
-    
-    if(aux_processes > 3) { // Limit the number of processes running to 6 ( including 3 base shell)
-        aux_processes--; // Decrement the number of active (non base shell) processes
+    if (new_PCB == NULL) { // Process table full or out of memory
         terminal_write(1, "Max number of processes reached!\n", 33); // Write to terminal
         RETURN(1);
     }
 
-    pdt_entry_page_t new_page;
-
-    pdt_entry_page_setup(&new_page, next_pid + 1, 1); // Get page directory entry for 0x2 4mb page (zero-idxed) with user permissions (1)
-    // Update virtual memory address 128mb (32nd 4mb page - zero indexed)
-    pdt[32] = new_page.val;
-    flush_tlb(); // Flush the TLB
-
-    tss.esp0 = 0x800000 - next_pid * 0x2000; // Update the new stack pointer ESP_new = 8MB - PID * 8KB (0x2000)
-    // Maybe update tss.ebp
+    // Give the process an empty user program window (virtual 128mb); pages are loaded on first touch
+    if (user_paging_setup(new_PCB) == -1) {
+        process_destroy(new_PCB);
+        terminal_write(1, "Max number of processes reached!\n", 33); // Write to terminal
+        RETURN(1);
+    }
 
-    // Load the file into the correct memory location
-    uint32_t file_length = ((inode_t*)(&g_inodes[cur_dentry.inode_num]))->size;
-    // Load the file into the correct memory location
-    read_data(cur_dentry.inode_num, 0, (uint8_t*)PROGRAM_START, file_length);
+    if(shell_init_boot != 0 && base_boot) {
+        base_shell_booted_bitmask |= 1 << (shell_init_boot - 1); // Update the new shell on the booted shell mask
+        base_shell_live_bitmask = base_shell_booted_bitmask;
+        shell_init_boot = 0; // Set the initial boot flag to none
+    } else if(base_boot) {
+        base_shell_live_bitmask = base_shell_booted_bitmask; // Updated the live shells to accont for rebooted shell
+    }
 
-    // Create PCB at top of new process kernal stack
-    ProcessControlBlock* new_PCB = (void*)(BASE_MEM - (next_pid + 1) * PCB_MEM); // Update the new PCB pointer - new_PCB = 8MB - (PID + 1) * 8KB (0x2000)
-    new_PCB->processID = next_pid;
+    // Fill in the PCB at the base of the new process's kernel stack
     new_PCB->exitStatus = 0;
+    // Record the program image so page_fault_handler can load it page by page
+    new_PCB->imageInode = cur_dentry.inode_num;
+    new_PCB->imageSize = g_inodes[cur_dentry.inode_num].size;
+    elf_layout(cur_dentry.inode_num, new_PCB->imageSize, &new_PCB->textEnd, &new_PCB->heapStart);
+    new_PCB->brk = new_PCB->heapStart; // Empty heap; user_paging_setup already dropped any old mappings
     strcpy((int8_t*)new_PCB->name, (int8_t*)file_name);
-    new_PCB->parentPCB = base_boot ? 0 : (ProcessControlBlock*)(BASE_MEM - (current_PCB->processID + 1) * PCB_MEM); // Update the new PCB parent pointer - new_PCB = 8MB - (parent PID + 1) * 8KB (0x2000)
+    new_PCB->parentPCB = base_boot ? 0 : current_PCB;
     new_PCB->childPCB = (ProcessControlBlock*)0;
+    sched_fork(new_PCB, base_boot ? NULL : current_PCB);
+    new_PCB->terminal = base_boot ? next_pid : current_PCB->terminal; // Base shell PID = terminal number
     // If this is not the first process, update teh parent PCB to point to the child PCB
     if(!base_boot) {
         current_PCB->childPCB = (ProcessControlBlock*)new_PCB;
+        current_PCB->state = PROC_BLOCKED; // Off the CPU until the child halts; the child runs in its place
     }
 
     // Add stdin and stdout to the file descriptor array
@@ -308,29 +350,31 @@ int32_t execute(const uint8_t* command_user) {
     uint32_t eip = 0 | (uint32_t)file_metadata[27] << 24 | (uint32_t)file_metadata[26] << 16 | (uint32_t)file_metadata[25] << 8 | (uint32_t)file_metadata[24];
     // Shifts bytes of the ESP from file approriate amount to form file EIP.
 
-    // Context switch
+    // Save the current EBP in the PCB for later return in halt
+    register uint32_t saved_ebp asm("ebp");
+    current_PCB->EBP = (void*)saved_ebp;
+
+    // The new process runs on this CPU, entering the kernel on its own stack (the new process's kernel
+    // stack starts just above its 8KB block)
+    new_PCB->lockDepth = 0;
+    smp_set_current(new_PCB);
+    uint32_t kernel_stack = KERNEL_STACK_TOP(new_PCB);
+
+    // Context switch. The iret frame is built on the new process's kernel stack, which is empty while it's
+    // in user mode: once the kernel lock is released another CPU may resume a process on this stack
+    // (the keyboard's shell boot queued the one it interrupted).
     asm volatile (
+        "movl %5, %%esp\n" // Switch to the new kernel stack
         "push %0\n"       // Push SS
         "push %1\n"       // Push ESP
         "push %2\n"       // Push EFLAGS
         "push %3\n"       // Push CS
         "push %4\n"       // Push EIP
-
-        // put esp in kernalStackTop
-        // put eip in execReturnAddr
-
-        : 
-        : "r" (ss), "r" (esp), "r" (eflags), "r" (cs), "r" (eip)
-        : "memory"
-    );
-
-    // Save the current EBP in the PCB for later return in halt
-    register uint32_t saved_ebp asm("ebp");
-    current_PCB->EBP = (void*)saved_ebp;
-    
-
-    asm volatile (
+        "call kernel_lock_release\n"
         "iret\n"          // Return from interrupt
+        :
+        : "r" (ss), "r" (esp), "r" (eflags), "r" (cs), "r" (eip), "m" (kernel_stack)
+        : "memory"
     );
 
     RETURN(0); // Never reached
@@ -547,7 +591,7 @@ int32_t getargs(uint8_t* buf, int32_t nbytes) {
  *  DESCRIPTION: maps the text-mode video memory into user space at a pre-set virtual address
  *  INPUTS: screen_start - double pointer to user video memory (start)
  *  RETURN VALUE: -1 if invalid screen_start, 0 if successfully mapped
- *  SIDE EFFECTS: changes PDT and Page table for vid map (more of an effect than a side effect)
+ *  SIDE EFFECTS: maps the terminal's video page table in the process's page directory
  */
 int32_t vidmap(uint8_t** screen_start) {
     ProcessControlBlock* current_pcb;
@@ -560,8 +604,6 @@ int32_t vidmap(uint8_t** screen_start) {
         : "eax"                      // Clobber list, indicating EAX is modified
     );
 
-    int cur_process_local = get_base_process_pcb(current_pcb)->processID;
-
     // Step 1: Bound checks
     uint32_t vid_addr = (uint32_t)screen_start;
     if (screen_start == NULL) { // invalid screen start
@@ -574,29 +616,10 @@ int32_t vidmap(uint8_t** screen_start) {
     }
 
     // Step 2: Paging setup
+    // Map the terminal's video page table into this process's page directory (flushes the TLB)
+    user_paging_vidmap(current_pcb, current_pcb->terminal);
 
-    // Update PDT
-    pdt_entry_table_t vidmem;
-    vidmem.p = 1; // present
-    vidmem.us = 1; // user
-    vidmem.rw = 1;
-    vidmem.address = ((int)pt_vidmap)/4096; // 4096 = 4kB; pt_vidmap is paging table for user space video memory
-    pdt[VID_PDT_IDX] = vidmem.val;
-
-    // Update Paging table for user space video memory
-    pt_entry_t vidmem_pt;
-    vidmem_pt.p = 1; // present
-    vidmem_pt.us = 1; // user
-    vidmem_pt.rw = 1;
-    if(cur_terminal == cur_process_local) {
-        vidmem_pt.address_31_12 = VID_MEM_PHYSICAL/4096; // 4096 = 4kB
-    } else {
-        vidmem_pt.address_31_12 = VID_MEM_PHYSICAL/4096 + cur_process_local;
-    }
-    pt_vidmap[0] = vidmem_pt.val;
-
-    // Step 3: Flush TLB, update screen start and return
-    flush_tlb(); // Updated tables so flush Translation Lookaside Buffer
+    // Step 3: Update screen start and return
     *screen_start = (uint8_t*)VID_MEM; // Update screen start to start of (user-space) video memory
 
     RETURN(0);
@@ -615,16 +638,770 @@ int32_t sigreturn(void) {
 
 
 
-// Syscall helpers
+/*
+ * int32_t getdents(int32_t fd, void* buf, int32_t nbytes)
+ *  DESCRIPTION: batched directory listing; fills buf with as many packed dirent_t records
+ *               (name, file type, inode, size) as fit, continuing from the directory fd's position
+ *  INPUTS: fd - file descriptor of an open directory, buf - user buffer, nbytes - size of buf
+ *  RETURN VALUE: number of bytes of records written, 0 at the end of the directory, -1 on error
+ *  SIDE EFFECTS: advances the directory fd's position
+ */
+int32_t getdents(int32_t fd, void* buf, int32_t nbytes) {
+    if (fd < 2 || fd > 7 || !buf || nbytes < 0) {
+        RETURN(-1); // Return error
+    }
 
-ProcessControlBlock* get_top_process_pcb(ProcessControlBlock* starting_pcb) {
-    while(starting_pcb->childPCB != 0) {
-        starting_pcb = starting_pcb->childPCB;
+    ProcessControlBlock* current_pcb;
+    // Assembly code to get the current PCB
+    // Clear the lower 13 bits then AND with ESP to align it to the 8KB boundary
+    asm volatile (
+        "movl %%esp, %%eax\n"       // Move current ESP value to EAX for manipulation
+        "andl $0xFFFFE000, %%eax\n" // Clear the lower 13 bits to align to 8KB boundary
+        "movl %%eax, %0\n"          // Move the modified EAX value to current_pcb
+        : "=r" (current_pcb)        // Output operands
+        :                            // No input operands
+        : "eax"                      // Clobber list, indicating EAX is modified
+    );
+
+    // Only directory file descriptors can be listed
+    if (current_pcb->files[fd].flags == 0 || current_pcb->files[fd].operationsTable.read != dir_read) {
+        RETURN(-1); // Return error
     }
 
-    return starting_pcb;
+    int bytes = dir_read_records(&current_pcb->files[fd].filePosition, (dirent_t*)buf, nbytes);
+
+    RETURN(bytes); // Return the number of bytes of records written
+
+    return 0;
+}
+
+/*
+ * int32_t lseek(int32_t fd, int32_t offset, int32_t whence)
+ *  DESCRIPTION: moves the position the next read of fd starts at
+ *  INPUTS: fd - open file descriptor, offset - signed distance, whence - SEEK_SET, SEEK_CUR or SEEK_END
+ *  RETURN VALUE: the new position, -1 if fd is invalid or can't seek (terminal, RTC)
+ *  SIDE EFFECTS: changes the fd's position
+ */
+int32_t lseek(int32_t fd, int32_t offset, int32_t whence) {
+    if (fd < 0 || fd > 7) {
+        RETURN(-1); // Return error
+    }
+
+    ProcessControlBlock* current_pcb;
+    // Assembly code to get the current PCB
+    // Clear the lower 13 bits then AND with ESP to align it to the 8KB boundary
+    asm volatile (
+        "movl %%esp, %%eax\n"       // Move current ESP value to EAX for manipulation
+        "andl $0xFFFFE000, %%eax\n" // Clear the lower 13 bits to align to 8KB boundary
+        "movl %%eax, %0\n"          // Move the modified EAX value to current_pcb
+        : "=r" (current_pcb)        // Output operands
+        :                            // No input operands
+        : "eax"                      // Clobber list, indicating EAX is modified
+    );
+
+    if (current_pcb->files[fd].flags == 0 || current_pcb->files[fd].operationsTable.seek == NULL) {
+        RETURN(-1); // Return error
+    }
+    int position = current_pcb->files[fd].operationsTable.seek(fd, offset, whence);
+
+    RETURN(position); // Return the new position
+
+    return 0;
+}
+
+/*
+ * int32_t pread(int32_t fd, void* buf, int32_t nbytes, uint32_t offset)
+ *  DESCRIPTION: reads from offset in a file without using or moving the fd's position
+ *  INPUTS: fd - open file descriptor, buf - buffer to fill, nbytes - bytes to read, offset - byte offset to read at
+ *  RETURN VALUE: number of bytes read, 0 past the end, -1 if fd is invalid or has no position (terminal, RTC)
+ *  SIDE EFFECTS: NONE
+ */
+int32_t pread(int32_t fd, void* buf, int32_t nbytes, uint32_t offset) {
+    if (fd < 0 || fd > 7 || !buf || nbytes < 0) {
+        RETURN(-1); // Return error
+    }
+
+    ProcessControlBlock* current_pcb;
+    // Assembly code to get the current PCB
+    // Clear the lower 13 bits then AND with ESP to align it to the 8KB boundary
+    asm volatile (
+        "movl %%esp, %%eax\n"       // Move current ESP value to EAX for manipulation
+        "andl $0xFFFFE000, %%eax\n" // Clear the lower 13 bits to align to 8KB boundary
+        "movl %%eax, %0\n"          // Move the modified EAX value to current_pcb
+        : "=r" (current_pcb)        // Output operands
+        :                            // No input operands
+        : "eax"                      // Clobber list, indicating EAX is modified
+    );
+
+    if (current_pcb->files[fd].flags == 0 || current_pcb->files[fd].operationsTable.pread == NULL) {
+        RETURN(-1); // Return error
+    }
+    int bytes = current_pcb->files[fd].operationsTable.pread(fd, buf, nbytes, offset);
+
+    RETURN(bytes); // Return the number of bytes read
+
+    return 0;
 }
 
+/*
+ * int32_t readv(int32_t fd, const void* iov, int32_t iovcnt)
+ *  DESCRIPTION: reads into iovcnt buffers in order with one trap; stops early on a short read
+ *               (end of file, or the end of a terminal line)
+ *  INPUTS: fd - open file descriptor, iov - array of IOVector, iovcnt - number of entries (1 to IOV_MAX)
+ *  RETURN VALUE: total number of bytes read, -1 if the arguments are invalid or the first read fails
+ *  SIDE EFFECTS: advances the fd's position like read
+ */
+int32_t readv(int32_t fd, const void* iov, int32_t iovcnt) {
+    const IOVector* vec = (const IOVector*)iov;
+    if (fd < 0 || fd > 7 || !vec || iovcnt < 1 || iovcnt > IOV_MAX) {
+        RETURN(-1); // Return error
+    }
+
+    ProcessControlBlock* current_pcb;
+    // Assembly code to get the current PCB
+    // Clear the lower 13 bits then AND with ESP to align it to the 8KB boundary
+    asm volatile (
+        "movl %%esp, %%eax\n"       // Move current ESP value to EAX for manipulation
+        "andl $0xFFFFE000, %%eax\n" // Clear the lower 13 bits to align to 8KB boundary
+        "movl %%eax, %0\n"          // Move the modified EAX value to current_pcb
+        : "=r" (current_pcb)        // Output operands
+        :                            // No input operands
+        : "eax"                      // Clobber list, indicating EAX is modified
+    );
+
+    if (current_pcb->files[fd].flags == 0 || current_pcb->files[fd].operationsTable.read == NULL) {
+        RETURN(-1); // Return error
+    }
+
+    int total = 0;
+    int i;
+    for (i = 0; i < iovcnt; i++) {
+        if (!vec[i].base || vec[i].length < 0) {
+            break;
+        }
+        int bytes = current_pcb->files[fd].operationsTable.read(fd, vec[i].base, vec[i].length);
+        if (bytes < 0) {
+            if (total == 0) {
+                total = -1; // Nothing was read, report the error
+            }
+            break;
+        }
+        total += bytes;
+        if (bytes < vec[i].length) { // Short read, the next buffer would get nothing
+            break;
+        }
+    }
+
+    RETURN(total); // Return the number of bytes read
+
+    return 0;
+}
+
+/*
+ * int32_t writev(int32_t fd, const void* iov, int32_t iovcnt)
+ *  DESCRIPTION: writes iovcnt buffers in order with one trap
+ *  INPUTS: fd - open file descriptor, iov - array of IOVector, iovcnt - number of entries (1 to IOV_MAX)
+ *  RETURN VALUE: total number of bytes written, -1 if the arguments are invalid or the first write fails
+ *  SIDE EFFECTS: Prints to terminal for stdout
+ */
+int32_t writev(int32_t fd, const void* iov, int32_t iovcnt) {
+    const IOVector* vec = (const IOVector*)iov;
+    if (fd < 0 || fd > 7 || !vec || iovcnt < 1 || iovcnt > IOV_MAX) {
+        RETURN(-1); // Return error
+    }
+
+    ProcessControlBlock* current_pcb;
+    asm volatile (
+        "movl %%esp, %%eax\n"       // Move current ESP value to EAX for manipulation
+        "andl $0xFFFFE000, %%eax\n" // Clear the lower 13 bits to align to 8KB boundary
+        "movl %%eax, %0\n"          // Move the modified EAX value to current_pcb
+        : "=r" (current_pcb)        // Output operands
+        :                            // No input operands
+        : "eax"                      // Clobber list, indicating EAX is modified
+    );
+
+    if (current_pcb->files[fd].flags == 0 || current_pcb->files[fd].operationsTable.write == NULL) {
+        RETURN(-1); // Return error
+    }
+
+    int total = 0;
+    int i;
+    for (i = 0; i < iovcnt; i++) {
+        if (!vec[i].base || vec[i].length < 0) {
+            break;
+        }
+        int bytes = current_pcb->files[fd].operationsTable.write(fd, vec[i].base, vec[i].length);
+        if (bytes < 0) {
+            if (total == 0) {
+                total = -1; // Nothing was written, report the error
+            }
+            break;
+        }
+        total += bytes;
+    }
+
+    RETURN(total); // Return the number of bytes written
+
+    return 0;
+}
+
+/*
+ * int32_t sendfile(int32_t out_fd, int32_t in_fd, int32_t count)
+ *  DESCRIPTION: copies up to count bytes from the position of regular file in_fd to out_fd (e.g. stdout)
+ *               without a round trip through a user buffer
+ *  INPUTS: out_fd - writable file descriptor, in_fd - open regular file, count - maximum bytes to copy
+ *  RETURN VALUE: number of bytes copied, 0 at the end of the file, -1 on error
+ *  SIDE EFFECTS: advances in_fd's position, prints to terminal for stdout
+ */
+int32_t sendfile(int32_t out_fd, int32_t in_fd, int32_t count) {
+    if (out_fd < 0 || out_fd > 7 || in_fd < 2 || in_fd > 7 || count < 0) {
+        RETURN(-1); // Return error
+    }
+
+    ProcessControlBlock* current_pcb;
+    // Assembly code to get the current PCB
+    // Clear the lower 13 bits then AND with ESP to align it to the 8KB boundary
+    asm volatile (
+        "movl %%esp, %%eax\n"       // Move current ESP value to EAX for manipulation
+        "andl $0xFFFFE000, %%eax\n" // Clear the lower 13 bits to align to 8KB boundary
+        "movl %%eax, %0\n"          // Move the modified EAX value to current_pcb
+        : "=r" (current_pcb)        // Output operands
+        :                            // No input operands
+        : "eax"                      // Clobber list, indicating EAX is modified
+    );
+
+    FileDescriptor* in = &current_pcb->files[in_fd];
+    FileDescriptor* out = &current_pcb->files[out_fd];
+    // Source must be a regular file, whose data lives in the file system image
+    if (in->flags == 0 || in->operationsTable.read != file_read || out->flags == 0 || out->operationsTable.write == NULL) {
+        RETURN(-1); // Return error
+    }
+
+    int bytes = send_data(in->inode, &in->filePosition, count, out_fd, out->operationsTable.write);
+
+    RETURN(bytes); // Return the number of bytes copied
+
+    return 0;
+}
+
+/*
+ * int32_t sbrk(int32_t increment)
+ *  DESCRIPTION: moves the program break (the end of the heap) by increment bytes. Growing only moves the
+ *               break: pages are zero filled by the page fault handler the first time they're touched.
+ *               Shrinking gives the pages above the new break back.
+ *  INPUTS: increment - bytes to grow (positive) or shrink (negative) the heap by, 0 to read the break
+ *  RETURN VALUE: the previous break (the start of the new memory), -1 if the heap would run into the
+ *                stack or shrink below its start
+ *  SIDE EFFECTS: may free frames
+ */
+int32_t sbrk(int32_t increment) {
+    ProcessControlBlock* current_pcb;
+    // Assembly code to get the current PCB
+    // Clear the lower 13 bits then AND with ESP to align it to the 8KB boundary
+    asm volatile (
+        "movl %%esp, %%eax\n"       // Move current ESP value to EAX for manipulation
+        "andl $0xFFFFE000, %%eax\n" // Clear the lower 13 bits to align to 8KB boundary
+        "movl %%eax, %0\n"          // Move the modified EAX value to current_pcb
+        : "=r" (current_pcb)        // Output operands
+        :                            // No input operands
+        : "eax"                      // Clobber list, indicating EAX is modified
+    );
+
+    uint32_t old_brk = current_pcb->brk;
+    uint32_t new_brk = old_brk + increment;
+    if (increment >= 0 ? new_brk > USER_STACK - USER_STACK_SIZE : (new_brk < current_pcb->heapStart || new_brk > old_brk)) {
+        RETURN(-1); // Return error
+    }
+
+    if (increment < 0) {
+        user_paging_unmap(current_pcb, PAGE_ROUND_UP(new_brk), PAGE_ROUND_UP(old_brk));
+    }
+    current_pcb->brk = new_brk;
+
+    RETURN(old_brk); // Return the start of the new memory
+
+    return 0;
+}
+
+/*
+ * vma_insert
+ *  DESCRIPTION: places a new region of size bytes in the mmap region (MMAP_START to MMAP_END) and records it.
+ *               An anonymous region right after another anonymous one extends it instead of taking a slot.
+ *  INPUTS: mappings - the process's mapping slots
+ *          addr - page aligned address to map at, or 0 to let the kernel pick (first fit)
+ *          size - bytes, a whole number of pages
+ *          shm - shared memory segment ID + 1, or 0 for anonymous memory
+ *  RETURN VALUE: start of the region, -1 if addr is outside the region or overlaps a mapping, there's no room,
+ *                or every slot is in use
+ *  SIDE EFFECTS: none
+ */
+static int32_t vma_insert(VMArea* mappings, uint32_t addr, uint32_t size, uint32_t shm) {
+    uint32_t start = addr ? addr : MMAP_START;
+    int i, free_slot = -1;
+
+    // Slide start past every mapping it overlaps (only allowed when the kernel picks the address)
+    for (i = 0; i < MAX_MAPPINGS; i++) {
+        if (mappings[i].end != 0 && start < mappings[i].end && start + size > mappings[i].start) {
+            if (addr) {
+                return -1;
+            }
+            start = mappings[i].end;
+            i = -1; // Recheck the new start against every mapping
+        }
+    }
+    if (start < MMAP_START || start + size > MMAP_END || start + size < start) {
+        return -1;
+    }
+
+    // Extend an anonymous mapping that ends right here, otherwise take a free slot
+    for (i = 0; i < MAX_MAPPINGS; i++) {
+        if (shm == 0 && mappings[i].end == start && mappings[i].shm == 0) {
+            mappings[i].end = start + size;
+            return start;
+        }
+        if (mappings[i].end == 0 && free_slot == -1) {
+            free_slot = i;
+        }
+    }
+    if (free_slot == -1) {
+        return -1;
+    }
+    mappings[free_slot].start = start;
+    mappings[free_slot].end = start + size;
+    mappings[free_slot].shm = shm;
+    return start;
+}
+
+/*
+ * int32_t mmap(void* addr, int32_t length)
+ *  DESCRIPTION: maps length bytes (rounded up to whole pages) of anonymous, zero-filled, read/write memory
+ *               in the mmap region (MMAP_START to MMAP_END). Nothing is allocated until a page is touched.
+ *  INPUTS: addr - page aligned address to map at, or NULL to let the kernel pick (first fit)
+ *          length - bytes to map
+ *  RETURN VALUE: start of the mapping, -1 if length is invalid, addr is unaligned, outside the region or
+ *                overlaps a mapping, there's no room, or the process has MAX_MAPPINGS mappings
+ *  SIDE EFFECTS: none
+ */
+int32_t mmap(void* addr, int32_t length) {
+    ProcessControlBlock* current_pcb;
+    // Assembly code to get the current PCB
+    // Clear the lower 13 bits then AND with ESP to align it to the 8KB boundary
+    asm volatile (
+        "movl %%esp, %%eax\n"       // Move current ESP value to EAX for manipulation
+        "andl $0xFFFFE000, %%eax\n" // Clear the lower 13 bits to align to 8KB boundary
+        "movl %%eax, %0\n"          // Move the modified EAX value to current_pcb
+        : "=r" (current_pcb)        // Output operands
+        :                            // No input operands
+        : "eax"                      // Clobber list, indicating EAX is modified
+    );
+
+    if (length <= 0 || length > MMAP_END - MMAP_START || ((uint32_t)addr & (PAGE_SIZE - 1))) {
+        RETURN(-1); // Return error
+    }
+    int start = vma_insert(current_pcb->mappings, (uint32_t)addr, PAGE_ROUND_UP((uint32_t)length), 0);
+
+    RETURN(start); // Return the start of the mapping
+
+    return 0;
+}
+
+/*
+ * int32_t munmap(void* addr, int32_t length)
+ *  DESCRIPTION: unmaps the pages of [addr, addr + length) in the mmap region and frees the memory behind
+ *               them. Mappings partly inside the range are trimmed, or split in two if the range is in
+ *               their middle. Pages that weren't mapped are ignored.
+ *  INPUTS: addr - page aligned start of the range
+ *          length - bytes to unmap (rounded up to whole pages)
+ *  RETURN VALUE: 0 on success, -1 if the range is invalid, touches a shared memory segment, or a split needs
+ *                a free mapping slot
+ *  SIDE EFFECTS: frees frames
+ */
+int32_t munmap(void* addr, int32_t length) {
+    ProcessControlBlock* current_pcb;
+    // Assembly code to get the current PCB
+    // Clear the lower 13 bits then AND with ESP to align it to the 8KB boundary
+    asm volatile (
+        "movl %%esp, %%eax\n"       // Move current ESP value to EAX for manipulation
+        "andl $0xFFFFE000, %%eax\n" // Clear the lower 13 bits to align to 8KB boundary
+        "movl %%eax, %0\n"          // Move the modified EAX value to current_pcb
+        : "=r" (current_pcb)        // Output operands
+        :                            // No input operands
+        : "eax"                      // Clobber list, indicating EAX is modified
+    );
+
+    uint32_t start = (uint32_t)addr;
+    if (length <= 0 || (start & (PAGE_SIZE - 1)) || start < MMAP_START || start >= MMAP_END) {
+        RETURN(-1); // Return error
+    }
+    uint32_t end = start + PAGE_ROUND_UP((uint32_t)length);
+    if (end > MMAP_END || end < start) {
+        end = MMAP_END;
+    }
+
+    VMArea* mappings = current_pcb->mappings;
+    int i, free_slot = -1, split = -1;
+    for (i = 0; i < MAX_MAPPINGS; i++) {
+        if (mappings[i].shm != 0 && mappings[i].end != 0 && start < mappings[i].end && end > mappings[i].start) {
+            RETURN(-1); // Shared memory only goes with shmdt
+        }
+    }
+    for (i = 0; i < MAX_MAPPINGS; i++) {
+        if (mappings[i].end == 0) {
+            free_slot = free_slot == -1 ? i : free_slot;
+        } else if (start > mappings[i].start && end < mappings[i].end) {
+            split = i; // Range is strictly inside this mapping
+        }
+    }
+    if (split != -1) {
+        if (free_slot == -1) {
+            RETURN(-1); // Return error
+        }
+        mappings[free_slot].start = end;
+        mappings[free_slot].end = mappings[split].end;
+        mappings[split].end = start;
+    } else {
+        for (i = 0; i < MAX_MAPPINGS; i++) {
+            if (mappings[i].end == 0 || end <= mappings[i].start || start >= mappings[i].end) {
+                continue; // Free slot or no overlap
+            }
+            if (start <= mappings[i].start && end >= mappings[i].end) {
+                mappings[i].start = 0; // Whole mapping goes
+                mappings[i].end = 0;
+            } else if (start <= mappings[i].start) {
+                mappings[i].start = end; // Trim the front
+            } else {
+                mappings[i].end = start; // Trim the back
+            }
+        }
+    }
+
+    user_paging_unmap(current_pcb, start, end);
+
+    RETURN(0); // Return success
+
+    return 0;
+}
+
+/*
+ * int32_t fork(void)
+ *  DESCRIPTION: duplicates the calling process. The child gets a new PID, copies of the PCB state (open
+ *               files, arguments, heap and mappings) and a copy-on-write copy of the address space, so only
+ *               pages either side writes are ever copied. Shared memory segments stay shared. Its kernel stack starts as a copy of the parent's
+ *               int $0x80 frame, and it returns to user space through fork_return.
+ *               The child goes on the run queue and shares the parent's terminal; the parent carries on.
+ *  INPUTS: none
+ *  RETURN VALUE: 0 in the child; the child's PID in the parent; -1 if the process
+ *                table is full or memory ran out
+ *  SIDE EFFECTS: makes the child runnable
+ */
+int32_t fork(void) {
+    cli();
+    ProcessControlBlock* current_PCB;
+    // Assembly code to get the current PCB
+    // Mask the lower 13 bits then AND with ESP to align it to the 8KB boundary
+    asm volatile (
+        "movl %%esp, %%eax\n"       // Move current ESP value to EAX for manipulation
+        "andl $0xFFFFE000, %%eax\n" // Clear the lower 13 bits to align to 8KB boundary
+        "movl %%eax, %0\n"          // Move the modified EAX value to current_pcb
+        : "=r" (current_PCB)        // Output operands
+        :                            // No input operands
+        : "eax"                      // Clobber list, indicating EAX is modified
+    );
+
+    int i;
+    ProcessControlBlock* child_PCB = process_create(-1);
+    if (child_PCB == NULL) { // Process table full or out of memory
+        RETURN(-1);
+    }
+    if (user_paging_fork(current_PCB, child_PCB) == -1) {
+        user_paging_destroy(child_PCB);
+        process_destroy(child_PCB);
+        RETURN(-1);
+    }
+
+    // Everything but the PID, the address space and the process links is inherited
+    memcpy(child_PCB->files, current_PCB->files, sizeof(child_PCB->files));
+    memcpy(child_PCB->args, current_PCB->args, sizeof(child_PCB->args));
+    memcpy(child_PCB->name, current_PCB->name, sizeof(child_PCB->name));
+    memcpy(child_PCB->mappings, current_PCB->mappings, sizeof(child_PCB->mappings));
+    for (i = 0; i < MAX_MAPPINGS; i++) {
+        if (child_PCB->mappings[i].end != 0 && child_PCB->mappings[i].shm != 0) {
+            shm_ref(child_PCB->mappings[i].shm - 1); // The child is attached too
+        }
+    }
+    child_PCB->imageInode = current_PCB->imageInode;
+    child_PCB->imageSize = current_PCB->imageSize;
+    child_PCB->textEnd = current_PCB->textEnd;
+    child_PCB->heapStart = current_PCB->heapStart;
+    child_PCB->brk = current_PCB->brk;
+    child_PCB->forked = 1;
+    child_PCB->lockDepth = 1; // Released by system_call_return on its way to user mode
+    child_PCB->terminal = current_PCB->terminal;
+    sched_fork(child_PCB, current_PCB);
+
+    // Child kernel stack: the parent's user registers and iret frame on top, and under them a frame for
+    // return_to_parent to pop (EBP, then the return address fork_return)
+    uint32_t* parent_frame = (uint32_t*)KERNEL_STACK_TOP(current_PCB) - SYSCALL_FRAME_WORDS;
+    uint32_t* child_frame = (uint32_t*)KERNEL_STACK_TOP(child_PCB) - SYSCALL_FRAME_WORDS;
+    memcpy(child_frame, parent_frame, SYSCALL_FRAME_WORDS * sizeof(uint32_t));
+    child_frame[-1] = (uint32_t)fork_return;
+    child_frame[-2] = 0;
+    child_PCB->schedEBP = &child_frame[-2];
+
+    sched_enqueue(child_PCB); // Both run from here on; the child starts at its first turn
+
+    RETURN(child_PCB->processID);
+
+    return 0;
+}
+
+/*
+ * int32_t shmget(uint32_t key, int32_t size)
+ *  DESCRIPTION: creates the shared memory segment named key with size bytes (rounded up to whole pages), or
+ *               finds it if another process already did. Its pages read as zero until written.
+ *  INPUTS: key - nonzero name the processes sharing the segment agree on
+ *          size - bytes needed (at most SHM_MAX_PAGES pages); an existing segment must be at least this big
+ *  RETURN VALUE: size of the segment in bytes, -1 if key or size is invalid or no segment slot is free
+ *  SIDE EFFECTS: none. The segment goes away when the last process attached to it detaches.
+ */
+int32_t shmget(uint32_t key, int32_t size) {
+    if (size <= 0) {
+        RETURN(-1); // Return error
+    }
+    int id = shm_get(key, size);
+    if (id == -1) {
+        RETURN(-1); // Return error
+    }
+
+    RETURN(shm_size(id)); // Return the size of the segment
+
+    return 0;
+}
+
+/*
+ * int32_t shmat(uint32_t key)
+ *  DESCRIPTION: maps the whole shared memory segment named key read/write in the mmap region. Every attached
+ *               process sees the same physical pages, so writes are visible to the others immediately.
+ *  INPUTS: key - key passed to shmget
+ *  RETURN VALUE: start of the mapping, -1 if there's no such segment, no room, or no free mapping slot
+ *  SIDE EFFECTS: none; pages are mapped as they are touched
+ */
+int32_t shmat(uint32_t key) {
+    ProcessControlBlock* current_pcb;
+    // Assembly code to get the current PCB
+    // Clear the lower 13 bits then AND with ESP to align it to the 8KB boundary
+    asm volatile (
+        "movl %%esp, %%eax\n"       // Move current ESP value to EAX for manipulation
+        "andl $0xFFFFE000, %%eax\n" // Clear the lower 13 bits to align to 8KB boundary
+        "movl %%eax, %0\n"          // Move the modified EAX value to current_pcb
+        : "=r" (current_pcb)        // Output operands
+        :                            // No input operands
+        : "eax"                      // Clobber list, indicating EAX is modified
+    );
+
+    int id = shm_find(key);
+    if (id == -1) {
+        RETURN(-1); // Return error
+    }
+    int start = vma_insert(current_pcb->mappings, 0, shm_size(id), id + 1);
+    if (start == -1) {
+        RETURN(-1); // Return error
+    }
+    shm_ref(id);
+
+    RETURN(start); // Return the start of the mapping
+
+    return 0;
+}
+
+/*
+ * int32_t shmdt(void* addr)
+ *  DESCRIPTION: unmaps a shared memory segment attached with shmat. The last process to detach removes
+ *               the segment.
+ *  INPUTS: addr - address shmat returned
+ *  RETURN VALUE: 0 on success, -1 if no segment is attached there
+ *  SIDE EFFECTS: may free the segment's frames
+ */
+int32_t shmdt(void* addr) {
+    ProcessControlBlock* current_pcb;
+    // Assembly code to get the current PCB
+    // Clear the lower 13 bits then AND with ESP to align it to the 8KB boundary
+    asm volatile (
+        "movl %%esp, %%eax\n"       // Move current ESP value to EAX for manipulation
+        "andl $0xFFFFE000, %%eax\n" // Clear the lower 13 bits to align to 8KB boundary
+        "movl %%eax, %0\n"          // Move the modified EAX value to current_pcb
+        : "=r" (current_pcb)        // Output operands
+        :                            // No input operands
+        : "eax"                      // Clobber list, indicating EAX is modified
+    );
+
+    VMArea* mappings = current_pcb->mappings;
+    int i;
+    for (i = 0; i < MAX_MAPPINGS; i++) {
+        if (mappings[i].end != 0 && mappings[i].shm != 0 && mappings[i].start == (uint32_t)addr) {
+            break;
+        }
+    }
+    if (i == MAX_MAPPINGS) {
+        RETURN(-1); // Return error
+    }
+
+    user_paging_unmap(current_pcb, mappings[i].start, mappings[i].end); // Drops this process's frame references
+    shm_unref(mappings[i].shm - 1);
+    mappings[i].start = 0;
+    mappings[i].end = 0;
+    mappings[i].shm = 0;
+
+    RETURN(0); // Return success
+
+    return 0;
+}
+
+/*
+ * int32_t setpriority(int32_t pid, int32_t nice)
+ *  DESCRIPTION: sets the nice value of a process. Each level is about a 10% change in CPU share against
+ *               a nice 0 process. Executed and forked children inherit it.
+ *  INPUTS: pid - process to change, 0 for the caller
+ *          nice - NICE_MIN (most CPU) to NICE_MAX (least); values outside the range are clamped
+ *  RETURN VALUE: 0 on success, -1 if there's no such process
+ *  SIDE EFFECTS: takes effect from the process's next tick
+ */
+int32_t setpriority(int32_t pid, int32_t nice) {
+    ProcessControlBlock* pcb;
+    // Assembly code to get the current PCB
+    // Clear the lower 13 bits then AND with ESP to align it to the 8KB boundary
+    asm volatile (
+        "movl %%esp, %%eax\n"       // Move current ESP value to EAX for manipulation
+        "andl $0xFFFFE000, %%eax\n" // Clear the lower 13 bits to align to 8KB boundary
+        "movl %%eax, %0\n"          // Move the modified EAX value to current_pcb
+        : "=r" (pcb)                // Output operands
+        :                            // No input operands
+        : "eax"                      // Clobber list, indicating EAX is modified
+    );
+
+    if (pid != 0 && (pcb = process_lookup(pid)) == NULL) {
+        RETURN(-1); // Return error
+    }
+    if (nice < NICE_MIN) {
+        nice = NICE_MIN;
+    }
+    if (nice > NICE_MAX) {
+        nice = NICE_MAX;
+    }
+    pcb->nice = nice;
+
+    RETURN(0); // Return success
+
+    return 0;
+}
+
+/*
+ * int32_t schedstat(int32_t pid, void* buf)
+ *  DESCRIPTION: copies a process's scheduler statistics (a SchedStat) to buf: its nice value, how long
+ *               it has run against the time since boot, and how long its wakeups took to get the CPU
+ *  INPUTS: pid - process to report, 0 for the caller
+ *          buf - where to put the SchedStat
+ *  RETURN VALUE: 0 on success, -1 if buf is NULL or there's no such process
+ *  SIDE EFFECTS: none
+ */
+int32_t schedstat(int32_t pid, void* buf) {
+    ProcessControlBlock* pcb;
+    SchedStat* stat = (SchedStat*)buf;
+    // Assembly code to get the current PCB
+    // Clear the lower 13 bits then AND with ESP to align it to the 8KB boundary
+    asm volatile (
+        "movl %%esp, %%eax\n"       // Move current ESP value to EAX for manipulation
+        "andl $0xFFFFE000, %%eax\n" // Clear the lower 13 bits to align to 8KB boundary
+        "movl %%eax, %0\n"          // Move the modified EAX value to current_pcb
+        : "=r" (pcb)                // Output operands
+        :                            // No input operands
+        : "eax"                      // Clobber list, indicating EAX is modified
+    );
+
+    if (stat == NULL || (pid != 0 && (pcb = process_lookup(pid)) == NULL)) {
+        RETURN(-1); // Return error
+    }
+    stat->nice = pcb->nice;
+    stat->runUs = pcb->runUs;
+    stat->uptimeUs = pit_time_us();
+    stat->wakeups = pcb->wakeups;
+    stat->wakeLatencyTotal = pcb->wakeLatencyTotal;
+    stat->wakeLatencyMax = pcb->wakeLatencyMax;
+
+    RETURN(0); // Return success
+
+    return 0;
+}
+
+/*
+ * int32_t cpustat(void* buf)
+ *  DESCRIPTION: copies the CPUs' time accounting (a CpuStat) to buf: uptime and time spent halted in the
+ *               idle contexts (summed over CPUs) in microseconds, how many timer interrupts there were
+ *               (idle and in total), and how many CPUs are online. Utilization over an interval is one
+ *               minus the idle delta over the uptime delta times the CPU count.
+ *  INPUTS: buf - where to put the CpuStat
+ *  RETURN VALUE: 0 on success, -1 if buf is NULL
+ *  SIDE EFFECTS: none
+ */
+int32_t cpustat(void* buf) {
+    CpuStat* stat = (CpuStat*)buf;
+
+    if (stat == NULL) {
+        RETURN(-1); // Return error
+    }
+    stat->uptimeUs = pit_time_us();
+    stat->idleUs = sched_idle_time();
+    stat->pitInterrupts = pit_interrupts;
+    stat->idleInterrupts = idle_interrupts;
+    stat->cpus = smp_online();
+
+    RETURN(0); // Return success
+
+    return 0;
+}
+
+/*
+ * int32_t sleep_ms(uint32_t ms)
+ *  DESCRIPTION: blocks the caller for at least ms milliseconds on a kernel timer, rounded up to the
+ *               timer wheel's 1ms tick. Other processes run (or the CPU idles) meanwhile.
+ *  INPUTS: ms - milliseconds to sleep; 0 sleeps until the next tick
+ *  RETURN VALUE: 0
+ *  SIDE EFFECTS: none
+ */
+int32_t sleep_ms(uint32_t ms) {
+    RETURN(timer_sleep_ms(ms));
+
+    return 0;
+}
+
+/*
+ * void sysenter_init(tss_t* cpu_tss)
+ *  DESCRIPTION: points the running CPU's SYSENTER MSRs at sysenter_linkage, so user programs can make
+ *               system calls without int $0x80. SYSENTER_ESP is the address of the CPU's tss.esp0 rather
+ *               than a stack: sysenter_linkage loads the kernel stack of whatever is running from there, so
+ *               the MSR never has to change on a context switch. Does nothing if the CPU has no SYSENTER
+ *               (the Pentium Pro's early steppings claim to but don't); int $0x80 always works.
+ *  INPUTS: cpu_tss - the running CPU's TSS
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: writes the SYSENTER MSRs
+ */
+void sysenter_init(tss_t* cpu_tss) {
+    uint32_t eax, ebx, ecx, edx;
+
+    asm volatile ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+    if (!(edx & CPUID_SEP)) {
+        return;
+    }
+    if (((eax >> 8) & 0xF) == 6 && ((eax >> 4) & 0xF) < 3 && (eax & 0xF) < 3) {
+        return; // Pentium Pro: SEP is set but SYSENTER isn't there
+    }
+    asm volatile ("wrmsr" : : "a" (KERNEL_CS), "d" (0), "c" (MSR_SYSENTER_CS));
+    asm volatile ("wrmsr" : : "a" ((uint32_t)&cpu_tss->esp0), "d" (0), "c" (MSR_SYSENTER_ESP));
+    asm volatile ("wrmsr" : : "a" ((uint32_t)sysenter_linkage), "d" (0), "c" (MSR_SYSENTER_EIP));
+}
+
+// Syscall helpers
+
 ProcessControlBlock* get_base_process_pcb(ProcessControlBlock* starting_pcb) {
     while(starting_pcb->parentPCB != 0) {
         starting_pcb = starting_pcb->parentPCB;
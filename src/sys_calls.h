@@ -14,6 +14,23 @@
 #define VID_PDT_IDX      34         // Page Directory Table index for video memory paging table
 #define VID_MEM_PHYSICAL 0xB8000    // Video memory start physical address
 
+// ELF32 header and program header fields used by execute
+#define ELF_PHOFF_OFFSET     28     // e_phoff: file offset of the program headers
+#define ELF_PHENTSIZE_OFFSET 42     // e_phentsize: size of one program header
+#define ELF_PHNUM_OFFSET     44     // e_phnum: number of program headers
+#define ELF_PHDR_WORDS       8      // Program header size in 32-bit words
+#define ELF_P_TYPE           0      // Program header word indices
+#define ELF_P_VADDR          2
+#define ELF_P_MEMSZ          5
+#define ELF_P_FLAGS          6
+#define ELF_PT_LOAD          1
+#define ELF_PF_W             0x2
+
+#define IOV_MAX 16 // Most buffers one readv/writev call will gather or scatter
+#define MAX_MAPPINGS 16 // Most separate mmap regions (and shared memory attachments) one process can have
+#define SYSCALL_FRAME_WORDS 12 // Top of a kernel stack at int $0x80 (or sysenter): iret frame (5) + system_call_linkage's saves (7)
+#define CPUID_SEP (1 << 11) // CPUID leaf 1, EDX: SYSENTER/SYSEXIT
+
 extern int32_t halt(uint32_t status); // Halts the current system call
 extern int32_t execute(const uint8_t* command); // executes the called sys call
 extern int32_t read(int32_t fd, void* buf, int32_t nbytes); // reads data from a file or device
@@ -24,20 +41,57 @@ extern int32_t getargs(uint8_t* buf, int32_t nbytes);
 extern int32_t vidmap(uint8_t** screen_start);
 extern int32_t set_handler(int32_t signum, void* handler_address);
 extern int32_t sigreturn(void);
+extern int32_t getdents(int32_t fd, void* buf, int32_t nbytes);
+extern int32_t lseek(int32_t fd, int32_t offset, int32_t whence); // moves the position of a file
+extern int32_t pread(int32_t fd, void* buf, int32_t nbytes, uint32_t offset); // reads at an offset without moving the position
+extern int32_t readv(int32_t fd, const void* iov, int32_t iovcnt); // reads into several buffers in one call
+extern int32_t writev(int32_t fd, const void* iov, int32_t iovcnt); // writes from several buffers in one call
+extern int32_t sendfile(int32_t out_fd, int32_t in_fd, int32_t count); // copies a file to a device inside the kernel
+extern int32_t sbrk(int32_t increment); // grows or shrinks the heap
+extern int32_t mmap(void* addr, int32_t length); // maps anonymous zero-filled memory
+extern int32_t munmap(void* addr, int32_t length); // unmaps memory from mmap
+extern int32_t fork(void); // duplicates the calling process, copy-on-write
+extern int32_t shmget(uint32_t key, int32_t size); // creates or finds a shared memory segment
+extern int32_t shmat(uint32_t key); // maps a shared memory segment
+extern int32_t shmdt(void* addr); // unmaps a shared memory segment
+extern int32_t setpriority(int32_t pid, int32_t nice); // sets a process's nice value
+extern int32_t schedstat(int32_t pid, void* buf); // reports a process's scheduler statistics
+extern int32_t cpustat(void* buf); // reports uptime and idle time
+extern int32_t sleep_ms(uint32_t ms); // sleeps for a number of milliseconds
+extern void sysenter_linkage(void); // SYSENTER entry point, see x86_desc.S
+void sysenter_init(tss_t* cpu_tss); // enables SYSENTER on the running CPU
 
 typedef int (*read_func)(int32_t fd, void* buf, int32_t nbytes);
 typedef int (*write_func)(int32_t fd, const void* buf, int32_t nbytes);
 typedef int (*open_func)(const uint8_t* filename);
 typedef int (*close_func)(int32_t fd);
+typedef int (*seek_func)(int32_t fd, int32_t offset, int32_t whence);
+typedef int (*pread_func)(int32_t fd, void* buf, int32_t nbytes, uint32_t offset);
 
 // initializes file operations table struct
+// seek and pread are NULL for devices without a position (terminal, RTC)
 typedef struct FileOperationsTable {
     read_func read;
     write_func write;
     open_func open;
     close_func close;
+    seek_func seek;
+    pread_func pread;
 } FileOperationsTable;
 
+// one buffer of a readv/writev request
+typedef struct IOVector {
+    void* base;
+    int32_t length;
+} IOVector;
+
+// one mmap region [start, end), page aligned: anonymous memory or an attached shared memory segment
+typedef struct VMArea {
+    uint32_t start;
+    uint32_t end;                    // 0 for an unused slot
+    uint32_t shm;                    // Shared memory segment ID + 1, 0 for anonymous memory
+} VMArea;
+
 // initializes file descriptor table struct
 typedef struct FileDescriptor {
     FileOperationsTable operationsTable;
@@ -46,6 +100,29 @@ typedef struct FileDescriptor {
     uint32_t flags;
 } FileDescriptor;
 
+// Scheduler statistics of one process, copied out by schedstat (layout shared with user programs)
+typedef struct SchedStat {
+    int32_t nice;
+    uint32_t runUs;                  // Microseconds the process has run
+    uint32_t uptimeUs;               // pit_time_us(), to turn runUs into a share
+    uint32_t wakeups;                // Wakeups from a wait queue
+    uint32_t wakeLatencyTotal;       // Microseconds from wakeup until running, summed over wakeups
+    uint32_t wakeLatencyMax;         // Longest wakeup latency in microseconds
+} SchedStat;
+
+// Whole-machine time accounting, copied out by cpustat (layout shared with user programs)
+typedef struct CpuStat {
+    uint32_t uptimeUs;               // pit_time_us(): microseconds since boot, wrapping
+    uint32_t idleUs;                 // Microseconds spent halted in the idle context, wrapping
+    uint32_t pitInterrupts;          // PIT interrupts since boot (fewer than PIT_HZ a second when tickless)
+    uint32_t idleInterrupts;         // PIT interrupts that found the CPU idle
+    uint32_t cpus;                   // CPUs online; idleUs is summed over all of them
+} CpuStat;
+
+// Process states (ProcessControlBlock.state)
+#define PROC_RUNNABLE 0 // Running or ready to run
+#define PROC_BLOCKED  1 // Off the run queue: sleeping on a wait queue or waiting in execute
+
 // initializes process control block struct
 typedef struct ProcessControlBlock {
     int processID;                   // Unique process identifier
@@ -57,15 +134,37 @@ typedef struct ProcessControlBlock {
     void* parentPCB;
     void* EBP;
     void* schedEBP;
+    uint32_t imageInode;             // Inode of the program image, demand loaded by page_fault_handler
+    uint32_t imageSize;              // Size of the program image in bytes
+    uint32_t textEnd;                // Pages below this address are mapped read-only from the file system image
+    uint32_t* pageDirectory;         // Page directory loaded into CR3 while the process runs (a frame from frame_alloc)
+    uint32_t* userPageTable;         // Page table of the 128MB user program window (a frame from frame_alloc)
+    uint32_t heapStart;              // End of the program image and its bss, page aligned: where the heap starts
+    uint32_t brk;                    // Program break, the heap is [heapStart, brk)
+    VMArea mappings[MAX_MAPPINGS];   // mmap regions and shared memory attachments, filled in by page_fault_handler
+    uint32_t forked;                 // Created by fork: no parent waits on it, so halt just exits
+    uint32_t state;                  // PROC_RUNNABLE, or PROC_BLOCKED while sleeping or waiting for an executed child
+    uint32_t terminal;               // Terminal (1-3) the process reads from and prints to, inherited from its creator
+    int32_t nice;                    // NICE_MIN (most CPU) to NICE_MAX (least), set with setpriority
+    uint32_t vruntime;               // Virtual runtime in us: CPU time scaled by NICE_0_WEIGHT / weight
+    uint32_t runUs;                  // Microseconds of CPU time, wrapping
+    uint32_t execStart;              // pit_time_us() it was last charged up to, see sched_account
+    uint32_t wakeTime;               // pit_time_us() of the last wakeup
+    uint32_t wakePending;            // Woken but hasn't run since
+    uint32_t wakeups;                // Wakeups from a wait queue that have been followed by a run
+    uint32_t wakeLatencyTotal;       // Microseconds from those wakeups until the process ran, summed
+    uint32_t wakeLatencyMax;         // Longest of those
+    uint32_t cpu;                    // CPU the process is running on, or last ran on (index in cpus[])
+    uint32_t lockDepth;              // Kernel lock nesting on this process's behalf, see kernel_lock
 } ProcessControlBlock;
 
 extern void halt_return(uint32_t parent_ebp, uint32_t parent_esp, uint32_t ret_val);
 extern void return_to_parent(void* parent_ebp);
+extern void fork_return(void);
 
 extern uint8_t base_shell_booted_bitmask;
 extern int shell_init_boot;
 
-ProcessControlBlock* get_top_process_pcb(ProcessControlBlock* starting_pcb);
 ProcessControlBlock* get_base_process_pcb(ProcessControlBlock* starting_pcb);
 
 #define RETURN(VALUE) \
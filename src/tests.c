@@ -5,6 +5,18 @@
 #include "RTC.h"
 #include "keyboard.h"
 #include "file_sys.h"
+#include "pit.h"
+#include "frame_alloc.h"
+#include "kmalloc.h"
+#include "process.h"
+#include "paging.h"
+#include "sys_calls.h"
+#include "shm.h"
+#include "timer.h"
+#include "apic.h"
+#include "i8259.h"
+#include "smp.h"
+#include "fs_bench.h"
 #define PASS 1
 #define FAIL 0
 
@@ -424,6 +436,885 @@ void syscall_test() {
 
 
 
+/* --------------Frame Allocator Tests-------------- */
+
+/*
+ * frame_alloc_test
+ *   DESCRIPTION: Checks the physical frame allocator: 4kB and 4MB frames come back aligned, inside the
+ *                managed range, distinct, writable through the kernel identity mapping, a shared frame is
+ *                only freed with its last reference, and freeing them restores the free count
+ *   INPUTS: none
+ *   OUTPUTS: The number of free frames
+ *   RETURN VALUE: PASS/FAIL
+ *   SIDE EFFECTS: Temporarily allocates and frees memory
+ */
+int frame_alloc_test() {
+	TEST_HEADER;
+
+	uint32_t before = frame_free_count();
+	uint32_t a = frame_alloc();
+	uint32_t b = frame_alloc();
+	uint32_t large = frame_alloc_large();
+	int result = PASS;
+
+	printf("%u free 4kB frames\n", before);
+	if (a == 0 || b == 0 || a == b || (a & (PAGE_SIZE - 1)) || (b & (PAGE_SIZE - 1)) ||
+		a < FRAME_MEM_START || b >= FRAME_MEM_END) {
+		result = FAIL;
+	}
+	if (large != 0 && ((large & (LARGE_PAGE_SIZE - 1)) || (a >= large && a < large + LARGE_PAGE_SIZE))) {
+		result = FAIL;
+	}
+	if (result == PASS) {
+		*(uint32_t*)a = 0x391;
+		*(uint32_t*)b = 0;
+		if (*(uint32_t*)a != 0x391) {
+			result = FAIL;
+		}
+	}
+
+	// A shared frame survives until its last reference is dropped
+	uint32_t in_use = frame_free_count();
+	frame_share(a);
+	if (!frame_is_shared(a) || frame_is_shared(b)) {
+		result = FAIL;
+	}
+	frame_free(a);
+	if (frame_is_shared(a) || frame_free_count() != in_use) {
+		result = FAIL;
+	}
+
+	frame_free(a);
+	frame_free(b);
+	if (large != 0) {
+		frame_free_large(large);
+	}
+	if (frame_free_count() != before) {
+		result = FAIL;
+	}
+	return result;
+}
+
+
+/* --------------Kernel Heap Tests-------------- */
+
+#define KMALLOC_TEST_OBJS 300 // Enough 64 byte objects to span several slabs
+
+/*
+ * kmalloc_test
+ *   DESCRIPTION: Exercises the kernel heap: many objects from one size class (crossing slab boundaries),
+ *                a page sized allocation, a private cache, and that freeing everything gives the frames back
+ *   INPUTS: none
+ *   OUTPUTS: Cache statistics
+ *   RETURN VALUE: PASS/FAIL
+ *   SIDE EFFECTS: Temporarily allocates kernel memory
+ */
+int kmalloc_test() {
+	TEST_HEADER;
+
+	static void* objs[KMALLOC_TEST_OBJS];
+	static kmem_cache_t test_cache;
+	uint32_t i, j;
+	int result = PASS;
+
+	// Objects are distinct, correctly sized and don't overlap
+	for (i = 0; i < KMALLOC_TEST_OBJS; i++) {
+		objs[i] = kmalloc(40 + (i % 24)); // 40-63 bytes: all in kmalloc-64
+		if (objs[i] == NULL || ((uint32_t)objs[i] & (PAGE_SIZE - 1)) == 0) {
+			return FAIL;
+		}
+		memset(objs[i], (uint8_t)i, 40);
+	}
+	for (i = 0; i < KMALLOC_TEST_OBJS; i++) {
+		for (j = 0; j < 40; j++) {
+			if (((uint8_t*)objs[i])[j] != (uint8_t)i) {
+				result = FAIL;
+			}
+		}
+	}
+	for (i = 0; i < KMALLOC_TEST_OBJS; i++) {
+		kfree(objs[i]);
+	}
+
+	// Page sized allocations bypass the slabs
+	void* page = kzalloc(PAGE_SIZE);
+	if (page == NULL || ((uint32_t)page & (PAGE_SIZE - 1)) != 0 || *(uint32_t*)page != 0) {
+		result = FAIL;
+	}
+	kfree(page);
+	if (kmalloc(PAGE_SIZE + 1) != NULL || kmalloc(0) != NULL) {
+		result = FAIL;
+	}
+
+	// A dedicated cache reuses freed objects
+	if (kmem_cache_init(&test_cache, "test", 100) != 0) {
+		return FAIL;
+	}
+	void* a = kmem_cache_alloc(&test_cache);
+	kmem_cache_free(&test_cache, a);
+	void* b = kmem_cache_alloc(&test_cache);
+	if (a != b || test_cache.misses != 1 || test_cache.hits != 1) {
+		result = FAIL;
+	}
+	kmem_cache_free(&test_cache, b);
+
+	kmem_stats();
+	return result;
+}
+
+/*
+ * tlb_invalidate_test
+ *   DESCRIPTION: Remaps one user page between two frames and checks that tlb_invalidate_page makes the
+ *                new mapping visible without a full flush
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: PASS/FAIL
+ *   SIDE EFFECTS: Builds and frees a throwaway address space, reloads pdt
+ */
+int tlb_invalidate_test() {
+	TEST_HEADER;
+
+	static ProcessControlBlock pcb; // Only the page directory fields are used
+	uint32_t a, b;
+	pt_entry_t page;
+	int result = PASS;
+
+	if (user_paging_setup(&pcb) == -1) {
+		return FAIL;
+	}
+	a = frame_alloc();
+	b = frame_alloc();
+	if (a == 0 || b == 0) { // Out of frames: undo the rest, as below, so a later run starts clean
+		if (a != 0) {
+			frame_free(a);
+		}
+		if (b != 0) {
+			frame_free(b);
+		}
+		load_page_directory(pdt);
+		user_paging_destroy(&pcb);
+		return FAIL;
+	}
+	*(uint32_t*)a = 0xAAAA;
+	*(uint32_t*)b = 0xBBBB;
+
+	page.val = 0;
+	page.p = 1;
+	page.rw = 1;
+	page.address_31_12 = a >> 12;
+	pcb.userPageTable[0] = page.val;
+	tlb_invalidate_page(USER_MEM_START);
+	if (*(volatile uint32_t*)USER_MEM_START != 0xAAAA) {
+		result = FAIL;
+	}
+
+	page.address_31_12 = b >> 12;
+	pcb.userPageTable[0] = page.val;
+	tlb_invalidate_page(USER_MEM_START);
+	if (*(volatile uint32_t*)USER_MEM_START != 0xBBBB) {
+		result = FAIL;
+	}
+
+	frame_free(a); // b is still mapped and goes back with the rest of the window
+	load_page_directory(pdt);
+	user_paging_destroy(&pcb);
+	return result;
+}
+
+
+/* --------------Process Table Tests-------------- */
+
+/*
+ * process_table_test
+ *   DESCRIPTION: Fills every free PID with process_create, checks each gets its own 8kB aligned kernel
+ *                stack with the PCB at its base, then destroys them all and checks the table is empty again
+ *   INPUTS: none
+ *   OUTPUTS: Table size and how many processes fit
+ *   RETURN VALUE: PASS/FAIL
+ *   SIDE EFFECTS: Temporarily allocates PIDs and kernel stacks (run before any program besides the shells)
+ */
+int process_table_test() {
+	TEST_HEADER;
+
+	uint32_t live = process_count;
+	uint32_t created = 0;
+	uint32_t pid;
+	int result = PASS;
+	ProcessControlBlock* pcb;
+
+	while ((pcb = process_create(-1)) != NULL) {
+		created++;
+		if (((uint32_t)pcb & (PCB_MEM - 1)) != 0 || process_lookup(pcb->processID) != pcb
+			|| pcb->processID < FIRST_AUX_PID) {
+			result = FAIL;
+		}
+	}
+	printf("%u PIDs, %u processes created\n", process_table_size, created);
+	if (created == 0) {
+		result = FAIL;
+	}
+
+	for (pid = FIRST_AUX_PID; pid < process_table_size; pid++) {
+		pcb = process_lookup(pid);
+		if (pcb != NULL && pcb->pageDirectory == NULL) { // Ours: real programs always have an address space
+			process_destroy(pcb);
+		}
+	}
+	if (process_count != live) {
+		result = FAIL;
+	}
+	return result;
+}
+
+/* --------------Shared Memory Tests-------------- */
+
+#define SHM_TEST_KEY 0x391 // Not used by any program
+
+/*
+ * shm_test
+ *   DESCRIPTION: Creates a segment, finds it again by key, checks its pages are allocated zeroed on first
+ *                use and stay put, and that the last unref removes it and frees its frames
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: PASS/FAIL
+ *   SIDE EFFECTS: Temporarily allocates a segment
+ */
+int shm_test() {
+	TEST_HEADER;
+
+	int32_t id = shm_get(SHM_TEST_KEY, 3 * PAGE_SIZE - 1);
+	uint32_t before = frame_free_count(); // After the frame list came from kmalloc
+	int result = PASS;
+
+	if (id == -1 || shm_find(SHM_TEST_KEY) != id || shm_get(SHM_TEST_KEY, PAGE_SIZE) != id ||
+		shm_get(SHM_TEST_KEY, 4 * PAGE_SIZE) != -1 || shm_size(id) != 3 * PAGE_SIZE) {
+		return FAIL;
+	}
+	shm_ref(id);
+	uint32_t frame = shm_frame(id, 2);
+	if (frame == 0 || *(uint32_t*)frame != 0 || shm_frame(id, 2) != frame || shm_frame(id, 3) != 0) {
+		result = FAIL;
+	}
+	shm_unref(id);
+	if (shm_find(SHM_TEST_KEY) != -1 || frame_free_count() < before) {
+		result = FAIL;
+	}
+	return result;
+}
+
+/* --------------Timer Tests-------------- */
+
+#define TIMER_TEST_TIMERS   5
+#define TIMER_TEST_WAIT_US  500000 // Longer than the longest timer below
+#define TIMER_TEST_LONG_MS  5000000 // Over 2^32 us: must not wrap into a short delay
+
+static uint32_t timer_test_start;
+static uint32_t timer_test_fired[TIMER_TEST_TIMERS];  // Microseconds after the start, 0 if not fired
+static uint32_t timer_test_order[TIMER_TEST_TIMERS];
+static uint32_t timer_test_count;
+
+/*
+ * timer_test_func
+ *   DESCRIPTION: Timer function for timer_test: records when and in what order each timer fired
+ *   INPUTS: data - index of the timer
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void timer_test_func(void* data) {
+	uint32_t index = (uint32_t)data;
+
+	timer_test_fired[index] = pit_time_us() - timer_test_start;
+	if (timer_test_count < TIMER_TEST_TIMERS) {
+		timer_test_order[timer_test_count++] = index;
+	}
+}
+
+/*
+ * timer_test
+ *   DESCRIPTION: Arms timers in the root of the wheel and in the level above it (so one has to cascade
+ *                down), rearms one earlier and cancels another, then lets the PIT run them. Checks they
+ *                fire in deadline order, no earlier than asked, and that the cancelled one never does.
+ *                Also arms two very long timers (one past the clamp) and checks they're due the right
+ *                number of ticks out, less than 2^31, and don't fire meanwhile.
+ *   INPUTS: none
+ *   OUTPUTS: When each timer fired
+ *   RETURN VALUE: PASS/FAIL
+ *   SIDE EFFECTS: Enables interrupts for about half a second
+ */
+int timer_test() {
+	TEST_HEADER;
+
+	uint32_t delay_ms[TIMER_TEST_TIMERS] = { 2, 20, 300, 5, 1000 };
+	static const uint32_t expected[] = { 0, 4, 1, 2 }; // Timer 3 is cancelled, timer 4 rearmed at 10ms
+	ktimer_t timers[TIMER_TEST_TIMERS];
+	ktimer_t long_timers[2];
+	uint32_t flags;
+	uint32_t i;
+	int result = PASS;
+
+	timer_test_count = 0;
+	timer_test_start = pit_time_us();
+	for (i = 0; i < TIMER_TEST_TIMERS; i++) {
+		timer_test_fired[i] = 0;
+		timer_setup(&timers[i], timer_test_func, (void*)i);
+		timer_add(&timers[i], delay_ms[i]);
+	}
+	timer_setup(&long_timers[0], timer_test_func, (void*)3); // Counted like the cancelled timer if they fire
+	timer_setup(&long_timers[1], timer_test_func, (void*)3);
+	timer_add(&long_timers[0], TIMER_TEST_LONG_MS);
+	timer_add(&long_timers[1], 0xFFFFFFFF);
+	for (i = 0; i < 2; i++) {
+		uint32_t ticks = long_timers[i].expires - timers[0].expires; // timers[0] is 2 ticks out
+		if (ticks < TIMER_TEST_LONG_MS - 2 || ticks >= 0x80000000) {
+			result = FAIL;
+		}
+	}
+	delay_ms[4] = 10;
+	timer_add(&timers[4], delay_ms[4]);
+	if (!timer_cancel(&timers[3]) || timer_pending(&timers[3])) {
+		result = FAIL;
+	}
+
+	cli_and_save(flags);
+	sti();
+	while (timer_test_count < 4 && pit_time_us() - timer_test_start < TIMER_TEST_WAIT_US);
+	restore_flags(flags);
+
+	for (i = 0; i < 2; i++) {
+		if (!timer_cancel(&long_timers[i])) {
+			result = FAIL; // Fired early (or wasn't pending)
+		}
+	}
+	for (i = 0; i < TIMER_TEST_TIMERS; i++) {
+		printf("timer %u: %ums, fired after %uus\n", i, delay_ms[i], timer_test_fired[i]);
+		if (timer_cancel(&timers[i])) {
+			result = FAIL; // Should have fired (or been cancelled) by now
+		}
+	}
+	if (timer_test_count != 4 || timer_test_fired[3] != 0) {
+		return FAIL;
+	}
+	for (i = 0; i < 4; i++) {
+		uint32_t index = expected[i];
+		if (timer_test_order[i] != index || timer_test_fired[index] < delay_ms[index] * 1000) {
+			result = FAIL;
+		}
+	}
+	return result;
+}
+
+/*
+ * smp_test
+ *   DESCRIPTION: Checks the CPUs smp_start brought up: the boot CPU is CPU 0, every other started CPU sits
+ *                in its own idle context, and each one's TSS points at that context's stack. Also checks
+ *                that the kernel lock nests (the boot context already holds it) and that a spinlock is
+ *                free again after it's released.
+ *   INPUTS: none
+ *   OUTPUTS: How many CPUs are online
+ *   RETURN VALUE: PASS/FAIL
+ *   SIDE EFFECTS: none
+ */
+int smp_test() {
+	TEST_HEADER;
+
+	spinlock_t lock = { 0 };
+	uint32_t depth = IDLE_PCB->lockDepth;
+	uint32_t i;
+	int result = PASS;
+
+	printf("%u CPUs online\n", smp_online());
+	if (this_cpu() != &cpus[0] || !cpus[0].started || smp_online() < 1) {
+		return FAIL;
+	}
+	for (i = 1; i < MAX_CPUS; i++) {
+		if (!cpus[i].started) {
+			continue;
+		}
+		if (cpus[i].idle == NULL || cpus[i].idle->cpu != i || cpus[i].tss == cpus[0].tss ||
+				cpus[i].tss->esp0 != KERNEL_STACK_TOP(cpus[i].idle)) {
+			result = FAIL;
+		}
+	}
+
+	kernel_lock();
+	if (IDLE_PCB->lockDepth != depth + 1) {
+		result = FAIL;
+	}
+	kernel_unlock();
+	if (IDLE_PCB->lockDepth != depth) {
+		result = FAIL;
+	}
+
+	spin_lock(&lock);
+	if (!lock.locked) {
+		result = FAIL;
+	}
+	spin_unlock(&lock);
+	if (lock.locked) {
+		result = FAIL;
+	}
+	return result;
+}
+
+/*
+ * sysenter_test
+ *   DESCRIPTION: Checks that sysenter_init pointed the boot CPU's SYSENTER MSRs at sysenter_linkage, the
+ *                kernel code segment and its TSS's esp0 (the APs run the same code). The latency
+ *                comparison with int $0x80 needs user mode: see the syslat program.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: PASS/FAIL (PASS if the CPU has no SYSENTER)
+ *   SIDE EFFECTS: none
+ */
+int sysenter_test() {
+	TEST_HEADER;
+
+	uint32_t eax, ebx, ecx, edx;
+	uint32_t cs, esp, eip, high;
+
+	asm volatile ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+	if (!(edx & CPUID_SEP)) {
+		printf("no SYSENTER\n");
+		return PASS;
+	}
+	asm volatile ("rdmsr" : "=a" (cs), "=d" (high) : "c" (MSR_SYSENTER_CS));
+	asm volatile ("rdmsr" : "=a" (esp), "=d" (high) : "c" (MSR_SYSENTER_ESP));
+	asm volatile ("rdmsr" : "=a" (eip), "=d" (high) : "c" (MSR_SYSENTER_EIP));
+	if (cs != KERNEL_CS || esp != (uint32_t)&cpus[0].tss->esp0 || eip != (uint32_t)sysenter_linkage) {
+		return FAIL;
+	}
+	return PASS;
+}
+
+/* --------------Performance Benchmarks-------------- */
+
+static uint8_t bench_buf_ref[BENCH_BUF_SIZE];
+
+/*
+ * read_data_bytewise
+ *   DESCRIPTION: Reference copy of the original read_data loop, which recomputed the block index and
+ *                called memcpy once per byte. Kept only so the benchmark has a baseline to compare against.
+ *   INPUTS: inode, offset, buf, length - same as read_data
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of bytes read, -1 for a bad inode
+ *   SIDE EFFECTS: fills buf
+ */
+static int32_t read_data_bytewise(uint32_t inode, uint32_t offset, uint8_t *buf, uint32_t length) {
+	if (inode >= g_boot_block->num_inodes) {
+		return -1;
+	}
+	inode_t *file_inode = &g_inodes[inode];
+	if (length > file_inode->size - offset) {
+		length = file_inode->size - offset;
+	}
+	uint32_t bytes_read = 0;
+	uint32_t i;
+	for (i = offset; i < offset + length; i++) {
+		if (file_inode->blocks[i / BLOCK_SIZE] >= g_boot_block->num_data_blocks) {
+			break;
+		}
+		data_block_t *data_block = &g_data_blocks[file_inode->blocks[i / BLOCK_SIZE]];
+		memcpy(buf + bytes_read, (uint8_t*)data_block + i % BLOCK_SIZE, 1);
+		bytes_read++;
+	}
+	return bytes_read;
+}
+
+/*
+ * read_data_bench
+ *   DESCRIPTION: Loads every regular file in filesys_img with both the bytewise reference loop and
+ *                the block-span read_data, checks that the bytes match, and prints the cycles each
+ *                path took (averaged over BENCH_ITERATIONS runs) along with the speedup.
+ *   INPUTS: none
+ *   OUTPUTS: One line per file with cycle counts
+ *   RETURN VALUE: PASS if both paths agree on every file, FAIL otherwise
+ *   SIDE EFFECTS: none
+ */
+int read_data_bench() {
+	TEST_HEADER;
+
+	int result = PASS;
+	uint32_t i, iter, start;
+	for (i = 0; i < g_boot_block->num_dir_entries; i++) {
+		dir_entry_t *dentry = &g_boot_block->dir_entries[i];
+		if (dentry->file_type != FILE_TYPE_REG) {
+			continue;
+		}
+		uint32_t size = g_inodes[dentry->inode_num].size;
+		if (size > BENCH_BUF_SIZE) {
+			size = BENCH_BUF_SIZE;
+		}
+
+		uint32_t bytewise_cycles = 0;
+		uint32_t span_cycles = 0;
+		for (iter = 0; iter < BENCH_ITERATIONS; iter++) {
+			start = rdtsc();
+			read_data_bytewise(dentry->inode_num, 0, bench_buf_ref, size);
+			bytewise_cycles += rdtsc() - start;
+
+			start = rdtsc();
+			read_data(dentry->inode_num, 0, bench_buf, size);
+			span_cycles += rdtsc() - start;
+		}
+		bytewise_cycles /= BENCH_ITERATIONS;
+		span_cycles /= BENCH_ITERATIONS;
+
+		uint32_t j;
+		for (j = 0; j < size; j++) {
+			if (bench_buf_ref[j] != bench_buf[j]) {
+				result = FAIL;
+				break;
+			}
+		}
+
+		int8_t name[MAX_FILE_NAME + 1]; // Names of exactly 32 characters are not NUL terminated
+		strncpy(name, (int8_t*)dentry->name, MAX_FILE_NAME);
+		name[MAX_FILE_NAME] = '\0';
+		printf("%s: %u bytes, bytewise %u cyc, span %u cyc, x%u\n", name, size,
+			bytewise_cycles, span_cycles, span_cycles ? bytewise_cycles / span_cycles : 0);
+	}
+	return result;
+}
+
+
+/*
+ * read_dentry_by_name_scan
+ *   DESCRIPTION: Reference copy of the original linear strncmp scan over the boot block, used as the
+ *                baseline for dentry_lookup_bench.
+ *   INPUTS: fname: file name to find
+ *   OUTPUTS: none
+ *   RETURN VALUE: dentry index, -1 if not found
+ *   SIDE EFFECTS: none
+ */
+static int32_t read_dentry_by_name_scan(const uint8_t *fname) {
+	uint32_t i;
+	for (i = 0; i < g_boot_block->num_dir_entries; i++) {
+		if (strncmp((const int8_t *)fname, (const int8_t *)g_boot_block->dir_entries[i].name, MAX_FILE_NAME) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/*
+ * dentry_lookup_bench_image
+ *   DESCRIPTION: Looks up every name in the currently initialized image (plus one missing name) with
+ *                the linear scan and with read_dentry_by_name, and prints the average cycles per lookup.
+ *   INPUTS: label: image name to print
+ *   OUTPUTS: One line with both averages
+ *   RETURN VALUE: PASS if both lookups return the same index for every name, FAIL otherwise
+ *   SIDE EFFECTS: none
+ */
+static int dentry_lookup_bench_image(int8_t *label) {
+	int result = PASS;
+	uint8_t name[MAX_FILE_NAME + 1];
+	uint8_t missing[] = "no_such_file";
+	dir_entry_t dentry;
+	uint32_t i, iter, start;
+	uint32_t scan_cycles = 0;
+	uint32_t hash_cycles = 0;
+	uint32_t lookups = 0;
+
+	for (iter = 0; iter < BENCH_ITERATIONS; iter++) {
+		for (i = 0; i <= g_boot_block->num_dir_entries; i++) {
+			const uint8_t *fname = missing; // The final pass looks up a name that is not present
+			if (i < g_boot_block->num_dir_entries) {
+				strncpy((int8_t*)name, (int8_t*)g_boot_block->dir_entries[i].name, MAX_FILE_NAME);
+				name[MAX_FILE_NAME] = '\0';
+				fname = name;
+			}
+
+			start = rdtsc();
+			int32_t scan_idx = read_dentry_by_name_scan(fname);
+			scan_cycles += rdtsc() - start;
+
+			start = rdtsc();
+			int32_t hash_idx = read_dentry_by_name(fname, &dentry);
+			hash_cycles += rdtsc() - start;
+
+			if (scan_idx != hash_idx) {
+				result = FAIL;
+			}
+			lookups++;
+		}
+	}
+
+	printf("%s: %u entries, scan %u cyc/lookup, hash %u cyc/lookup\n", label,
+		g_boot_block->num_dir_entries, scan_cycles / lookups, hash_cycles / lookups);
+	return result;
+}
+
+/*
+ * dentry_lookup_bench
+ *   DESCRIPTION: Compares name lookup latency of the linear scan against the hashed index, first on
+ *                filesys_img and then on a synthetic boot block holding the maximum MAX_FILES entries.
+ *   INPUTS: none
+ *   OUTPUTS: One line per image with cycle counts
+ *   RETURN VALUE: PASS if both lookups agree on both images, FAIL otherwise
+ *   SIDE EFFECTS: Temporarily points the file system at the synthetic image, then restores filesys_img
+ */
+int dentry_lookup_bench() {
+	TEST_HEADER;
+
+	static boot_block_t synthetic __attribute__((aligned(BLOCK_SIZE)));
+	uint8_t *real_image = (uint8_t*)g_boot_block;
+	int result = dentry_lookup_bench_image("filesys_img");
+
+	// Fill every directory slot; names share a long prefix so strncmp has to work for each miss
+	uint32_t i;
+	memset(&synthetic, 0, sizeof(synthetic));
+	synthetic.num_dir_entries = MAX_FILES;
+	for (i = 0; i < MAX_FILES; i++) {
+		strcpy((int8_t*)synthetic.dir_entries[i].name, "synthetic_directory_entry_");
+		synthetic.dir_entries[i].name[26] = '0' + i / 10;
+		synthetic.dir_entries[i].name[27] = '0' + i % 10;
+		synthetic.dir_entries[i].file_type = FILE_TYPE_REG;
+	}
+
+	fileSystem_init((uint8_t*)&synthetic);
+	if (dentry_lookup_bench_image("synthetic full directory") != PASS) {
+		result = FAIL;
+	}
+	fileSystem_init(real_image);
+
+	return result;
+}
+
+#define PIT_CH2_PORT      0x42
+#define PIT_CMD_PORT      0x43
+#define PIT_GATE_PORT     0x61
+#define TSC_CAL_MS        10    // Length of the PIT window used to calibrate the TSC
+
+/*
+ * tsc_calibrate
+ *   DESCRIPTION: Measures the TSC rate by counting cycles across a TSC_CAL_MS one-shot countdown on
+ *                PIT channel 2 (the speaker channel, so the scheduler tick on channel 0 is untouched).
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Sets tsc_mhz, reprograms PIT channel 2
+ */
+static void tsc_calibrate() {
+	uint32_t latch = PIT_FREQ / 1000 * TSC_CAL_MS;
+	uint32_t start;
+
+	outb((inb(PIT_GATE_PORT) & ~0x02) | 0x01, PIT_GATE_PORT); // Gate channel 2 on, speaker off
+	outb(0xB0, PIT_CMD_PORT); // Channel 2, lobyte/hibyte, mode 0 (interrupt on terminal count)
+	outb(latch & 0xFF, PIT_CH2_PORT);
+	outb(latch >> 8, PIT_CH2_PORT);
+
+	start = rdtsc();
+	while (!(inb(PIT_GATE_PORT) & 0x20)); // Channel 2 output goes high at terminal count
+	tsc_mhz = (rdtsc() - start) / (TSC_CAL_MS * 1000);
+	if (tsc_mhz == 0) {
+		tsc_mhz = 1;
+	}
+}
+
+/*
+ * fs_bench
+ *   DESCRIPTION: File system throughput harness, meant as a quick regression gate for file_sys.c work:
+ *                fs_bench_run's benchmarks, timed with the TSC. The same benchmarks run on a Linux host
+ *                with `make fs_bench_host` (see host/fs_host.c).
+ *   INPUTS: none
+ *   OUTPUTS: The TSC rate, then one line per benchmark
+ *   RETURN VALUE: PASS if every read returned the expected byte count, FAIL otherwise
+ *   SIDE EFFECTS: Reprograms PIT channel 2 (see tsc_calibrate)
+ */
+int fs_bench() {
+	TEST_HEADER;
+
+	tsc_calibrate();
+	printf("TSC: %u MHz\n", tsc_mhz);
+	return fs_bench_run() == 0 ? PASS : FAIL;
+}
+
+#define CAT_FILE       "verylargetextwithverylongname.tx" // Names are stored truncated to 32 chars
+#define CAT_CHUNK      1024                                 // Buffer size ece391cat used with read/write
+
+/*
+ * sendfile_bench
+ *   DESCRIPTION: Times `cat verylargetextwithverylongname.txt` both ways: the old read/write loop
+ *                (read_data into a 1kB buffer, then terminal_write from it) against send_data, which
+ *                sendfile uses to hand file system spans straight to terminal_write. The syscall traps
+ *                the old loop also paid (two per 1kB) are not included, so this understates the gain.
+ *   INPUTS: none
+ *   OUTPUTS: The file twice, then one result line per method
+ *   RETURN VALUE: PASS if both methods printed the whole file, FAIL otherwise
+ *   SIDE EFFECTS: Prints to and clears the screen, reprograms PIT channel 2 (see tsc_calibrate)
+ */
+int sendfile_bench() {
+	TEST_HEADER;
+
+	dir_entry_t dentry;
+	uint32_t start, cycles_rw, cycles_send, offset, size;
+	uint32_t bytes_rw = 0;
+	int32_t ret;
+
+	if (read_dentry_by_name((uint8_t*)CAT_FILE, &dentry) == -1) {
+		return FAIL;
+	}
+	size = g_inodes[dentry.inode_num].size;
+	tsc_calibrate();
+
+	// Before: read into a buffer, then write the buffer out
+	clear();
+	offset = 0;
+	start = rdtsc();
+	while ((ret = read_data(dentry.inode_num, offset, bench_buf, CAT_CHUNK)) > 0) {
+		offset += ret;
+		bytes_rw += terminal_write(1, bench_buf, ret);
+	}
+	cycles_rw = rdtsc() - start;
+
+	// After: stream spans from the file system image
+	clear();
+	offset = 0;
+	start = rdtsc();
+	ret = send_data(dentry.inode_num, &offset, size, 1, terminal_write);
+	cycles_send = rdtsc() - start;
+
+	clear();
+	printf("cat %s (%u bytes), TSC: %u MHz\n", CAT_FILE, size, tsc_mhz);
+	bench_report("read + write", cycles_rw, 1, bytes_rw);
+	bench_report("sendfile", cycles_send, 1, ret > 0 ? ret : 0);
+
+	return (bytes_rw == size && ret == size) ? PASS : FAIL;
+}
+
+#define CTX_SWITCHES   1024 // Switches per method
+
+/*
+ * ctx_touch_kernel
+ *   DESCRIPTION: Touches the kernel working set a switch lands in: the kernel page, the identity mapped
+ *                4MB pages the frame allocator hands out, and video memory
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: sum of the words read (so the reads aren't optimized away)
+ *   SIDE EFFECTS: Fills the TLB
+ */
+static uint32_t ctx_touch_kernel() {
+	uint32_t addr, sum = 0;
+	for (addr = LARGE_PAGE_SIZE; addr < FRAME_MEM_END; addr += LARGE_PAGE_SIZE) {
+		sum += *(volatile uint32_t*)addr;
+	}
+	return sum + *(volatile uint32_t*)VID_MEM_PHYSICAL;
+}
+
+/*
+ * context_switch_bench
+ *   DESCRIPTION: Compares the address space switch the scheduler used to do (patch pdt[32] and the vidmap
+ *                table in the shared directory, then two full TLB flushes) with loading a per-process page
+ *                directory whose kernel entries are global. Each switch is followed by a pass over the kernel
+ *                working set, so the cost of refilling the TLB is counted too.
+ *   INPUTS: none
+ *   OUTPUTS: ns per switch for each method
+ *   RETURN VALUE: PASS
+ *   SIDE EFFECTS: Builds and frees two throwaway address spaces, reloads pdt, reprograms PIT channel 2 (see tsc_calibrate)
+ */
+int context_switch_bench() {
+	TEST_HEADER;
+
+	uint32_t i, start, cycles_old, cycles_new;
+	uint32_t saved_user_pde = pdt[USER_PDT_IDX];
+	uint32_t sum = 0;
+	static ProcessControlBlock ctx[2]; // Only the page directory fields are used
+
+	tsc_calibrate();
+	if (user_paging_setup(&ctx[0]) == -1 || user_paging_setup(&ctx[1]) == -1) {
+		load_page_directory(pdt);
+		user_paging_destroy(&ctx[0]);
+		return FAIL;
+	}
+
+	// Before: one shared directory, entries rewritten on every switch
+	load_page_directory(pdt);
+	start = rdtsc();
+	for (i = 0; i < CTX_SWITCHES; i++) {
+		pdt[USER_PDT_IDX] = ctx[i & 1].pageDirectory[USER_PDT_IDX];
+		tlb_flush_global(); // What each CR3 reload cost before kernel mappings were global
+		pt_vidmap[0][0] = pt_vidmap[(i & 1) + 1][0];
+		tlb_flush_global();
+		sum += ctx_touch_kernel();
+	}
+	cycles_old = rdtsc() - start;
+	pdt[USER_PDT_IDX] = saved_user_pde;
+	vidmap_display(cur_terminal);
+
+	// After: a single CR3 load
+	start = rdtsc();
+	for (i = 0; i < CTX_SWITCHES; i++) {
+		user_paging_switch(&ctx[i & 1]);
+		sum += ctx_touch_kernel();
+	}
+	cycles_new = rdtsc() - start;
+
+	load_page_directory(pdt);
+	user_paging_destroy(&ctx[0]);
+	user_paging_destroy(&ctx[1]);
+
+	printf("TSC: %u MHz (checksum %x)\n", tsc_mhz, sum);
+	bench_report("patch pdt + flush x2", cycles_old, CTX_SWITCHES, 0);
+	bench_report("per-process cr3", cycles_new, CTX_SWITCHES, 0);
+	return PASS;
+}
+
+#define IRQ_BENCH_ROUNDS 4096 // Interrupts (and EOIs) per measurement
+
+/*
+ * irq_bench
+ *   DESCRIPTION: Measures what an interrupt costs from entry to EOI: a round trip through the common
+ *                INT_LINKAGE entry and exc_handler (int $0xFF, the APIC spurious vector, which exc_handler
+ *                ignores), plus the EOI on the 8259 (port I/O, as send_eoi did for every interrupt) and, if
+ *                apic_init found one, the local APIC (an MMIO write). The EOIs are sent with nothing in
+ *                service (IRQ 7 on the 8259), which costs the controller the same.
+ *   INPUTS: none
+ *   OUTPUTS: ns per operation, and the entry to EOI total for each controller
+ *   RETURN VALUE: PASS
+ *   SIDE EFFECTS: Interrupts are off while it runs, reprograms PIT channel 2 (see tsc_calibrate)
+ */
+int irq_bench() {
+	TEST_HEADER;
+
+	uint32_t i, start, flags;
+	uint32_t cycles_entry, cycles_8259, cycles_apic = 0;
+
+	tsc_calibrate();
+	cli_and_save(flags);
+
+	start = rdtsc();
+	for (i = 0; i < IRQ_BENCH_ROUNDS; i++) {
+		asm volatile ("int $0xFF" : : : "memory");
+	}
+	cycles_entry = rdtsc() - start;
+
+	start = rdtsc();
+	for (i = 0; i < IRQ_BENCH_ROUNDS; i++) {
+		outb(EOI + 7, MASTER_8259_PORT);
+	}
+	cycles_8259 = rdtsc() - start;
+
+	if (apic_enabled) {
+		start = rdtsc();
+		for (i = 0; i < IRQ_BENCH_ROUNDS; i++) {
+			apic_eoi();
+		}
+		cycles_apic = rdtsc() - start;
+	}
+	restore_flags(flags);
+
+	printf("TSC: %u MHz, interrupts via the %s\n", tsc_mhz, apic_enabled ? "APIC" : "8259");
+	bench_report("int entry + iret", cycles_entry, IRQ_BENCH_ROUNDS, 0);
+	bench_report("8259 EOI", cycles_8259, IRQ_BENCH_ROUNDS, 0);
+	bench_report("entry to 8259 EOI", cycles_entry + cycles_8259, IRQ_BENCH_ROUNDS, 0);
+	if (apic_enabled) {
+		bench_report("APIC EOI", cycles_apic, IRQ_BENCH_ROUNDS, 0);
+		bench_report("entry to APIC EOI", cycles_entry + cycles_apic, IRQ_BENCH_ROUNDS, 0);
+	}
+	return PASS;
+}
+
 /* Test suite entry point */
 void launch_tests(){
 	disable_irq(8);
@@ -452,7 +1343,7 @@ void launch_tests(){
 	// paging_setup_test(0x3FFFFF); // below kernal page
 
 	// paging_setup_test(0x7FFFFF); // end of kernal page
-	// paging_setup_test(0x800000); // above end of kernal page
+	// paging_setup_test(0x800000); // above end of kernal page (mapped supervisor-only for the frame allocator)
 
 	/* Syscall and Keyboard Echo Testing*/
 
@@ -515,5 +1406,39 @@ void launch_tests(){
 	
 	// // Attempt and fail to write to a directory
 	// dir_write_test(write);
-	
+
+	/* --------------Frame Allocator Tests-------------- */
+
+	// TEST_OUTPUT("frame_alloc_test", frame_alloc_test());
+	// TEST_OUTPUT("tlb_invalidate_test", tlb_invalidate_test());
+
+	/* --------------Kernel Heap Tests-------------- */
+
+	// TEST_OUTPUT("kmalloc_test", kmalloc_test());
+
+	/* --------------Process Table Tests-------------- */
+
+	// TEST_OUTPUT("process_table_test", process_table_test());
+
+	/* --------------Shared Memory Tests-------------- */
+
+	// TEST_OUTPUT("shm_test", shm_test());
+
+	/* --------------Timer Tests-------------- */
+
+	// TEST_OUTPUT("timer_test", timer_test());
+
+	/* --------------SMP Tests-------------- */
+
+	// TEST_OUTPUT("smp_test", smp_test());
+	// TEST_OUTPUT("sysenter_test", sysenter_test());
+
+	/* --------------Performance Benchmarks-------------- */
+
+	// TEST_OUTPUT("read_data_bench", read_data_bench());
+	// TEST_OUTPUT("dentry_lookup_bench", dentry_lookup_bench());
+	// TEST_OUTPUT("fs_bench", fs_bench());
+	// TEST_OUTPUT("sendfile_bench", sendfile_bench());
+	// TEST_OUTPUT("context_switch_bench", context_switch_bench());
+	// TEST_OUTPUT("irq_bench", irq_bench());
 }
@@ -0,0 +1,305 @@
+#include "timer.h"
+#include "pit.h"
+#include "wait_queue.h"
+#include "lib.h"
+
+#define TIMER_ROOT_MASK   (TIMER_ROOT_SIZE - 1)
+#define TIMER_LEVEL_MASK  (TIMER_LEVEL_SIZE - 1)
+#define TIMER_MAX_TICKS   0x7FFF0000            // Longer delays are clamped (about 24 days), well short of the
+                                                // 2^31 ticks at which timer_link would see them as overdue
+
+// Hierarchical timer wheel. A timer due within TIMER_ROOT_SIZE ticks sits in the root slot for its tick;
+// later ones sit in a coarser level, and are cascaded down a level each time the one below wraps around
+// to their slot. Adding and cancelling are O(1), and a tick only looks at its own slot.
+static ktimer_t* timer_root[TIMER_ROOT_SIZE];
+static ktimer_t* timer_level[TIMER_LEVELS][TIMER_LEVEL_SIZE];
+static uint32_t timer_jiffies = 0;    // Next tick to run
+static uint32_t timer_due_us = 0;     // pit_time_us() when tick timer_jiffies is due
+static uint32_t timer_count = 0;      // Pending timers
+
+/*
+ * timer_init
+ *   DESCRIPTION: Starts the wheel at the current time
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Must run after pit_init and before interrupts are enabled
+ */
+void timer_init() {
+    timer_jiffies = 0;
+    timer_due_us = pit_time_us() + TIMER_TICK_US;
+    timer_count = 0;
+}
+
+/*
+ * timer_setup
+ *   DESCRIPTION: Prepares a timer for timer_add
+ *   INPUTS: timer - timer to set up, not pending
+ *           func - callback, run from the PIT interrupt with interrupts disabled
+ *           data - argument for func
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void timer_setup(ktimer_t* timer, timer_func func, void* data) {
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->expires = 0;
+    timer->func = func;
+    timer->data = data;
+}
+
+/*
+ * timer_link
+ *   DESCRIPTION: Puts a timer in the slot for its expiry: the root for the next TIMER_ROOT_SIZE ticks,
+ *                otherwise the lowest level whose range reaches it. Already expired timers go in the slot
+ *                of the next tick.
+ *   INPUTS: timer - timer with expires set, not linked
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Called with interrupts disabled
+ */
+static void timer_link(ktimer_t* timer) {
+    uint32_t expires = timer->expires;
+    uint32_t delta = expires - timer_jiffies;
+    uint32_t level, shift;
+    ktimer_t** slot;
+
+    if ((int32_t)delta < 0) {
+        slot = &timer_root[timer_jiffies & TIMER_ROOT_MASK];
+    } else if (delta < TIMER_ROOT_SIZE) {
+        slot = &timer_root[expires & TIMER_ROOT_MASK];
+    } else {
+        for (level = 0, shift = TIMER_ROOT_BITS; level < TIMER_LEVELS - 1; level++, shift += TIMER_LEVEL_BITS) {
+            if (delta < (1U << (shift + TIMER_LEVEL_BITS))) {
+                break;
+            }
+        }
+        slot = &timer_level[level][(expires >> shift) & TIMER_LEVEL_MASK];
+    }
+
+    timer->next = *slot;
+    if (timer->next != NULL) {
+        timer->next->pprev = &timer->next;
+    }
+    *slot = timer;
+    timer->pprev = slot;
+}
+
+/*
+ * timer_unlink
+ *   DESCRIPTION: Takes a pending timer out of its slot
+ *   INPUTS: timer - pending timer
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Called with interrupts disabled
+ */
+static void timer_unlink(ktimer_t* timer) {
+    *timer->pprev = timer->next;
+    if (timer->next != NULL) {
+        timer->next->pprev = timer->pprev;
+    }
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+/*
+ * timer_add
+ *   DESCRIPTION: Arms a timer to call its function after a delay, rearming it if it's already pending.
+ *                It fires on the first tick at least delay_ms from now (at most TIMER_MAX_TICKS ticks).
+ *   INPUTS: timer - timer from timer_setup
+ *           delay_ms - milliseconds to wait
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: May move the PIT deadline earlier
+ */
+void timer_add(ktimer_t* timer, uint32_t delay_ms) {
+    uint32_t flags;
+    uint32_t ticks = delay_ms / (TIMER_TICK_US / 1000); // Not delay_ms * 1000, which overflows past 71 minutes
+    int32_t behind;
+
+    if (ticks > TIMER_MAX_TICKS) {
+        ticks = TIMER_MAX_TICKS;
+    }
+    cli_and_save(flags);
+    if (timer_pending(timer)) {
+        timer_unlink(timer);
+    } else {
+        timer_count++;
+    }
+    // The wheel only catches up in pit_handler, so count from the tick that's really next
+    behind = (int32_t)(pit_time_us() - timer_due_us);
+    if (behind >= 0) {
+        ticks += behind / TIMER_TICK_US + 1;
+        if (ticks > TIMER_MAX_TICKS) {
+            ticks = TIMER_MAX_TICKS;
+        }
+    }
+    timer->expires = timer_jiffies + ticks;
+    timer_link(timer);
+    pit_deadline_changed();
+    restore_flags(flags);
+}
+
+/*
+ * timer_cancel
+ *   DESCRIPTION: Disarms a timer. Once this returns its function won't be called.
+ *   INPUTS: timer - timer from timer_setup
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the timer was pending, 0 if it had already fired or was never added
+ *   SIDE EFFECTS: none
+ */
+int timer_cancel(ktimer_t* timer) {
+    uint32_t flags;
+    int pending;
+
+    cli_and_save(flags);
+    pending = timer_pending(timer);
+    if (pending) {
+        timer_unlink(timer);
+        timer_count--;
+    }
+    restore_flags(flags);
+    return pending;
+}
+
+/*
+ * timer_cascade
+ *   DESCRIPTION: Moves every timer in one slot of a level down to where it now belongs
+ *   INPUTS: level - level above the root (0 is the first)
+ *           index - slot in that level
+ *   OUTPUTS: none
+ *   RETURN VALUE: index, so the caller can tell whether the level wrapped too
+ *   SIDE EFFECTS: Called with interrupts disabled
+ */
+static uint32_t timer_cascade(uint32_t level, uint32_t index) {
+    ktimer_t* timer = timer_level[level][index];
+
+    timer_level[level][index] = NULL;
+    while (timer != NULL) {
+        ktimer_t* next = timer->next;
+        timer_link(timer);
+        timer = next;
+    }
+    return index;
+}
+
+/*
+ * timer_tick
+ *   DESCRIPTION: Runs tick timer_jiffies: cascades the levels above if the root wrapped, then calls every
+ *                timer in the tick's root slot. A callback may add timers, including itself; they land in
+ *                later slots.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Called with interrupts disabled
+ */
+static void timer_tick() {
+    uint32_t index = timer_jiffies & TIMER_ROOT_MASK;
+    uint32_t level, shift;
+    ktimer_t* timer;
+
+    if (index == 0) {
+        for (level = 0, shift = TIMER_ROOT_BITS; level < TIMER_LEVELS; level++, shift += TIMER_LEVEL_BITS) {
+            if (timer_cascade(level, (timer_jiffies >> shift) & TIMER_LEVEL_MASK) != 0) {
+                break;
+            }
+        }
+    }
+    timer_jiffies++;
+
+    while ((timer = timer_root[index]) != NULL) {
+        timer_unlink(timer);
+        timer_count--;
+        timer->func(timer->data);
+    }
+}
+
+/*
+ * timer_run
+ *   DESCRIPTION: Runs every tick that's due by now. Called from pit_handler, so with the tickless PIT this
+ *                can be many ticks at once; while no timer is pending they're skipped without looking.
+ *   INPUTS: now - pit_time_us()
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Calls timer functions. Called with interrupts disabled.
+ */
+void timer_run(uint32_t now) {
+    uint32_t ticks;
+
+    while ((int32_t)(now - timer_due_us) >= 0) {
+        if (timer_count == 0) {
+            ticks = (now - timer_due_us) / TIMER_TICK_US + 1;
+            timer_jiffies += ticks;
+            timer_due_us += ticks * TIMER_TICK_US;
+            break;
+        }
+        timer_tick();
+        timer_due_us += TIMER_TICK_US;
+    }
+}
+
+/*
+ * timer_next_us
+ *   DESCRIPTION: How long until the wheel next has work: a tick whose root slot holds timers, or a root
+ *                wrap that cascades the levels above. Looks at one slot per tick, so limit should be short
+ *                (the PIT's longest countdown).
+ *   INPUTS: now - pit_time_us()
+ *           limit - longest answer wanted, in microseconds
+ *   OUTPUTS: none
+ *   RETURN VALUE: microseconds until then (0 if overdue), or limit if nothing happens before it
+ *   SIDE EFFECTS: Called with interrupts disabled
+ */
+uint32_t timer_next_us(uint32_t now, uint32_t limit) {
+    int32_t until = (int32_t)(timer_due_us - now);
+    uint32_t tick;
+
+    if (timer_count == 0) {
+        return limit;
+    }
+    if (until < 0) {
+        return 0;
+    }
+    for (tick = timer_jiffies; (uint32_t)until < limit; tick++, until += TIMER_TICK_US) {
+        if (timer_root[tick & TIMER_ROOT_MASK] != NULL || (tick & TIMER_ROOT_MASK) == 0) {
+            return until;
+        }
+    }
+    return limit;
+}
+
+/*
+ * timer_wake
+ *   DESCRIPTION: Timer function for timer_sleep_ms: wakes the sleeper
+ *   INPUTS: data - the sleeper's wait queue
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void timer_wake(void* data) {
+    wait_queue_wake((wait_queue_t*)data);
+}
+
+/*
+ * timer_sleep_ms
+ *   DESCRIPTION: Blocks the current process for at least ms milliseconds (rounded up to the next tick).
+ *                The timer and the wait queue live on its kernel stack.
+ *   INPUTS: ms - milliseconds to sleep
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0
+ *   SIDE EFFECTS: Runs other processes, or idles, meanwhile
+ */
+int32_t timer_sleep_ms(uint32_t ms) {
+    wait_queue_t queue = { NULL, NULL };
+    ktimer_t timer;
+    uint32_t flags;
+
+    timer_setup(&timer, timer_wake, &queue);
+    cli_and_save(flags);
+    timer_add(&timer, ms);
+    while (timer_pending(&timer)) {
+        wait_queue_sleep(&queue);
+    }
+    restore_flags(flags);
+    return 0;
+}
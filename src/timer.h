@@ -0,0 +1,38 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include "types.h"
+
+#define TIMER_TICK_US     1000                  // Timer resolution: the wheel turns one slot a millisecond
+#define TIMER_ROOT_BITS   8                     // The first level has a slot for each of the next 256 ticks
+#define TIMER_LEVEL_BITS  6                     // Each further level covers 64 times the one below it
+#define TIMER_ROOT_SIZE   (1 << TIMER_ROOT_BITS)
+#define TIMER_LEVEL_SIZE  (1 << TIMER_LEVEL_BITS)
+#define TIMER_LEVELS      4                     // Levels above the root: 8 + 4 * 6 = 32 bits of ticks
+
+typedef void (*timer_func)(void* data);
+
+// A pending callback. Lives wherever its owner keeps it (a stack frame is fine); the wheel only links it.
+typedef struct ktimer_t {
+    struct ktimer_t* next;           // Next timer in the same slot
+    struct ktimer_t** pprev;         // The pointer to this timer in its slot, NULL when not pending
+    uint32_t expires;                // Tick it's due at
+    timer_func func;                 // Called from the PIT interrupt with interrupts disabled
+    void* data;
+} ktimer_t;
+
+// See c file for descriptions
+void timer_init();
+void timer_setup(ktimer_t* timer, timer_func func, void* data);
+void timer_add(ktimer_t* timer, uint32_t delay_ms);
+int timer_cancel(ktimer_t* timer);
+void timer_run(uint32_t now);
+uint32_t timer_next_us(uint32_t now, uint32_t limit);
+int32_t timer_sleep_ms(uint32_t ms);
+
+// Whether a timer is waiting to fire
+static inline int timer_pending(ktimer_t* timer) {
+    return timer->pprev != NULL;
+}
+
+#endif
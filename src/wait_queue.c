@@ -0,0 +1,90 @@
+#include "wait_queue.h"
+#include "kmalloc.h"
+#include "pit.h"
+#include "sys_calls.h"
+#include "lib.h"
+
+static kmem_cache_t wait_cache; // wait_entry_t objects
+
+/*
+ * wait_queue_init
+ *   DESCRIPTION: Creates the kmem cache wait queue entries come from
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Must run after kmalloc_init and before interrupts are enabled
+ */
+void wait_queue_init() {
+    kmem_cache_init(&wait_cache, "wait_entry", sizeof(wait_entry_t));
+}
+
+/*
+ * wait_queue_sleep
+ *   DESCRIPTION: Blocks the current process on a queue until wait_queue_wake runs. While it's blocked the
+ *                scheduler runs other processes, or halts the CPU if none can run. Callers test their
+ *                condition, then sleep, in a loop with interrupts disabled, so a wakeup from an interrupt
+ *                handler can't slip in between the test and the sleep.
+ *   INPUTS: queue - queue to sleep on
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Must be called with interrupts disabled, and returns with them disabled. If no entry
+ *                 can be allocated it only yields, and the caller's loop polls.
+ */
+void wait_queue_sleep(wait_queue_t* queue) {
+    ProcessControlBlock* current_pcb;
+    // Assembly code to get the current PCB
+    // Clear the lower 13 bits then AND with ESP to align it to the 8KB boundary
+    asm volatile (
+        "movl %%esp, %%eax\n"       // Move current ESP value to EAX for manipulation
+        "andl $0xFFFFE000, %%eax\n" // Clear the lower 13 bits to align to 8KB boundary
+        "movl %%eax, %0\n"          // Move the modified EAX value to current_pcb
+        : "=r" (current_pcb)        // Output operands
+        :                            // No input operands
+        : "eax"                      // Clobber list, indicating EAX is modified
+    );
+
+    wait_entry_t* entry = kmem_cache_alloc(&wait_cache);
+    if (entry == NULL) {
+        schedule(); // Out of memory: poll instead
+        return;
+    }
+    entry->pcb = current_pcb;
+    entry->next = NULL;
+    if (queue->tail == NULL) {
+        queue->head = entry;
+    } else {
+        queue->tail->next = entry;
+    }
+    queue->tail = entry;
+
+    current_pcb->state = PROC_BLOCKED;
+    while (current_pcb->state == PROC_BLOCKED) {
+        schedule();
+    }
+}
+
+/*
+ * wait_queue_wake
+ *   DESCRIPTION: Puts every process sleeping on a queue back on the run queue and empties it. Cheap on an
+ *                empty queue, so interrupt handlers call it on every event.
+ *   INPUTS: queue - queue to wake
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Frees the queue's entries
+ */
+void wait_queue_wake(wait_queue_t* queue) {
+    wait_entry_t* entry;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    entry = queue->head;
+    queue->head = NULL;
+    queue->tail = NULL;
+    while (entry != NULL) {
+        wait_entry_t* next = entry->next;
+        sched_wakeup(entry->pcb);
+        kmem_cache_free(&wait_cache, entry);
+        entry = next;
+    }
+    restore_flags(flags);
+}
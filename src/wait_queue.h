@@ -0,0 +1,25 @@
+#ifndef WAIT_QUEUE_H
+#define WAIT_QUEUE_H
+
+#include "types.h"
+
+struct ProcessControlBlock;
+
+// One sleeping process (from the wait entry kmem cache)
+typedef struct wait_entry_t {
+    struct ProcessControlBlock* pcb;
+    struct wait_entry_t* next;
+} wait_entry_t;
+
+// Processes sleeping until some event, woken in FIFO order; all zero is an empty queue
+typedef struct wait_queue_t {
+    wait_entry_t* head;
+    wait_entry_t* tail;
+} wait_queue_t;
+
+// See c file for descriptions
+void wait_queue_init();
+void wait_queue_sleep(wait_queue_t* queue);
+void wait_queue_wake(wait_queue_t* queue);
+
+#endif
@@ -15,6 +15,24 @@
 #define USER_DS     0x002B
 #define KERNEL_TSS  0x0030
 #define KERNEL_LDT  0x0038
+#define AP_TSS      0x0040      /* TSS of CPU 1; CPU n uses AP_TSS + 8 * (n - 1) */
+
+/* CPUs the kernel runs on (see smp.c): the GDT has a TSS for each */
+#define MAX_CPUS    4
+
+/* Page below 1MB the application processors start in, in real mode */
+#define AP_TRAMPOLINE 0x8000
+
+/* SYSENTER/SYSEXIT (see sysenter_linkage): the MSRs that set it up, and the user program window, which
+ * the user stack holding the return address has to be in */
+#define MSR_SYSENTER_CS     0x174
+#define MSR_SYSENTER_ESP    0x175
+#define MSR_SYSENTER_EIP    0x176
+#define SYSENTER_STACK_LOW  0x8000000
+#define SYSENTER_STACK_HIGH 0x8400000
+#define EFLAGS_IF           0x200
+#define SYSCALL_HALT        1                   /* halt's system call number */
+#define HALT_EXCEPTION      256                 /* halt status for a process the kernel kills */
 
 /* Size of the task state segment (TSS) */
 #define TSS_SIZE    104
@@ -24,6 +42,9 @@
 
 #define NUM_DIR_ETRY 1024
 
+/* Number of user video memory page tables (one per terminal) */
+#define NUM_VIDMAP_PT 3
+
 #ifndef ASM
 
 /* This structure is used to load descriptor base registers
@@ -125,6 +146,7 @@ extern uint32_t ldt;
 extern uint32_t tss_size;
 extern seg_desc_t tss_desc_ptr;
 extern tss_t tss;
+extern seg_desc_t ap_tss_desc_ptr[MAX_CPUS - 1];
 
 /* Sets runtime-settable parameters in the GDT entry for the LDT */
 #define SET_LDT_PARAMS(str, addr, lim)                          \
@@ -229,8 +251,9 @@ typedef union pt_entry_t {
 extern uint32_t pdt[NUM_DIR_ETRY] __attribute__((aligned(4096)));
 // The page table for the first 4mb of physical memory
 extern uint32_t pt0[NUM_DIR_ETRY] __attribute__((aligned(4096)));
-// The page table for user-space video memory (starting at 136MB point)
-extern uint32_t pt_vidmap[NUM_DIR_ETRY] __attribute__((aligned(4096)));
+// The page tables for user-space video memory (starting at 136MB point), one per terminal
+extern uint32_t pt_vidmap[NUM_VIDMAP_PT][NUM_DIR_ETRY] __attribute__((aligned(4096)));
+
 
 
 /* Sets runtime parameters for an IDT entry */
@@ -0,0 +1,89 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define BUFSIZE 128
+#define DEFAULT_SECONDS 5
+#define MAX_SECONDS 3600
+#define RTC_HZ 2            /* Samples are taken every RTC_HZ ticks: once a second */
+
+static void
+put_num (uint32_t value)
+{
+    uint8_t num[BUFSIZE];
+
+    ece391_itoa (value, num, 10);
+    ece391_fdputs (1, num);
+}
+
+/*
+ * Prints CPU utilization once a second for the given number of seconds:
+ * the share of the second the CPUs weren't halted in the kernel's idle
+ * contexts (100% is all of them busy), and the timer interrupt rate.  It sleeps on the RTC between
+ * samples, so it barely shows up itself.  Run it in one terminal and a
+ * workload in another.
+ */
+int main ()
+{
+    uint8_t args[BUFSIZE];
+    struct ece391_cpustat prev, now;
+    int32_t seconds = 0;
+    int32_t rtc_fd, garbage, freq = RTC_HZ;
+    int32_t i, j;
+    uint32_t busy_permille, elapsed, capacity, idle;
+
+    if (0 == ece391_getargs (args, BUFSIZE)) {
+        for (i = 0; args[i] >= '0' && args[i] <= '9'; i++) {
+            seconds = seconds * 10 + (args[i] - '0');
+        }
+    }
+    if (seconds <= 0 || seconds > MAX_SECONDS) {
+        seconds = DEFAULT_SECONDS;
+    }
+
+    if (-1 == (rtc_fd = ece391_open ((uint8_t*)"rtc"))) {
+        ece391_fdputs (1, (uint8_t*)"cpustat: can't open the RTC\n");
+        return 3;
+    }
+    ece391_write (rtc_fd, &freq, 4);
+
+    ece391_cpustat (&prev);
+    for (i = 0; i < seconds; i++) {
+        for (j = 0; j < RTC_HZ; j++) {
+            ece391_read (rtc_fd, &garbage, 4);
+        }
+        ece391_cpustat (&now);
+
+        elapsed = now.uptime_us - prev.uptime_us;
+        capacity = elapsed * (now.cpus != 0 ? now.cpus : 1);
+        idle = now.idle_us - prev.idle_us;
+        if (idle > capacity) {
+            idle = capacity;
+        }
+        busy_permille = capacity >= 1000 ? (capacity - idle) / (capacity / 1000) : 0;
+        if (busy_permille > 1000) {
+            busy_permille = 1000;
+        }
+
+        ece391_fdputs (1, (uint8_t*)"busy ");
+        put_num (busy_permille / 10);
+        ece391_fdputs (1, (uint8_t*)".");
+        put_num (busy_permille % 10);
+        ece391_fdputs (1, (uint8_t*)"%  idle ");
+        put_num (idle);
+        ece391_fdputs (1, (uint8_t*)"us of ");
+        put_num (capacity);
+        ece391_fdputs (1, (uint8_t*)"us on ");
+        put_num (now.cpus);
+        ece391_fdputs (1, (uint8_t*)" cpus  timer irqs ");
+        put_num ((now.pit_irqs - prev.pit_irqs) * 1000 / (elapsed / 1000 + 1));
+        ece391_fdputs (1, (uint8_t*)"/s (");
+        put_num (now.idle_irqs - prev.idle_irqs);
+        ece391_fdputs (1, (uint8_t*)" idle)\n");
+        prev = now;
+    }
+
+    ece391_close (rtc_fd);
+    return 0;
+}
@@ -0,0 +1,62 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define HEAP_PAGES 4
+#define PAGE_SIZE 4096
+
+/*
+ * Checks copy-on-write fork: the parent fills a stack variable and a few
+ * heap pages, forks, and the child overwrites all of them.  The child
+ * must see its own writes and the parent must still see its old values
+ * however the two are scheduled.
+ */
+int main ()
+{
+    uint8_t num[16];
+    uint8_t* heap;
+    int32_t stack_value = 391;
+    int32_t pid, i;
+
+    if (ECE391_MEM_FAILED == (heap = ece391_sbrk (HEAP_PAGES * PAGE_SIZE))) {
+        ece391_fdputs (1, (uint8_t*)"fork: out of memory\n");
+        return 3;
+    }
+    for (i = 0; i < HEAP_PAGES; i++) {
+        heap[i * PAGE_SIZE] = 'p';
+    }
+
+    pid = ece391_fork ();
+    if (-1 == pid) {
+        ece391_fdputs (1, (uint8_t*)"fork: fork failed\n");
+        return 2;
+    }
+
+    if (0 == pid) {
+        stack_value = 0;
+        for (i = 0; i < HEAP_PAGES; i++) {
+            heap[i * PAGE_SIZE] = 'c';
+        }
+        for (i = 0; i < HEAP_PAGES; i++) {
+            if ('c' != heap[i * PAGE_SIZE] || 0 != stack_value) {
+                ece391_fdputs (1, (uint8_t*)"fork: child lost a write\n");
+                return 1;
+            }
+        }
+        ece391_fdputs (1, (uint8_t*)"fork: child done\n");
+        return 0;
+    }
+
+    for (i = 0; i < HEAP_PAGES; i++) {
+        if ('p' != heap[i * PAGE_SIZE] || 391 != stack_value) {
+            ece391_fdputs (1, (uint8_t*)"fork: child wrote to the parent's memory\n");
+            return 1;
+        }
+    }
+    ece391_itoa (pid, num, 10);
+    ece391_fdputs (1, (uint8_t*)"fork: parent memory intact, child PID ");
+    ece391_fdputs (1, num);
+    ece391_fdputs (1, (uint8_t*)"\n");
+    return 0;
+}
@@ -5,12 +5,17 @@
 
 #define BUFSIZE 1024
 #define SBUFSIZE 33
+#define NRECORDS 16
+#define FILE_TYPE_REG 2
+
+/* line buffer on the heap, doubled by sbrk whenever a line doesn't fit */
+static uint8_t* data;
+static int32_t data_size;
 
 int32_t
 do_one_file (const char* s, const char* fname) 
 {
     int32_t fd, cnt, last, line_start, line_end, check, s_len;
-    uint8_t data[BUFSIZE+1];
 
     s_len = ece391_strlen ((uint8_t*)s);
     if (-1 == (fd = ece391_open ((uint8_t*)fname))) {
@@ -19,7 +24,7 @@ do_one_file (const char* s, const char* fname)
     }
     last = 0;
     while (1) {
-        cnt = ece391_read (fd, data + last, BUFSIZE - last);
+        cnt = ece391_read (fd, data + last, data_size - last);
 	if (-1 == cnt) {
             ece391_fdputs (1, (uint8_t*)"file read failed\n");
             return -1;
@@ -30,13 +35,20 @@ do_one_file (const char* s, const char* fname)
 	    line_end = line_start;
 	    while (line_end < last && '\n' != data[line_end])
 		line_end++;
-	    if ('\n' != data[line_end] && 0 != cnt && line_start != 0) {
+	    if (line_end == last && 0 != cnt && line_start != 0) {
 		/* copy from line_start to last down to 0 and fix last */
 		data[line_end] = '\0';
 		ece391_strcpy (data, data + line_start);
 		last -= line_start;
 		break;
 	    }
+	    if (line_end == last && 0 != cnt && (last < data_size ||
+		ECE391_MEM_FAILED != ece391_sbrk (data_size))) {
+		/* the line fills the buffer: double it and read the rest */
+		if (last == data_size)
+		    data_size *= 2;
+		break;
+	    }
 	    /* search the line */
 	    data[line_end] = '\0';
 	    for (check = line_start; check < line_end; check++) {
@@ -67,7 +79,8 @@ do_one_file (const char* s, const char* fname)
 
 int main ()
 {
-    int32_t fd, cnt;
+    int32_t fd, cnt, i, j;
+    struct ece391_dirent records[NRECORDS];
     uint8_t buf[SBUFSIZE];
     uint8_t search[BUFSIZE];
 
@@ -76,21 +89,32 @@ int main ()
         return 3;
     }
 
+    data_size = BUFSIZE;
+    if (ECE391_MEM_FAILED == (data = ece391_sbrk (data_size + 1))) {
+        ece391_fdputs (1, (uint8_t*)"out of memory\n");
+        return 3;
+    }
+
     if (-1 == (fd = ece391_open ((uint8_t*)"."))) {
         ece391_fdputs (1, (uint8_t*)"directory open failed\n");
 	return 2;
     }
 
-    while (0 != (cnt = ece391_read (fd, buf, SBUFSIZE-1))) {
+    /* one getdents call returns up to NRECORDS entries, types included */
+    while (0 != (cnt = ece391_getdents (fd, records, sizeof (records)))) {
         if (-1 == cnt) {
 	    ece391_fdputs (1, (uint8_t*)"directory entry read failed\n");
 	    return 3;
 	}
-	if ('.' == buf[0]) /* a directory... */
-	    continue;
-	buf[cnt] = '\0';
-	if (0 != do_one_file ((char*)search, (char*)buf))
-	    return 3;
+	for (i = 0; i < cnt / (int32_t)sizeof (struct ece391_dirent); i++) {
+	    if (FILE_TYPE_REG != records[i].file_type) /* a directory or device... */
+		continue;
+	    for (j = 0; j < ECE391_NAME_LEN && '\0' != records[i].name[j]; j++)
+		buf[j] = records[i].name[j];
+	    buf[j] = '\0';
+	    if (0 != do_one_file ((char*)search, (char*)buf))
+		return 3;
+	}
     }
 
     return 0;
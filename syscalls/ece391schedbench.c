@@ -0,0 +1,204 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define BUFSIZE 128
+#define SHM_KEY 0x5CED
+#define RTC_HZ 32             /* Interactive wakeups per second */
+#define DEFAULT_SECONDS 5
+#define MAX_SECONDS 60
+#define INTERACTIVE_WORK 2000 /* Loop iterations per interactive wakeup */
+#define NUM_WORKERS 4
+
+/* Shared with the workers: the stop flag and how far each one got */
+struct bench_shared {
+    volatile int32_t stop;
+    volatile uint32_t loops[NUM_WORKERS];
+};
+
+struct worker {
+    const char* name;
+    int32_t nice;
+    int32_t interactive;   /* Sleeps on the RTC instead of spinning */
+    int32_t pid;
+    struct ece391_schedstat start;
+    struct ece391_schedstat end;
+};
+
+static struct worker workers[NUM_WORKERS] = {
+    { "cpu     ", 0, 0 },
+    { "cpu     ", 0, 0 },
+    { "cpu     ", 5, 0 },
+    { "interact", 0, 1 },
+};
+
+/* Weights of the nice values used above, as in the kernel's table */
+static uint32_t
+nice_weight (int32_t nice)
+{
+    return 0 == nice ? 1024 : 335;
+}
+
+static void
+put_num (uint32_t value)
+{
+    uint8_t num[BUFSIZE];
+
+    ece391_itoa (value, num, 10);
+    ece391_fdputs (1, num);
+}
+
+/* Prints permille as a percentage with one decimal */
+static void
+put_percent (uint32_t permille)
+{
+    put_num (permille / 10);
+    ece391_fdputs (1, (uint8_t*)".");
+    put_num (permille % 10);
+    ece391_fdputs (1, (uint8_t*)"%");
+}
+
+static int32_t
+run_worker (struct bench_shared* shared, int32_t index)
+{
+    struct worker* w = &workers[index];
+    int32_t rtc_fd, garbage, freq = RTC_HZ;
+    volatile uint32_t i;
+
+    ece391_setpriority (0, w->nice);
+    if (!w->interactive) {
+        while (!shared->stop) {
+            shared->loops[index]++;
+        }
+        return 0;
+    }
+
+    if (-1 == (rtc_fd = ece391_open ((uint8_t*)"rtc"))) {
+        return 1;
+    }
+    ece391_write (rtc_fd, &freq, 4);
+    while (!shared->stop) {
+        ece391_read (rtc_fd, &garbage, 4);
+        for (i = 0; i < INTERACTIVE_WORK; i++);
+        shared->loops[index]++;
+    }
+    ece391_close (rtc_fd);
+    return 0;
+}
+
+/*
+ * Scheduler benchmark: forks three CPU-bound workers (two at nice 0, one
+ * at nice 5) and an interactive one that wakes RTC_HZ times a second to
+ * do a little work, lets them run for the given number of seconds, and
+ * reports each one's share of the CPU and how long its wakeups waited.
+ * A fair scheduler gives the nice 0 spinners about 1024/335 = 3x the
+ * share of the nice 5 one, and keeps the interactive wakeups short.
+ */
+int main ()
+{
+    uint8_t args[BUFSIZE];
+    struct bench_shared* shared;
+    int32_t seconds = 0;
+    int32_t rtc_fd, garbage, freq = RTC_HZ;
+    int32_t i, pid;
+    uint32_t elapsed, cpu_us, cpu_weight;
+
+    if (0 == ece391_getargs (args, BUFSIZE)) {
+        for (i = 0; args[i] >= '0' && args[i] <= '9'; i++) {
+            seconds = seconds * 10 + (args[i] - '0');
+        }
+    }
+    if (seconds <= 0 || seconds > MAX_SECONDS) {
+        seconds = DEFAULT_SECONDS;
+    }
+
+    if (-1 == ece391_shmget (SHM_KEY, sizeof (struct bench_shared)) ||
+        ECE391_MEM_FAILED == (shared = ece391_shmat (SHM_KEY))) {
+        ece391_fdputs (1, (uint8_t*)"schedbench: can't attach shared memory\n");
+        return 3;
+    }
+    if (-1 == (rtc_fd = ece391_open ((uint8_t*)"rtc"))) {
+        ece391_fdputs (1, (uint8_t*)"schedbench: can't open the RTC\n");
+        return 3;
+    }
+    ece391_write (rtc_fd, &freq, 4);
+    shared->stop = 0;
+
+    for (i = 0; i < NUM_WORKERS; i++) {
+        shared->loops[i] = 0;
+        pid = ece391_fork ();
+        if (-1 == pid) {
+            ece391_fdputs (1, (uint8_t*)"schedbench: fork failed\n");
+            shared->stop = 1;
+            return 2;
+        }
+        if (0 == pid) {
+            return run_worker (shared, i);
+        }
+        workers[i].pid = pid;
+    }
+
+    /* Let everyone start (and set its nice value), then measure */
+    ece391_read (rtc_fd, &garbage, 4);
+    ece391_read (rtc_fd, &garbage, 4);
+    for (i = 0; i < NUM_WORKERS; i++) {
+        ece391_schedstat (workers[i].pid, &workers[i].start);
+    }
+    for (i = 0; i < seconds * RTC_HZ; i++) {
+        ece391_read (rtc_fd, &garbage, 4);
+    }
+    for (i = 0; i < NUM_WORKERS; i++) {
+        ece391_schedstat (workers[i].pid, &workers[i].end);
+    }
+    shared->stop = 1;
+
+    elapsed = workers[0].end.uptime_us - workers[0].start.uptime_us;
+    cpu_us = cpu_weight = 0;
+    for (i = 0; i < NUM_WORKERS; i++) {
+        if (!workers[i].interactive) {
+            cpu_us += workers[i].end.run_us - workers[i].start.run_us;
+            cpu_weight += nice_weight (workers[i].nice);
+        }
+    }
+
+    ece391_fdputs (1, (uint8_t*)"schedbench: ");
+    put_num (seconds);
+    ece391_fdputs (1, (uint8_t*)"s, ");
+    put_num (elapsed / 1000);
+    ece391_fdputs (1, (uint8_t*)" ms measured\n");
+    for (i = 0; i < NUM_WORKERS; i++) {
+        struct worker* w = &workers[i];
+        uint32_t run = w->end.run_us - w->start.run_us;
+        uint32_t wakeups = w->end.wakeups - w->start.wakeups;
+        uint32_t latency = w->end.wake_latency_total_us - w->start.wake_latency_total_us;
+
+        ece391_fdputs (1, (uint8_t*)w->name);
+        ece391_fdputs (1, (uint8_t*)" nice ");
+        put_num (w->nice);
+        ece391_fdputs (1, (uint8_t*)"  cpu ");
+        put_percent (elapsed >= 1000 ? run / (elapsed / 1000) : 0);
+        if (!w->interactive) {
+            ece391_fdputs (1, (uint8_t*)" (");
+            put_percent (cpu_us >= 1000 ? run / (cpu_us / 1000) : 0);
+            ece391_fdputs (1, (uint8_t*)" of spinners, fair ");
+            put_percent (nice_weight (w->nice) * 1000 / cpu_weight);
+            ece391_fdputs (1, (uint8_t*)")\n");
+        } else {
+            ece391_fdputs (1, (uint8_t*)"  ");
+            put_num (wakeups);
+            ece391_fdputs (1, (uint8_t*)" wakeups, avg ");
+            put_num (wakeups ? latency / wakeups : 0);
+            ece391_fdputs (1, (uint8_t*)"us, max ");
+            put_num (w->end.wake_latency_max_us);
+            ece391_fdputs (1, (uint8_t*)"us\n");
+        }
+    }
+
+    /* Give the workers a moment to see the stop flag and halt */
+    ece391_read (rtc_fd, &garbage, 4);
+    ece391_read (rtc_fd, &garbage, 4);
+    ece391_close (rtc_fd);
+    ece391_shmdt (shared);
+    return 0;
+}
@@ -0,0 +1,63 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define SHM_KEY 391
+#define SHM_BYTES (16 * 4096)
+#define STRIDE 4096
+#define WAIT_TICKS 1000
+
+/*
+ * Checks shared memory: the parent attaches a segment and forks, the
+ * child fills every page of it, and the parent must see the child's
+ * data once the child says it's done (ordinary memory would have been
+ * copied, and the parent would wait forever).
+ */
+int main ()
+{
+    uint32_t* shared;
+    int32_t size, pid, i, rtc_fd, garbage;
+
+    if (SHM_BYTES != (size = ece391_shmget (SHM_KEY, SHM_BYTES)) ||
+        ECE391_MEM_FAILED == (shared = ece391_shmat (SHM_KEY))) {
+        ece391_fdputs (1, (uint8_t*)"shmtest: can't attach the segment\n");
+        return 3;
+    }
+
+    pid = ece391_fork ();
+    if (-1 == pid) {
+        ece391_fdputs (1, (uint8_t*)"shmtest: fork failed\n");
+        return 2;
+    }
+    if (0 == pid) {
+        for (i = 0; i < size / STRIDE; i++) {
+            shared[i * STRIDE / 4] = SHM_KEY + i;
+        }
+        shared[1] = 1;   /* Done */
+        return 0;
+    }
+
+    /* Fork doesn't wait for the child, so sleep on the RTC until it's done */
+    if (-1 == (rtc_fd = ece391_open ((uint8_t*)"rtc"))) {
+        ece391_fdputs (1, (uint8_t*)"shmtest: can't open the RTC\n");
+        return 3;
+    }
+    for (i = 0; i < WAIT_TICKS && 1 != shared[1]; i++) {
+        ece391_read (rtc_fd, &garbage, 4);
+    }
+    ece391_close (rtc_fd);
+
+    for (i = 0; i < size / STRIDE; i++) {
+        if (shared[i * STRIDE / 4] != SHM_KEY + i) {
+            ece391_fdputs (1, (uint8_t*)"shmtest: child's writes are missing\n");
+            return 1;
+        }
+    }
+    if (0 != ece391_shmdt (shared)) {
+        ece391_fdputs (1, (uint8_t*)"shmtest: detach failed\n");
+        return 1;
+    }
+    ece391_fdputs (1, (uint8_t*)"shmtest: passed\n");
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define BUFSIZE 1024
+#define MAX_DEPTH 200
+
+/*
+ * Builds a chain of nested programs: "stress N" executes "stress N-1" and
+ * waits for it, so N+1 processes are alive at the deepest point.  Each level
+ * fills a stack buffer before the call and checks it afterwards, catching a
+ * child (or a process on another terminal) that scribbled on its memory.
+ * Run "stress 20" in all three terminals for 60+ concurrent processes.
+ */
+int main ()
+{
+    uint8_t args[BUFSIZE];
+    uint8_t cmd[BUFSIZE];
+    uint8_t num[BUFSIZE];
+    uint32_t pattern[BUFSIZE / 4];
+    int32_t depth = 0;
+    int32_t nested;
+    int32_t i, ret;
+
+    if (0 != ece391_getargs (args, BUFSIZE)) {
+        ece391_fdputs (1, (uint8_t*)"usage: stress <depth>\n");
+        return 3;
+    }
+    for (i = 0; args[i] >= '0' && args[i] <= '9'; i++) {
+        depth = depth * 10 + (args[i] - '0');
+    }
+    if (0 == i || depth > MAX_DEPTH) {
+        ece391_fdputs (1, (uint8_t*)"usage: stress <depth>\n");
+        return 3;
+    }
+    nested = (' ' == args[i]);   /* Inner levels are run as "stress N-1 -" and stay quiet */
+    if (0 == depth) {
+        return 0;
+    }
+
+    for (i = 0; i < BUFSIZE / 4; i++) {
+        pattern[i] = (depth << 16) ^ i;
+    }
+
+    ece391_strcpy (cmd, (uint8_t*)"stress ");
+    ece391_itoa (depth - 1, num, 10);
+    ece391_strcpy (cmd + ece391_strlen (cmd), num);
+    ece391_strcpy (cmd + ece391_strlen (cmd), (uint8_t*)" -");
+    ret = ece391_execute (cmd);
+
+    for (i = 0; i < BUFSIZE / 4; i++) {
+        if (pattern[i] != ((depth << 16) ^ i)) {
+            ece391_itoa (depth, num, 10);
+            ece391_fdputs (1, (uint8_t*)"stress: memory corrupted at depth ");
+            ece391_fdputs (1, num);
+            ece391_fdputs (1, (uint8_t*)"\n");
+            return 2;
+        }
+    }
+    if (0 != ret) {
+        ece391_itoa (depth - 1, num, 10);
+        ece391_fdputs (1, (uint8_t*)"stress: could not run depth ");
+        ece391_fdputs (1, num);
+        ece391_fdputs (1, (uint8_t*)"\n");
+        return 1;
+    }
+
+    if (!nested) {
+        ece391_itoa (depth, num, 10);
+        ece391_fdputs (1, (uint8_t*)"stress: ");
+        ece391_fdputs (1, num);
+        ece391_fdputs (1, (uint8_t*)" levels passed\n");
+    }
+    return 0;
+}
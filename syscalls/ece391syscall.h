@@ -5,6 +5,18 @@
 
 /* All calls return >= 0 on success or -1 on failure. */
 
+#define ECE391_SEEK_SET 0
+#define ECE391_SEEK_CUR 1
+#define ECE391_SEEK_END 2
+
+#define ECE391_IOV_MAX 16
+
+/* One buffer of an ece391_readv/ece391_writev request. */
+struct ece391_iovec {
+	void* base;
+	int32_t len;
+};
+
 /*  
  * Note that the system call for halt will have to make sure that only
  * the low byte of EBX (the status argument) is returned to the calling
@@ -22,6 +34,155 @@ extern int32_t ece391_vidmap (uint8_t** screen_start);
 extern int32_t ece391_set_handler (int32_t signum, void* handler);
 extern int32_t ece391_sigreturn (void);
 
+/*
+ * Fills buf with as many directory records as fit, continuing from the
+ * position of the directory fd.  Returns the number of bytes of records
+ * written, 0 at the end of the directory, or -1 on failure.
+ */
+extern int32_t ece391_getdents (int32_t fd, void* buf, int32_t nbytes);
+
+#define ECE391_NAME_LEN 32
+
+/* Record layout filled in by ece391_getdents.  The name is not
+ * NUL-terminated when it is exactly ECE391_NAME_LEN characters long. */
+struct ece391_dirent {
+	uint8_t name[ECE391_NAME_LEN];
+	uint32_t file_type;
+	uint32_t inode;
+	uint32_t size;
+};
+
+/*
+ * Moves the position the next read of fd starts at.  whence is one of
+ * the ECE391_SEEK_ values.  Returns the new position, or -1 for the
+ * terminal and RTC, which have no position.
+ */
+extern int32_t ece391_lseek (int32_t fd, int32_t offset, int32_t whence);
+
+/*
+ * Reads from offset without using or moving the position of fd.
+ * Returns the number of bytes read, 0 past the end of the file.
+ */
+extern int32_t ece391_pread (int32_t fd, void* buf, int32_t nbytes, uint32_t offset);
+
+/*
+ * Gather/scatter versions of read and write: one call moves data for up
+ * to ECE391_IOV_MAX buffers, in order.  readv stops after the first
+ * short read.  Both return the total number of bytes moved.
+ */
+extern int32_t ece391_readv (int32_t fd, const struct ece391_iovec* iov, int32_t iovcnt);
+extern int32_t ece391_writev (int32_t fd, const struct ece391_iovec* iov, int32_t iovcnt);
+
+/*
+ * Copies up to count bytes from the position of regular file in_fd to
+ * out_fd inside the kernel.  Returns the number of bytes copied, 0 at
+ * the end of the file.
+ */
+extern int32_t ece391_sendfile (int32_t out_fd, int32_t in_fd, int32_t count);
+
+/*
+ * Moves the end of the heap by increment bytes (negative shrinks it) and
+ * returns the old end, which is the start of the new memory, or
+ * ECE391_MEM_FAILED if the heap would run into the stack.  New memory
+ * reads as zero and is only allocated when first touched.
+ */
+#define ECE391_MEM_FAILED ((void*)-1)
+extern void* ece391_sbrk (int32_t increment);
+
+/*
+ * Maps length bytes of zero-filled memory, allocated page by page as it
+ * is touched.  addr is a page aligned address to map at, or NULL to let
+ * the kernel choose.  Returns the start of the mapping or
+ * ECE391_MEM_FAILED.  munmap frees any part of a mapping; returns 0 or -1.
+ */
+extern void* ece391_mmap (void* addr, int32_t length);
+extern int32_t ece391_munmap (void* addr, int32_t length);
+
+/*
+ * Duplicates the calling program.  The copy shares the caller's memory
+ * copy-on-write, so pages are only copied when one side writes them.
+ * Returns 0 in the copy and its PID in the caller, or -1 on failure.
+ * Both keep running, sharing the caller's terminal.
+ */
+extern int32_t ece391_fork (void);
+
+/*
+ * Shared memory.  shmget creates the segment named key (nonzero) with
+ * at least size bytes, or finds the one another program created, and
+ * returns its size.  shmat maps it and returns its address; every
+ * program attached to the same key sees the same memory, and so does a
+ * child after fork.  shmdt unmaps it; the segment goes away when the
+ * last program detaches or halts.  Failures return -1 (shmat returns
+ * ECE391_MEM_FAILED).
+ */
+#define ECE391_SHM_MAX (256 * 4096)
+extern int32_t ece391_shmget (uint32_t key, int32_t size);
+extern void* ece391_shmat (uint32_t key);
+extern int32_t ece391_shmdt (void* addr);
+
+/*
+ * Scheduling.  The CPU is shared in proportion to weights set by nice
+ * values from -20 (most CPU) to 19 (least); each level is about 10%.
+ * setpriority sets the nice value of pid (0 for the caller), clamping
+ * it to that range; children inherit it.  schedstat reports how many
+ * microseconds pid has run for, the time since boot, and how long its
+ * wakeups (from RTC or keyboard reads) waited for the CPU.  Times wrap
+ * after about 71 minutes, so use differences.  Both return 0, or -1 if
+ * there's no such process.
+ */
+#define ECE391_NICE_MIN (-20)
+#define ECE391_NICE_MAX 19
+
+struct ece391_schedstat {
+    int32_t nice;
+    uint32_t run_us;
+    uint32_t uptime_us;
+    uint32_t wakeups;
+    uint32_t wake_latency_total_us;
+    uint32_t wake_latency_max_us;
+};
+
+extern int32_t ece391_setpriority (int32_t pid, int32_t nice);
+extern int32_t ece391_schedstat (int32_t pid, struct ece391_schedstat* stat);
+
+/*
+ * CPU time accounting.  When nothing can run on a CPU, the kernel halts
+ * it in an idle context; cpustat reports the time since boot and the
+ * time spent halted in microseconds (summed over the CPUs, of which
+ * there are cpus), and how many timer interrupts there have been (in
+ * total and while idle).  The timer is tickless: it only interrupts at
+ * the next scheduling deadline, so this is well under 100 a second per
+ * CPU when one program or none is running.  The microsecond counts wrap
+ * after about 71 minutes, so use differences.  Returns 0.
+ */
+struct ece391_cpustat {
+    uint32_t uptime_us;
+    uint32_t idle_us;
+    uint32_t pit_irqs;
+    uint32_t idle_irqs;
+    uint32_t cpus;
+};
+
+extern int32_t ece391_cpustat (struct ece391_cpustat* stat);
+
+/*
+ * Sleeps for at least ms milliseconds (the kernel's timers tick once a
+ * millisecond), letting other programs run meanwhile.  Returns 0.
+ */
+extern int32_t ece391_sleep_ms (uint32_t ms);
+
+/*
+ * The calls above enter the kernel with SYSENTER when the CPU has it
+ * (ece391_sysenter is then nonzero, see _start) and int $0x80 when it
+ * doesn't; both reach the same system calls.  The null system call
+ * (number 0, which always returns -1) can be made through either one,
+ * to measure what entering and leaving the kernel costs; only use
+ * ece391_null_sysenter if ece391_sysenter is set.
+ */
+extern int32_t ece391_sysenter;
+extern int32_t ece391_null_int (void);
+extern int32_t ece391_null_sysenter (void);
+
 enum signums {
 	DIV_ZERO = 0,
 	SEGFAULT,
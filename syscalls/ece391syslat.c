@@ -0,0 +1,108 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define BUFSIZE 128
+#define DEFAULT_CALLS 100000
+#define MAX_CALLS 1000000
+#define ROUNDS 5              /* The fastest round counts: the others may have been interrupted */
+
+static void
+put_num (uint32_t value)
+{
+    uint8_t num[BUFSIZE];
+
+    ece391_itoa (value, num, 10);
+    ece391_fdputs (1, num);
+}
+
+/*
+ * Makes the null system call calls times through one entry path, ROUNDS
+ * times over, and returns the microseconds the fastest round took, or 0
+ * if any call didn't return -1 (or didn't come back to the right place,
+ * which would show up as a crash).
+ */
+static uint32_t
+time_calls (int32_t (*null_call) (void), uint32_t calls)
+{
+    struct ece391_cpustat start, end;
+    uint32_t i, round, us, best = 0;
+
+    for (round = 0; round < ROUNDS; round++) {
+        ece391_cpustat (&start);
+        for (i = 0; i < calls; i++) {
+            if (-1 != null_call ()) {
+                return 0;
+            }
+        }
+        ece391_cpustat (&end);
+        us = end.uptime_us - start.uptime_us;
+        if (0 == round || us < best) {
+            best = us;
+        }
+    }
+    return 0 == best ? 1 : best;
+}
+
+static void
+report (const char* label, uint32_t us, uint32_t calls)
+{
+    ece391_fdputs (1, (uint8_t*)label);
+    put_num (us);
+    ece391_fdputs (1, (uint8_t*)"us for ");
+    put_num (calls);
+    ece391_fdputs (1, (uint8_t*)" calls, ");
+    put_num (us / calls * 1000 + us % calls * 1000 / calls);
+    ece391_fdputs (1, (uint8_t*)"ns per call\n");
+}
+
+/*
+ * Null system call latency through int $0x80 and through SYSENTER: the
+ * cost of getting into the kernel's dispatcher and back out, with no
+ * work in between.  The optional argument is the number of calls per
+ * round.
+ */
+int main ()
+{
+    uint8_t args[BUFSIZE];
+    uint32_t calls = 0;
+    uint32_t int_us, sysenter_us;
+    struct ece391_cpustat stat;
+    int32_t i;
+
+    if (0 == ece391_getargs (args, BUFSIZE)) {
+        for (i = 0; args[i] >= '0' && args[i] <= '9'; i++) {
+            calls = calls * 10 + (args[i] - '0');
+        }
+    }
+    if (0 == calls || calls > MAX_CALLS) {
+        calls = DEFAULT_CALLS;
+    }
+
+    if (0 == (int_us = time_calls (ece391_null_int, calls))) {
+        ece391_fdputs (1, (uint8_t*)"syslat: int $0x80 null call didn't fail\n");
+        return 2;
+    }
+    report ("int $0x80: ", int_us, calls);
+
+    if (!ece391_sysenter) {
+        ece391_fdputs (1, (uint8_t*)"syslat: this CPU has no SYSENTER\n");
+        return 0;
+    }
+    if (0 == (sysenter_us = time_calls (ece391_null_sysenter, calls))) {
+        ece391_fdputs (1, (uint8_t*)"syslat: SYSENTER null call didn't fail\n");
+        return 2;
+    }
+    report ("sysenter:  ", sysenter_us, calls);
+
+    /* A real call through the wrappers, which now use SYSENTER */
+    if (0 != ece391_cpustat (&stat) || 0 == stat.cpus) {
+        ece391_fdputs (1, (uint8_t*)"syslat: cpustat through SYSENTER failed\n");
+        return 2;
+    }
+    ece391_fdputs (1, (uint8_t*)"sysenter takes ");
+    put_num (sysenter_us * 100 / int_us);
+    ece391_fdputs (1, (uint8_t*)"% of the int $0x80 time\n");
+    return 0;
+}
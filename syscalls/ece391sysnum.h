@@ -11,5 +11,22 @@
 #define SYS_VIDMAP  8
 #define SYS_SET_HANDLER  9
 #define SYS_SIGRETURN  10
+#define SYS_GETDENTS 11
+#define SYS_LSEEK   12
+#define SYS_PREAD   13
+#define SYS_READV   14
+#define SYS_WRITEV  15
+#define SYS_SENDFILE 16
+#define SYS_SBRK    17
+#define SYS_MMAP    18
+#define SYS_MUNMAP  19
+#define SYS_FORK    20
+#define SYS_SHMGET  21
+#define SYS_SHMAT   22
+#define SYS_SHMDT   23
+#define SYS_SETPRIORITY 24
+#define SYS_SCHEDSTAT 25
+#define SYS_CPUSTAT 26
+#define SYS_SLEEP_MS 27
 
 #endif /* ECE391SYSNUM_H */